@@ -22,12 +22,40 @@
 + (BOOL)unzipFileAtPath:(NSString *)path toDestination:(NSString *)destination delegate:(id<SSZipArchiveDelegate>)delegate;
 + (BOOL)unzipFileAtPath:(NSString *)path toDestination:(NSString *)destination overwrite:(BOOL)overwrite password:(NSString *)password error:(NSError **)error delegate:(id<SSZipArchiveDelegate>)delegate;
 
+// Unzip on several threads (0 for one per active processor), largest files first.
+// The delegate is messaged from the worker threads, one message at a time, and fileIndex is the index of the file in the archive.
++ (BOOL)unzipFileAtPath:(NSString *)path toDestination:(NSString *)destination overwrite:(BOOL)overwrite password:(NSString *)password threads:(NSUInteger)threads error:(NSError **)error delegate:(id<SSZipArchiveDelegate>)delegate;
+
+// Unzip with the small files written by writesInFlight threads, so that archives of many small files are not held up by
+// the latency of each write (0 writes them on the calling thread). A file is reported as unzipped once its write is queued.
++ (BOOL)unzipFileAtPath:(NSString *)path toDestination:(NSString *)destination overwrite:(BOOL)overwrite password:(NSString *)password writesInFlight:(NSUInteger)writesInFlight error:(NSError **)error delegate:(id<SSZipArchiveDelegate>)delegate;
+
 // Zip
 + (BOOL)createZipFileAtPath:(NSString *)path withFilesAtPaths:(NSArray *)filenames;
 + (BOOL)createZipFileAtPath:(NSString *)path withContentsOfDirectory:(NSString *)directoryPath;
 
+// Zip on several threads (0 for one per active processor): the files are deflated concurrently, then written to the
+// archive in the same order as by the methods above, large ones going through temporary files.
++ (BOOL)createZipFileAtPath:(NSString *)path withFilesAtPaths:(NSArray *)paths threads:(NSUInteger)threads;
++ (BOOL)createZipFileAtPath:(NSString *)path withContentsOfDirectory:(NSString *)directoryPath threads:(NSUInteger)threads;
+
 + (BOOL)unzipEntityName:(NSString *)name fromFilePath:(NSString *)path toDestination:(NSString *)destination;
 
+// Unzip only the entries whose path starts with prefix (as @"res/fr.lproj/"), or matches a glob pattern (see unzGlobMatch),
+// keeping their paths under destination. They are chosen from the central directory, the other entries are not opened.
++ (BOOL)unzipEntriesWithPrefix:(NSString *)prefix fromFilePath:(NSString *)path toDestination:(NSString *)destination;
++ (BOOL)unzipEntriesMatchingPattern:(NSString *)pattern fromFilePath:(NSString *)path toDestination:(NSString *)destination;
+
+// Contents of one entry read in memory, without a temporary file (nil if it cannot be read). The name is case sensitive,
+// as for the other entry names above.
++ (NSData *)dataForEntry:(NSString *)name inArchive:(NSString *)path;
+
+// Copy entries to a new archive at path without inflating and deflating them (see zipCopyEntryFrom): all the entries of
+// several archives, leaving out those named as an entry already copied from an earlier one, or the entries of one archive
+// for which predicate returns YES.
++ (BOOL)mergeArchivesAtPaths:(NSArray *)paths toPath:(NSString *)path;
++ (BOOL)filterArchiveAtPath:(NSString *)sourcePath toPath:(NSString *)path passingTest:(BOOL (^)(NSString *entryName))predicate;
+
 - (id)initWithPath:(NSString *)path;
 - (BOOL)open;
 - (BOOL)writeFile:(NSString *)path;
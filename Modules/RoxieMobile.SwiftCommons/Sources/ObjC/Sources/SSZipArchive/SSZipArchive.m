@@ -10,6 +10,7 @@
 #import "SSZipArchiveDelegate.h"
 
 #include "minizip/zip.h"
+#include "minizip/mztools.h"
 #import "zlib.h"
 #import "zconf.h"
 
@@ -17,7 +18,22 @@
 
 #define CHUNK 16384
 
+// Files of at most this size are read in memory and handed to the write queue
+#define SSZipArchiveQueuedFileMaxSize (1024 * 1024)
+// Bytes held by the write queue before the unzipping waits for it
+#define SSZipArchiveWriteQueueMaxPending (32 * 1024 * 1024)
+// Bytes of deflated data held in memory by the concurrent zipping, larger files go through temporary files
+#define SSZipArchiveBuilderMaxPending (64 * 1024 * 1024)
+
 @interface SSZipArchive ()
++ (BOOL)_unzipCurrentFileOfZip:(zipFile)zip fileInfo:(unz_file_info)fileInfo toDestination:(NSString *)destination overwrite:(BOOL)overwrite directoriesModificationDates:(NSMutableSet *)directoriesModificationDates;
++ (BOOL)_unzipCurrentFileOfZip:(zipFile)zip fileInfo:(unz_file_info)fileInfo toDestination:(NSString *)destination overwrite:(BOOL)overwrite directoriesModificationDates:(NSMutableSet *)directoriesModificationDates writeQueue:(unzWriteQueue)writeQueue;
++ (BOOL)_unzipFilesAtPositions:(const unz64_file_pos *)filePositions count:(ZPOS64_T)count ofZip:(zipFile)zip toDestination:(NSString *)destination;
++ (BOOL)_copyEntriesOfArchiveAtPath:(NSString *)sourcePath toZip:(zipFile)zip copiedNames:(NSMutableSet *)copiedNames passingTest:(BOOL (^)(NSString *entryName))predicate;
++ (BOOL)_createZipFileAtPath:(NSString *)path withFilesAtPaths:(NSArray *)paths fileNames:(NSArray *)fileNames threads:(NSUInteger)threads;
+- (BOOL)_writeFilesAtPaths:(NSArray *)paths withFileNames:(NSArray *)fileNames threads:(NSUInteger)threads;
+- (void)zipInfo:(zip_fileinfo*)zipInfo setAttributesOfItemAtPath:(NSString *)path;
++ (void)_setModificationDates:(NSSet *)directoriesModificationDates;
 + (NSDate *)_dateWithMSDOSFormat:(UInt32)msdosDateTime;
 @end
 
@@ -47,6 +63,11 @@
 
 
 + (BOOL)unzipFileAtPath:(NSString *)path toDestination:(NSString *)destination overwrite:(BOOL)overwrite password:(NSString *)password error:(NSError **)error delegate:(id<SSZipArchiveDelegate>)delegate {
+	return [self unzipFileAtPath:path toDestination:destination overwrite:overwrite password:password writesInFlight:0 error:error delegate:delegate];
+}
+
+
++ (BOOL)unzipFileAtPath:(NSString *)path toDestination:(NSString *)destination overwrite:(BOOL)overwrite password:(NSString *)password writesInFlight:(NSUInteger)writesInFlight error:(NSError **)error delegate:(id<SSZipArchiveDelegate>)delegate {
 	// Begin opening
 	zipFile zip = unzOpen((const char*)[path UTF8String]);
 	if (zip == NULL) {
@@ -73,10 +94,13 @@
 		return NO;
 	}
 
+	unzWriteQueue writeQueue = NULL;
+	if (writesInFlight > 0) {
+		writeQueue = unzWriteQueueOpen((int)MIN(writesInFlight, (NSUInteger)INT_MAX), SSZipArchiveWriteQueueMaxPending);
+	}
+
 	BOOL success = YES;
 	int ret = 0;
-	unsigned char buffer[4096] = {0};
-	NSFileManager *fileManager = [NSFileManager defaultManager];
 	NSMutableSet *directoriesModificationDates = [[NSMutableSet alloc] init];
 
 	// Message delegate
@@ -123,146 +147,12 @@
 				[delegate zipArchiveProgressEvent:(NSInteger)currentPosition total:(NSInteger)fileSize];
 			}
 
-			char *filename = (char *)malloc(fileInfo.size_filename + 1);
-			unzGetCurrentFileInfo(zip, &fileInfo, filename, fileInfo.size_filename + 1, NULL, 0, NULL, 0);
-			filename[fileInfo.size_filename] = '\0';
-
-	        //
-	        // NOTE
-	        // I used the ZIP spec from here:
-	        // http://www.pkware.com/documents/casestudies/APPNOTE.TXT
-	        //
-	        // ...to deduce this method of detecting whether the file in the ZIP is a symbolic link.
-	        // If it is, it is listed as a directory but has a data size greater than zero (real
-	        // directories have it equal to 0) and the included, uncompressed data is the symbolic link path.
-	        //
-	        // ZIP files did not originally include support for symbolic links so the specification
-	        // doesn't include anything in them that isn't part of a unix extension that isn't being used
-	        // by the archivers we're testing. Most of this is figured out through trial and error and
-	        // reading ZIP headers in hex editors. This seems to do the trick though.
-	        //
-
-	        const uLong ZipCompressionMethodStore = 0;
-
-	        BOOL fileIsSymbolicLink = NO;
-
-	        if((fileInfo.compression_method == ZipCompressionMethodStore) && // Is it compressed?
-	           (S_ISDIR(fileInfo.external_fa)) && // Is it marked as a directory
-	           (fileInfo.compressed_size > 0)) // Is there any data?
-	        {
-	            fileIsSymbolicLink = YES;
-	        }
-
-			// Check if it contains directory
-			NSString *strPath = [NSString stringWithCString:filename encoding:NSUTF8StringEncoding];
-			BOOL isDirectory = NO;
-			if (filename[fileInfo.size_filename-1] == '/' || filename[fileInfo.size_filename-1] == '\\') {
-				isDirectory = YES;
-			}
-			free(filename);
-
-			// Contains a path
-			if ([strPath rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"/\\"]].location != NSNotFound) {
-				strPath = [strPath stringByReplacingOccurrencesOfString:@"\\" withString:@"/"];
-			}
-
-			NSString *fullPath = [destination stringByAppendingPathComponent:strPath];
-			NSError *err = nil;
-	        NSDate *modDate = [[self class] _dateWithMSDOSFormat:(UInt32)fileInfo.dosDate];
-	        NSDictionary *directoryAttr = [NSDictionary dictionaryWithObjectsAndKeys:modDate, NSFileCreationDate, modDate, NSFileModificationDate, nil];
-
-			if (isDirectory) {
-				[fileManager createDirectoryAtPath:fullPath withIntermediateDirectories:YES attributes:directoryAttr  error:&err];
-			} else {
-				[fileManager createDirectoryAtPath:[fullPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:directoryAttr error:&err];
-			}
-	        if (nil != err) {
-	            NSLog(@"[SSZipArchive] Error: %@", err.localizedDescription);
-	        }
-
-	        if(!fileIsSymbolicLink)
-	            [directoriesModificationDates addObject: [NSDictionary dictionaryWithObjectsAndKeys:fullPath, @"path", modDate, @"modDate", nil]];
-
-	        if ([fileManager fileExistsAtPath:fullPath] && !isDirectory && !overwrite) {
+			if (![self _unzipCurrentFileOfZip:zip fileInfo:fileInfo toDestination:destination overwrite:overwrite directoriesModificationDates:directoriesModificationDates writeQueue:writeQueue]) {
 				unzCloseCurrentFile(zip);
 				ret = unzGoToNextFile(zip);
 				continue;
 			}
 
-			if(!fileIsSymbolicLink)
-	        {
-	            FILE *fp = fopen((const char*)[fullPath UTF8String], "wb");
-	            while (fp) {
-	                int readBytes = unzReadCurrentFile(zip, buffer, 4096);
-
-	                if (readBytes > 0) {
-	                    fwrite(buffer, readBytes, 1, fp );
-	                } else {
-	                    break;
-	                }
-	            }
-
-	            if (fp) {
-	                fclose(fp);
-
-	                // Set the original datetime property
-	                if (fileInfo.dosDate != 0) {
-	                    NSDate *orgDate = [[self class] _dateWithMSDOSFormat:(UInt32)fileInfo.dosDate];
-	                    NSDictionary *attr = [NSDictionary dictionaryWithObject:orgDate forKey:NSFileModificationDate];
-
-	                    if (attr) {
-	                        if ([fileManager setAttributes:attr ofItemAtPath:fullPath error:nil] == NO) {
-	                            // Can't set attributes
-	                            NSLog(@"[SSZipArchive] Failed to set attributes - whilst setting modification date");
-	                        }
-	                    }
-	                }
-
-                    // Set the original permissions on the file
-                    uLong permissions = fileInfo.external_fa >> 16;
-                    if (permissions != 0) {
-                        // Store it into a NSNumber
-                        NSNumber *permissionsValue = @(permissions);
-
-                        // Retrieve any existing attributes
-                        NSMutableDictionary *attrs = [[NSMutableDictionary alloc] initWithDictionary:[fileManager attributesOfItemAtPath:fullPath error:nil]];
-
-                        // Set the value in the attributes dict
-                        attrs[NSFilePosixPermissions] = permissionsValue;
-
-                        // Update attributes
-                        if ([fileManager setAttributes:attrs ofItemAtPath:fullPath error:nil] == NO) {
-                            // Unable to set the permissions attribute
-                            NSLog(@"[SSZipArchive] Failed to set attributes - whilst setting permissions");
-                        }
-                        
-#if !__has_feature(objc_arc)
-                        [attrs release];
-#endif
-                    }
-	            }
-	        }
-            else
-            {
-                // Assemble the path for the symbolic link
-                NSMutableString* destinationPath = [NSMutableString string];
-                int bytesRead = 0;
-                while((bytesRead = unzReadCurrentFile(zip, buffer, 4096)) > 0)
-                {
-                    buffer[bytesRead] = 0;
-                    [destinationPath appendString:[NSString stringWithUTF8String:(const char*)buffer]];
-                }
-
-                // Create the symbolic link (making sure it stays relative if it was relative before)
-                int symlinkError = symlink([destinationPath cStringUsingEncoding:NSUTF8StringEncoding],
-                                           [fullPath cStringUsingEncoding:NSUTF8StringEncoding]);
-
-                if(symlinkError != 0)
-                {
-                    NSLog(@"Failed to create symbolic link at \"%@\" to \"%@\". symlink() error code: %d", fullPath, destinationPath, errno);
-                }
-            }
-
 			unzCloseCurrentFile( zip );
 			ret = unzGoToNextFile( zip );
 
@@ -276,21 +166,140 @@
 		}
 	} while(ret == UNZ_OK && ret != UNZ_END_OF_LIST_OF_FILE);
 
+	// Close, once all the files are written
+	unzClose(zip);
+	if (writeQueue != NULL && unzWriteQueueClose(writeQueue, NULL) != UNZ_OK) {
+		success = NO;
+	}
+
+	[self _setModificationDates:directoriesModificationDates];
+
+#if !__has_feature(objc_arc)
+	[directoriesModificationDates release];
+#endif
+
+	// Message delegate
+	if (success && [delegate respondsToSelector:@selector(zipArchiveDidUnzipArchiveAtPath:zipInfo:unzippedPath:)]) {
+		[delegate zipArchiveDidUnzipArchiveAtPath:path zipInfo:globalInfo unzippedPath:destination];
+	}
+	// final progress event = 100%
+	if ([delegate respondsToSelector:@selector(zipArchiveProgressEvent:total:)]) {
+		[delegate zipArchiveProgressEvent:(NSInteger)fileSize total:(NSInteger)fileSize];
+	}
+
+	return success;
+}
+
+
+static int SSZipArchiveUnzipParallelFile(voidpf opaque, unzFile file, ZPOS64_T num_of_file) {
+	int (^unzipFile)(unzFile, ZPOS64_T) = (__bridge int (^)(unzFile, ZPOS64_T))opaque;
+	return unzipFile(file, num_of_file);
+}
+
+
++ (BOOL)unzipFileAtPath:(NSString *)path toDestination:(NSString *)destination overwrite:(BOOL)overwrite password:(NSString *)password threads:(NSUInteger)threads error:(NSError **)error delegate:(id<SSZipArchiveDelegate>)delegate {
+	if (threads == 0) {
+		threads = [[NSProcessInfo processInfo] activeProcessorCount];
+	}
+	if (threads <= 1) {
+		return [self unzipFileAtPath:path toDestination:destination overwrite:overwrite password:password error:error delegate:delegate];
+	}
+
+	// Begin opening, with positional reads so that each worker reads on its own
+	zlib_filefunc64_def fileFunctions;
+	fill_pread_filefunc64(&fileFunctions);
+	zipFile zip = unzOpen2_64((const char*)[path UTF8String], &fileFunctions);
+	if (zip == NULL) {
+		NSDictionary *userInfo = [NSDictionary dictionaryWithObject:@"failed to open zip file" forKey:NSLocalizedDescriptionKey];
+		if (error) {
+			*error = [NSError errorWithDomain:@"SSZipArchiveErrorDomain" code:-1 userInfo:userInfo];
+		}
+		return NO;
+	}
+
+	NSDictionary * fileAttributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+	ZPOS64_T fileSize = fileAttributes.fileSize;
+	__block ZPOS64_T currentPosition = 0;
+
+	unz_global_info  globalInfo = {0ul, 0ul};
+	unzGetGlobalInfo(zip, &globalInfo);
+
+	if (unzGoToFirstFile(zip) != UNZ_OK) {
+		unzClose(zip);
+		NSDictionary *userInfo = [NSDictionary dictionaryWithObject:@"failed to open first file in zip file" forKey:NSLocalizedDescriptionKey];
+		if (error) {
+			*error = [NSError errorWithDomain:@"SSZipArchiveErrorDomain" code:-2 userInfo:userInfo];
+		}
+		return NO;
+	}
+
+	NSMutableSet *directoriesModificationDates = [[NSMutableSet alloc] init];
+	const char *passwordString = ([password length] == 0) ? NULL : [password cStringUsingEncoding:NSASCIIStringEncoding];
+
+	// Message delegate
+	if ([delegate respondsToSelector:@selector(zipArchiveWillUnzipArchiveAtPath:zipInfo:)]) {
+		[delegate zipArchiveWillUnzipArchiveAtPath:path zipInfo:globalInfo];
+	}
+	if ([delegate respondsToSelector:@selector(zipArchiveProgressEvent:total:)]) {
+		[delegate zipArchiveProgressEvent:(NSInteger)currentPosition total:(NSInteger)fileSize];
+	}
+
+	// Called on the worker threads, the delegate is messaged under a lock
+	int (^unzipFile)(unzFile, ZPOS64_T) = ^int(unzFile file, ZPOS64_T fileNumber) {
+		@autoreleasepool {
+			int ret;
+			if (passwordString == NULL) {
+				ret = unzOpenCurrentFile(file);
+			} else {
+				ret = unzOpenCurrentFilePassword(file, passwordString);
+			}
+			if (ret != UNZ_OK) {
+				return ret;
+			}
+
+			unz_file_info fileInfo;
+			memset(&fileInfo, 0, sizeof(unz_file_info));
+
+			ret = unzGetCurrentFileInfo(file, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+			if (ret != UNZ_OK) {
+				unzCloseCurrentFile(file);
+				return ret;
+			}
+
+			@synchronized(directoriesModificationDates) {
+				currentPosition += fileInfo.compressed_size;
+
+				// Message delegate
+				if ([delegate respondsToSelector:@selector(zipArchiveWillUnzipFileAtIndex:totalFiles:archivePath:fileInfo:)]) {
+					[delegate zipArchiveWillUnzipFileAtIndex:(NSInteger)fileNumber totalFiles:(NSInteger)globalInfo.number_entry
+												 archivePath:path fileInfo:fileInfo];
+				}
+				if ([delegate respondsToSelector:@selector(zipArchiveProgressEvent:total:)]) {
+					[delegate zipArchiveProgressEvent:(NSInteger)currentPosition total:(NSInteger)fileSize];
+				}
+			}
+
+			BOOL unzipped = [self _unzipCurrentFileOfZip:file fileInfo:fileInfo toDestination:destination overwrite:overwrite directoriesModificationDates:directoriesModificationDates];
+			unzCloseCurrentFile(file);
+
+			// Message delegate
+			if (unzipped && [delegate respondsToSelector:@selector(zipArchiveDidUnzipFileAtIndex:totalFiles:archivePath:fileInfo:)]) {
+				@synchronized(directoriesModificationDates) {
+					[delegate zipArchiveDidUnzipFileAtIndex:(NSInteger)fileNumber totalFiles:(NSInteger)globalInfo.number_entry
+												archivePath:path fileInfo:fileInfo];
+				}
+			}
+			return UNZ_OK;
+		}
+	};
+
+	int ret = unzParallelForEachFile(zip, (int)MIN(threads, (NSUInteger)INT_MAX), SSZipArchiveUnzipParallelFile, (__bridge voidpf)unzipFile);
+	BOOL success = (ret == UNZ_OK);
+
 	// Close
 	unzClose(zip);
 
-	// The process of decompressing the .zip archive causes the modification times on the folders
-    // to be set to the present time. So, when we are done, they need to be explicitly set.
-    // set the modification date on all of the directories.
-    NSError * err = nil;
-    for (NSDictionary * d in directoriesModificationDates) {
-        if (![[NSFileManager defaultManager] setAttributes:[NSDictionary dictionaryWithObjectsAndKeys:[d objectForKey:@"modDate"], NSFileModificationDate, nil] ofItemAtPath:[d objectForKey:@"path"] error:&err]) {
-            NSLog(@"[SSZipArchive] Set attributes failed for directory: %@.", [d objectForKey:@"path"]);
-        }
-        if (err) {
-            NSLog(@"[SSZipArchive] Error setting directory file modification date attribute: %@",err.localizedDescription);
-        }
-    }
+	[self _setModificationDates:directoriesModificationDates];
 
 #if !__has_feature(objc_arc)
 	[directoriesModificationDates release];
@@ -316,112 +325,148 @@
 		return NO;
 	}
     
-	ZPOS64_T currentPosition = 0;
-    
-	unz_global_info  globalInfo = {0ul, 0ul};
-	unzGetGlobalInfo(zip, &globalInfo);
-    
-	// Begin unzipping
-	if (unzGoToFirstFile(zip) != UNZ_OK) {
+	// Find the entry in the central directory, without opening the other ones
+	if (unzLocateFile(zip, (const char*)[name UTF8String], 1) != UNZ_OK || unzOpenCurrentFile(zip) != UNZ_OK) {
+		unzClose(zip);
 		return NO;
 	}
     
 	BOOL success = NO;
-	int ret = 0;
 	unsigned char buffer[4096] = {0};
 	NSFileManager *fileManager = [NSFileManager defaultManager];
-	NSMutableSet *directoriesModificationDates = [[NSMutableSet alloc] init];
     
-	NSInteger currentFileNumber = 0;
-	do {
-		@autoreleasepool {
-            ret = unzOpenCurrentFile(zip);
-            
-			if (ret != UNZ_OK) {
-				success = NO;
-				break;
-			}
-            
-			// Reading data and write to file
-			unz_file_info fileInfo;
-			memset(&fileInfo, 0, sizeof(unz_file_info));
+	unz_file_info fileInfo;
+	memset(&fileInfo, 0, sizeof(unz_file_info));
+    
+	if (unzGetCurrentFileInfo(zip, &fileInfo, NULL, 0, NULL, 0, NULL, 0) == UNZ_OK) {
+		NSError *err = nil;
+		NSDate *modDate = [[self class] _dateWithMSDOSFormat:(UInt32)fileInfo.dosDate];
+		NSDictionary *directoryAttr = [NSDictionary dictionaryWithObjectsAndKeys:modDate, NSFileCreationDate, modDate, NSFileModificationDate, nil];
+        
+		/* Create directories for destination */
+		[fileManager createDirectoryAtPath:[destination stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:directoryAttr error:&err];
+        
+		if (nil != err) {
+			NSLog(@"Error creating directories for destination[%@]: %@",[destination stringByDeletingLastPathComponent], err);
+		}
+        
+		/* Open destination file for write */
+		FILE *fp = fopen((const char*)[destination UTF8String], "wb");
+		while (fp) {
+			int readBytes = unzReadCurrentFile(zip, buffer, 4096);
             
-			ret = unzGetCurrentFileInfo(zip, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
-			if (ret != UNZ_OK) {
-				success = NO;
-				unzCloseCurrentFile(zip);
+			if (readBytes > 0) {
+				fwrite(buffer, readBytes, 1, fp );
+			} else {
 				break;
 			}
-            
-			currentPosition += fileInfo.compressed_size;
-            
-			char *filename = (char *)malloc(fileInfo.size_filename + 1);
-			unzGetCurrentFileInfo(zip, &fileInfo, filename, fileInfo.size_filename + 1, NULL, 0, NULL, 0);
-			filename[fileInfo.size_filename] = '\0';
-            
-			NSString *strPath = [NSString stringWithCString:filename encoding:NSUTF8StringEncoding];
-			free(filename);
-            
-            if([strPath isEqualToString:name]) { /* If file is the one that we're looking to */
-                
-                NSError *err = nil;
-                NSDate *modDate = [[self class] _dateWithMSDOSFormat:(UInt32)fileInfo.dosDate];
-                NSDictionary *directoryAttr = [NSDictionary dictionaryWithObjectsAndKeys:modDate, NSFileCreationDate, modDate, NSFileModificationDate, nil];
-                
-                /* Create directories for destination */
-                [fileManager createDirectoryAtPath:[destination stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:directoryAttr error:&err];
-                
-                if (nil != err) {
-                    NSLog(@"Error creating directories for destination[%@]: %@",[destination stringByDeletingLastPathComponent], err);
-                }
-                
-                /* Open destination file for write */
-                FILE *fp = fopen((const char*)[destination UTF8String], "wb");
-                while (fp) {
-                    int readBytes = unzReadCurrentFile(zip, buffer, 4096);
-                    
-                    if (readBytes > 0) {
-                        fwrite(buffer, readBytes, 1, fp );
-                    } else {
-                        break;
-                    }
-                }
-                
-                if (fp) {
-                    fclose(fp);
-                }
-                if (nil == err) {
-                    success = YES;
-                }
-            }
-	        
-            /* Move to next file */
-			unzCloseCurrentFile( zip );
-			ret = unzGoToNextFile( zip );
-			currentFileNumber++;
 		}
-	} while(ret == UNZ_OK && ret != UNZ_END_OF_LIST_OF_FILE);
+        
+		if (fp) {
+			fclose(fp);
+		}
+		if (nil == err) {
+			success = YES;
+		}
+	}
     
 	// Close
+	unzCloseCurrentFile(zip);
 	unzClose(zip);
     
-	// The process of decompressing the .zip archive causes the modification times on the folders
-    // to be set to the present time. So, when we are done, they need to be explicitly set.
-    // set the modification date on all of the directories.
-    NSError * err = nil;
-    for (NSDictionary * d in directoriesModificationDates) {
-        if (![[NSFileManager defaultManager] setAttributes:[NSDictionary dictionaryWithObjectsAndKeys:[d objectForKey:@"modDate"], NSFileModificationDate, nil] ofItemAtPath:[d objectForKey:@"path"] error:&err]) {
-            NSLog(@"[SSZipArchive] Set attributes failed for directory: %@.", [d objectForKey:@"path"]);
-        }
-        if (err) {
-            NSLog(@"[SSZipArchive] Error setting directory file modification date attribute: %@",err.localizedDescription);
-        }
-    }
-    
-#if !__has_feature(objc_arc)
-	[directoriesModificationDates release];
-#endif
-    
+	return success;
+}
+
+
++ (BOOL)unzipEntriesWithPrefix:(NSString *)prefix fromFilePath:(NSString *)path toDestination:(NSString *)destination {
+	zipFile zip = unzOpen((const char*)[path UTF8String]);
+	if (zip == NULL) {
+		return NO;
+	}
+
+	unz64_file_pos *filePositions = NULL;
+	ZPOS64_T count = 0;
+	BOOL success = NO;
+	if (unzSelectFilesWithPrefix(zip, (const char*)[prefix UTF8String], 1, &filePositions, &count) == UNZ_OK) {
+		success = [self _unzipFilesAtPositions:filePositions count:count ofZip:zip toDestination:destination];
+	}
+	free(filePositions);
+	unzClose(zip);
+	return success;
+}
+
+
++ (BOOL)unzipEntriesMatchingPattern:(NSString *)pattern fromFilePath:(NSString *)path toDestination:(NSString *)destination {
+	zipFile zip = unzOpen((const char*)[path UTF8String]);
+	if (zip == NULL) {
+		return NO;
+	}
+
+	unz64_file_pos *filePositions = NULL;
+	ZPOS64_T count = 0;
+	BOOL success = NO;
+	if (unzSelectFilesMatching(zip, (const char*)[pattern UTF8String], 1, &filePositions, &count) == UNZ_OK) {
+		success = [self _unzipFilesAtPositions:filePositions count:count ofZip:zip toDestination:destination];
+	}
+	free(filePositions);
+	unzClose(zip);
+	return success;
+}
+
++ (NSData *)dataForEntry:(NSString *)name inArchive:(NSString *)path
+{
+	unzFile zip = unzOpen64((const char*)[path UTF8String]);
+	if (zip == NULL) {
+		return nil;
+	}
+
+	void *bytes = NULL;
+	ZPOS64_T length = 0;
+	int ret = unzReadEntryToBuffer(zip, [name UTF8String], 1, &bytes, &length);
+	unzClose(zip);
+	if (ret != UNZ_OK) {
+		return nil;
+	}
+
+	// The buffer was allocated with malloc, NSData takes it over without a copy
+	return [NSData dataWithBytesNoCopy:bytes length:(NSUInteger)length freeWhenDone:YES];
+}
+
+
+#pragma mark - Copying
+
++ (BOOL)mergeArchivesAtPaths:(NSArray *)paths toPath:(NSString *)path {
+	zipFile zip = zipOpen([path UTF8String], APPEND_STATUS_CREATE);
+	if (zip == NULL) {
+		return NO;
+	}
+
+	BOOL success = YES;
+	NSMutableSet *copiedNames = [NSMutableSet set];
+	for (NSString *sourcePath in paths) {
+		if (![self _copyEntriesOfArchiveAtPath:sourcePath toZip:zip copiedNames:copiedNames passingTest:nil]) {
+			success = NO;
+			break;
+		}
+	}
+
+	if (zipClose(zip, NULL) != ZIP_OK) {
+		success = NO;
+	}
+	return success;
+}
+
+
++ (BOOL)filterArchiveAtPath:(NSString *)sourcePath toPath:(NSString *)path passingTest:(BOOL (^)(NSString *entryName))predicate {
+	zipFile zip = zipOpen([path UTF8String], APPEND_STATUS_CREATE);
+	if (zip == NULL) {
+		return NO;
+	}
+
+	BOOL success = [self _copyEntriesOfArchiveAtPath:sourcePath toZip:zip copiedNames:nil passingTest:predicate];
+	if (zipClose(zip, NULL) != ZIP_OK) {
+		success = NO;
+	}
 	return success;
 }
 
@@ -478,6 +523,55 @@
 }
 
 
++ (BOOL)createZipFileAtPath:(NSString *)path withFilesAtPaths:(NSArray *)paths threads:(NSUInteger)threads {
+	if (threads == 0) {
+		threads = [[NSProcessInfo processInfo] activeProcessorCount];
+	}
+	if (threads <= 1) {
+		return [self createZipFileAtPath:path withFilesAtPaths:paths];
+	}
+
+	NSMutableArray *fileNames = [NSMutableArray arrayWithCapacity:[paths count]];
+	for (NSString *filePath in paths) {
+		[fileNames addObject:filePath.lastPathComponent];
+	}
+	return [self _createZipFileAtPath:path withFilesAtPaths:paths fileNames:fileNames threads:threads];
+}
+
+
++ (BOOL)createZipFileAtPath:(NSString *)path withContentsOfDirectory:(NSString *)directoryPath threads:(NSUInteger)threads {
+	if (threads == 0) {
+		threads = [[NSProcessInfo processInfo] activeProcessorCount];
+	}
+	if (threads <= 1) {
+		return [self createZipFileAtPath:path withContentsOfDirectory:directoryPath];
+	}
+
+	// The files are listed first, so that they keep the order of the directory enumeration
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	NSDirectoryEnumerator *dirEnumerator = [fileManager enumeratorAtPath:directoryPath];
+	NSMutableArray *paths = [NSMutableArray array];
+	NSMutableArray *fileNames = [NSMutableArray array];
+
+	NSString *fileName;
+	while ((fileName = [dirEnumerator nextObject])) {
+		BOOL isDir;
+		NSString *fullFilePath = [directoryPath stringByAppendingPathComponent:fileName];
+		[fileManager fileExistsAtPath:fullFilePath isDirectory:&isDir];
+		if (!isDir) {
+			[paths addObject:fullFilePath];
+			[fileNames addObject:fileName];
+		}
+	}
+
+#if !__has_feature(objc_arc)
+	[fileManager release];
+#endif
+
+	return [self _createZipFileAtPath:path withFilesAtPaths:paths fileNames:fileNames threads:threads];
+}
+
+
 - (id)initWithPath:(NSString *)path {
 	if ((self = [super init])) {
 		_path = [path copy];
@@ -539,14 +633,39 @@
     }
 
     zip_fileinfo zipInfo = {{0}};
+    [self zipInfo:&zipInfo setAttributesOfItemAtPath:path];
+
+	void *buffer = malloc(CHUNK);
+	unsigned int len = (unsigned int) fread(buffer, 1, CHUNK, input);
+
+	// Media and archives, which would not shrink, are stored instead of deflated, judging by the name and the first chunk
+	int method, level, strategy;
+	zipChooseCompression(NULL, afileName, buffer, len, &method, &level, &strategy);
+	zipOpenNewFileInZip4_64(_zip, afileName, &zipInfo, NULL, 0, NULL, 0, NULL, method, level, 0, -MAX_WBITS, DEF_MEM_LEVEL, strategy, NULL, 0, 0, 0, 0);
+	zipWriteInFileInZip(_zip, buffer, len);
+
+    while (!feof(input))
+    {
+		len = (unsigned int) fread(buffer, 1, CHUNK, input);
+		zipWriteInFileInZip(_zip, buffer, len);
+	}
+
+	zipCloseFileInZip(_zip);
+	free(buffer);
+	fclose(input);
+	return YES;
+}
+
 
+// modification date and permissions of the file at *path*
+- (void)zipInfo:(zip_fileinfo*)zipInfo setAttributesOfItemAtPath:(NSString *)path {
     NSDictionary *attr = [[NSFileManager defaultManager] attributesOfItemAtPath:path error: nil];
     if( attr )
     {
         NSDate *fileDate = (NSDate *)[attr objectForKey:NSFileModificationDate];
         if( fileDate )
         {
-            [self zipInfo:&zipInfo setDate: fileDate ];
+            [self zipInfo:zipInfo setDate: fileDate ];
         }
 
         // Write permissions into the external attributes, for details on this see here: http://unix.stackexchange.com/a/14727
@@ -563,25 +682,9 @@
             uLong permissionsLong = @(permissionsOctal).unsignedLongValue;
 
             // Store this into the external file attributes once it has been shifted 16 places left to form part of the second from last byte
-            zipInfo.external_fa = permissionsLong << 16L;
+            zipInfo->external_fa = permissionsLong << 16L;
         }
     }
-
-    zipOpenNewFileInZip(_zip, afileName, &zipInfo, NULL, 0, NULL, 0, NULL, Z_DEFLATED, Z_DEFAULT_COMPRESSION);
-
-	void *buffer = malloc(CHUNK);
-	unsigned int len = 0;
-
-    while (!feof(input))
-    {
-		len = (unsigned int) fread(buffer, 1, CHUNK, input);
-		zipWriteInFileInZip(_zip, buffer, len);
-	}
-
-	zipCloseFileInZip(_zip);
-	free(buffer);
-	fclose(input);
-	return YES;
 }
 
 
@@ -595,7 +698,9 @@
     zip_fileinfo zipInfo = {{0,0,0,0,0,0},0,0,0};
     [self zipInfo:&zipInfo setDate:[NSDate date]];
 
-	zipOpenNewFileInZip(_zip, [filename UTF8String], &zipInfo, NULL, 0, NULL, 0, NULL, Z_DEFLATED, Z_DEFAULT_COMPRESSION);
+	int method, level, strategy;
+	zipChooseCompression(NULL, [filename UTF8String], data.bytes, (uLong)data.length, &method, &level, &strategy);
+	zipOpenNewFileInZip4_64(_zip, [filename UTF8String], &zipInfo, NULL, 0, NULL, 0, NULL, method, level, 0, -MAX_WBITS, DEF_MEM_LEVEL, strategy, NULL, 0, 0, 0, 0);
 
     zipWriteInFileInZip(_zip, data.bytes, (unsigned int)data.length);
 
@@ -604,6 +709,38 @@
 }
 
 
+// The files are deflated by a zipBuilder on *threads* threads, and written in the order of *paths*
+- (BOOL)_writeFilesAtPaths:(NSArray *)paths withFileNames:(NSArray *)fileNames threads:(NSUInteger)threads {
+    NSAssert((_zip != NULL), @"Attempting to write to an archive which was never opened");
+
+	zipBuilder builder = zipBuilderOpen(_zip, (int)threads, SSZipArchiveBuilderMaxPending);
+	if (builder == NULL) {
+		return NO;
+	}
+
+	int ret = ZIP_OK;
+	NSUInteger count = [paths count];
+	for (NSUInteger i = 0; i < count && ret == ZIP_OK; i++) {
+		@autoreleasepool {
+			NSString *filePath = [paths objectAtIndex:i];
+			const char *fileName = [[fileNames objectAtIndex:i] UTF8String];
+			zip_fileinfo zipInfo = {{0}};
+			[self zipInfo:&zipInfo setAttributesOfItemAtPath:filePath];
+
+			// The builder reads the files on its threads: media and archives are told by their names here,
+			// and the other files which the deflate does not make smaller are stored by the builder
+			int method, level, strategy;
+			zipChooseCompression(NULL, fileName, NULL, 0, &method, &level, &strategy);
+			ret = zipBuilderAddFile(builder, [filePath UTF8String], fileName, &zipInfo, level);
+		}
+	}
+
+	// Files which cannot be read are left out, as by writeFileAtPath:withFileName:
+	int closeRet = zipBuilderClose(builder, NULL);
+	return (ret == ZIP_OK) && (closeRet == ZIP_OK);
+}
+
+
 - (BOOL)close {
 	NSAssert((_zip != NULL), @"[SSZipArchive] Attempting to close an archive which was never opened");
 	zipClose(_zip, NULL);
@@ -613,6 +750,283 @@
 
 #pragma mark - Private
 
++ (BOOL)_createZipFileAtPath:(NSString *)path withFilesAtPaths:(NSArray *)paths fileNames:(NSArray *)fileNames threads:(NSUInteger)threads {
+	BOOL success = NO;
+	SSZipArchive *zipArchive = [[SSZipArchive alloc] initWithPath:path];
+	if ([zipArchive open]) {
+		success = [zipArchive _writeFilesAtPaths:paths withFileNames:fileNames threads:threads];
+		success = [zipArchive close] && success;
+	}
+
+#if !__has_feature(objc_arc)
+	[zipArchive release];
+#endif
+
+	return success;
+}
+
+
++ (BOOL)_unzipCurrentFileOfZip:(zipFile)zip fileInfo:(unz_file_info)fileInfo toDestination:(NSString *)destination overwrite:(BOOL)overwrite directoriesModificationDates:(NSMutableSet *)directoriesModificationDates {
+	return [self _unzipCurrentFileOfZip:zip fileInfo:fileInfo toDestination:destination overwrite:overwrite directoriesModificationDates:directoriesModificationDates writeQueue:NULL];
+}
+
+
++ (BOOL)_unzipCurrentFileOfZip:(zipFile)zip fileInfo:(unz_file_info)fileInfo toDestination:(NSString *)destination overwrite:(BOOL)overwrite directoriesModificationDates:(NSMutableSet *)directoriesModificationDates writeQueue:(unzWriteQueue)writeQueue {
+	unsigned char buffer[4096] = {0};
+	NSFileManager *fileManager = [NSFileManager defaultManager];
+
+	char *filename = (char *)malloc(fileInfo.size_filename + 1);
+	unzGetCurrentFileInfo(zip, &fileInfo, filename, fileInfo.size_filename + 1, NULL, 0, NULL, 0);
+	filename[fileInfo.size_filename] = '\0';
+
+	//
+	// NOTE
+	// I used the ZIP spec from here:
+	// http://www.pkware.com/documents/casestudies/APPNOTE.TXT
+	//
+	// ...to deduce this method of detecting whether the file in the ZIP is a symbolic link.
+	// If it is, it is listed as a directory but has a data size greater than zero (real
+	// directories have it equal to 0) and the included, uncompressed data is the symbolic link path.
+	//
+	// ZIP files did not originally include support for symbolic links so the specification
+	// doesn't include anything in them that isn't part of a unix extension that isn't being used
+	// by the archivers we're testing. Most of this is figured out through trial and error and
+	// reading ZIP headers in hex editors. This seems to do the trick though.
+	//
+
+	const uLong ZipCompressionMethodStore = 0;
+
+	BOOL fileIsSymbolicLink = NO;
+
+	if((fileInfo.compression_method == ZipCompressionMethodStore) && // Is it compressed?
+	   (S_ISDIR(fileInfo.external_fa)) && // Is it marked as a directory
+	   (fileInfo.compressed_size > 0)) // Is there any data?
+	{
+		fileIsSymbolicLink = YES;
+	}
+
+	// Check if it contains directory
+	NSString *strPath = [NSString stringWithCString:filename encoding:NSUTF8StringEncoding];
+	BOOL isDirectory = NO;
+	if (filename[fileInfo.size_filename-1] == '/' || filename[fileInfo.size_filename-1] == '\\') {
+		isDirectory = YES;
+	}
+	free(filename);
+
+	// Contains a path
+	if ([strPath rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"/\\"]].location != NSNotFound) {
+		strPath = [strPath stringByReplacingOccurrencesOfString:@"\\" withString:@"/"];
+	}
+
+	NSString *fullPath = [destination stringByAppendingPathComponent:strPath];
+	NSError *err = nil;
+	NSDate *modDate = [[self class] _dateWithMSDOSFormat:(UInt32)fileInfo.dosDate];
+	NSDictionary *directoryAttr = [NSDictionary dictionaryWithObjectsAndKeys:modDate, NSFileCreationDate, modDate, NSFileModificationDate, nil];
+
+	if (isDirectory) {
+		[fileManager createDirectoryAtPath:fullPath withIntermediateDirectories:YES attributes:directoryAttr  error:&err];
+	} else {
+		[fileManager createDirectoryAtPath:[fullPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:directoryAttr error:&err];
+	}
+	if (nil != err) {
+		NSLog(@"[SSZipArchive] Error: %@", err.localizedDescription);
+	}
+
+	if(!fileIsSymbolicLink) {
+		@synchronized(directoriesModificationDates) {
+			[directoriesModificationDates addObject: [NSDictionary dictionaryWithObjectsAndKeys:fullPath, @"path", modDate, @"modDate", nil]];
+		}
+	}
+
+	if ([fileManager fileExistsAtPath:fullPath] && !isDirectory && !overwrite) {
+		return NO;
+	}
+
+	if(!fileIsSymbolicLink && !isDirectory && writeQueue != NULL && fileInfo.uncompressed_size <= SSZipArchiveQueuedFileMaxSize)
+	{
+		// Small file: read in memory, the queue writes it and sets its date and permissions
+		uLong size = fileInfo.uncompressed_size;
+		unsigned char *data = (unsigned char *)malloc(size > 0 ? size : 1);
+		uLong dataLength = 0;
+		int readBytes = 0;
+		while (data != NULL && dataLength < size &&
+			   (readBytes = unzReadCurrentFile(zip, data + dataLength, (unsigned)(size - dataLength))) > 0) {
+			dataLength += (uLong)readBytes;
+		}
+		if (data == NULL || readBytes < 0 || dataLength != size) {
+			free(data);
+			return NO;
+		}
+		if (unzWriteQueueSubmit(writeQueue, (const char*)[fullPath UTF8String], data, (size_t)size,
+								(unsigned)(fileInfo.external_fa >> 16), fileInfo.dosDate) != UNZ_OK) {
+			NSLog(@"[SSZipArchive] Failed to write \"%@\"", fullPath);
+		}
+	}
+	else if(!fileIsSymbolicLink)
+	{
+		FILE *fp = fopen((const char*)[fullPath UTF8String], "wb");
+		while (fp) {
+			int readBytes = unzReadCurrentFile(zip, buffer, sizeof(buffer));
+
+			if (readBytes > 0) {
+				fwrite(buffer, readBytes, 1, fp );
+			} else {
+				break;
+			}
+		}
+
+		if (fp) {
+			fclose(fp);
+
+			// Set the original datetime property
+			if (fileInfo.dosDate != 0) {
+				NSDate *orgDate = [[self class] _dateWithMSDOSFormat:(UInt32)fileInfo.dosDate];
+				NSDictionary *attr = [NSDictionary dictionaryWithObject:orgDate forKey:NSFileModificationDate];
+
+				if (attr) {
+					if ([fileManager setAttributes:attr ofItemAtPath:fullPath error:nil] == NO) {
+						// Can't set attributes
+						NSLog(@"[SSZipArchive] Failed to set attributes - whilst setting modification date");
+					}
+				}
+			}
+
+			// Set the original permissions on the file
+			uLong permissions = fileInfo.external_fa >> 16;
+			if (permissions != 0) {
+				// Store it into a NSNumber
+				NSNumber *permissionsValue = @(permissions);
+
+				// Retrieve any existing attributes
+				NSMutableDictionary *attrs = [[NSMutableDictionary alloc] initWithDictionary:[fileManager attributesOfItemAtPath:fullPath error:nil]];
+
+				// Set the value in the attributes dict
+				attrs[NSFilePosixPermissions] = permissionsValue;
+
+				// Update attributes
+				if ([fileManager setAttributes:attrs ofItemAtPath:fullPath error:nil] == NO) {
+					// Unable to set the permissions attribute
+					NSLog(@"[SSZipArchive] Failed to set attributes - whilst setting permissions");
+				}
+
+#if !__has_feature(objc_arc)
+				[attrs release];
+#endif
+			}
+		}
+	}
+	else
+	{
+		// Assemble the path for the symbolic link
+		NSMutableString* destinationPath = [NSMutableString string];
+		int bytesRead = 0;
+		while((bytesRead = unzReadCurrentFile(zip, buffer, sizeof(buffer) - 1)) > 0)
+		{
+			buffer[bytesRead] = 0;
+			[destinationPath appendString:[NSString stringWithUTF8String:(const char*)buffer]];
+		}
+
+		// Create the symbolic link (making sure it stays relative if it was relative before)
+		int symlinkError = symlink([destinationPath cStringUsingEncoding:NSUTF8StringEncoding],
+		                           [fullPath cStringUsingEncoding:NSUTF8StringEncoding]);
+
+		if(symlinkError != 0)
+		{
+			NSLog(@"Failed to create symbolic link at \"%@\" to \"%@\". symlink() error code: %d", fullPath, destinationPath, errno);
+		}
+	}
+
+	return YES;
+}
+
+
++ (BOOL)_unzipFilesAtPositions:(const unz64_file_pos *)filePositions count:(ZPOS64_T)count ofZip:(zipFile)zip toDestination:(NSString *)destination {
+	BOOL success = YES;
+	NSMutableSet *directoriesModificationDates = [[NSMutableSet alloc] init];
+
+	for (ZPOS64_T i = 0; i < count; i++) {
+		@autoreleasepool {
+			if (unzGoToFilePos64(zip, &filePositions[i]) != UNZ_OK || unzOpenCurrentFile(zip) != UNZ_OK) {
+				success = NO;
+				break;
+			}
+
+			unz_file_info fileInfo;
+			memset(&fileInfo, 0, sizeof(unz_file_info));
+			if (unzGetCurrentFileInfo(zip, &fileInfo, NULL, 0, NULL, 0, NULL, 0) == UNZ_OK) {
+				[self _unzipCurrentFileOfZip:zip fileInfo:fileInfo toDestination:destination overwrite:YES directoriesModificationDates:directoriesModificationDates];
+			} else {
+				success = NO;
+			}
+			unzCloseCurrentFile(zip);
+		}
+	}
+
+	[self _setModificationDates:directoriesModificationDates];
+
+#if !__has_feature(objc_arc)
+	[directoriesModificationDates release];
+#endif
+
+	return success;
+}
+
+
++ (BOOL)_copyEntriesOfArchiveAtPath:(NSString *)sourcePath toZip:(zipFile)zip copiedNames:(NSMutableSet *)copiedNames passingTest:(BOOL (^)(NSString *entryName))predicate {
+	unzFile source = unzOpen64((const char*)[sourcePath UTF8String]);
+	if (source == NULL) {
+		return NO;
+	}
+
+	int ret = unzGoToFirstFile(source);
+	while (ret == UNZ_OK) {
+		@autoreleasepool {
+			unz_file_info64 fileInfo;
+			ret = unzGetCurrentFileInfo64(source, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+			if (ret == UNZ_OK) {
+				char *filename = (char *)malloc(fileInfo.size_filename + 1);
+				unzGetCurrentFileInfo64(source, &fileInfo, filename, fileInfo.size_filename + 1, NULL, 0, NULL, 0);
+				filename[fileInfo.size_filename] = '\0';
+
+				// Names which are not UTF-8 are taken byte for byte, so that they can still be told apart
+				NSString *name = [NSString stringWithCString:filename encoding:NSUTF8StringEncoding];
+				if (name == nil) {
+					name = [NSString stringWithCString:filename encoding:NSISOLatin1StringEncoding];
+				}
+				free(filename);
+
+				if ((predicate == nil || predicate(name)) && ![copiedNames containsObject:name]) {
+					ret = zipCopyEntryFrom(zip, source, NULL);
+					[copiedNames addObject:name];
+				}
+			}
+			if (ret == UNZ_OK) {
+				ret = unzGoToNextFile(source);
+			}
+		}
+	}
+
+	unzClose(source);
+	return (ret == UNZ_END_OF_LIST_OF_FILE);
+}
+
+
++ (void)_setModificationDates:(NSSet *)directoriesModificationDates {
+	// The process of decompressing the .zip archive causes the modification times on the folders
+	// to be set to the present time. So, when we are done, they need to be explicitly set.
+	// set the modification date on all of the directories.
+	NSError * err = nil;
+	for (NSDictionary * d in directoriesModificationDates) {
+		if (![[NSFileManager defaultManager] setAttributes:[NSDictionary dictionaryWithObjectsAndKeys:[d objectForKey:@"modDate"], NSFileModificationDate, nil] ofItemAtPath:[d objectForKey:@"path"] error:&err]) {
+			NSLog(@"[SSZipArchive] Set attributes failed for directory: %@.", [d objectForKey:@"path"]);
+		}
+		if (err) {
+			NSLog(@"[SSZipArchive] Error setting directory file modification date attribute: %@",err.localizedDescription);
+		}
+	}
+}
+
+
 // Format from http://newsgroups.derkeiler.com/Archive/Comp/comp.os.msdos.programmer/2009-04/msg00060.html
 // Two consecutive words, or a longword, YYYYYYYMMMMDDDDD hhhhhmmmmmmsssss
 // YYYYYYY is years from 1980 = 0
@@ -645,7 +1059,11 @@
     [components setMinute:(msdosDateTime & kMinuteMask) >> 5];
     [components setSecond:(msdosDateTime & kSecondMask) * 2];
 
-    NSDate *date = [NSDate dateWithTimeInterval:0 sinceDate:[gregorian dateFromComponents:components]];
+    // The calendar is shared by the threads of a parallel unzip
+    NSDate *date = nil;
+    @synchronized(gregorian) {
+        date = [NSDate dateWithTimeInterval:0 sinceDate:[gregorian dateFromComponents:components]];
+    }
 
 #if !__has_feature(objc_arc)
 	[components release];
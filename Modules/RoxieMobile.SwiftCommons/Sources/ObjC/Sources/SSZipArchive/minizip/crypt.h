@@ -32,7 +32,7 @@
 /***********************************************************************
  * Return the next byte in the pseudo-random sequence
  */
-static int decrypt_byte(unsigned long* pkeys, const unsigned long* pcrc_32_tab)
+static int decrypt_byte(unsigned long* pkeys, const z_crc_t* pcrc_32_tab)
 {
     unsigned temp;  /* POTENTIAL BUG:  temp*(temp^1) may overflow in an
                      * unpredictable manner on 16-bit systems; not a problem
@@ -45,7 +45,7 @@ static int decrypt_byte(unsigned long* pkeys, const unsigned long* pcrc_32_tab)
 /***********************************************************************
  * Update the encryption keys with the next byte of plain text
  */
-static int update_keys(unsigned long* pkeys,const unsigned long* pcrc_32_tab,int c)
+static int update_keys(unsigned long* pkeys,const z_crc_t* pcrc_32_tab,int c)
 {
     (*(pkeys+0)) = CRC32((*(pkeys+0)), c);
     (*(pkeys+1)) += (*(pkeys+0)) & 0xff;
@@ -62,7 +62,7 @@ static int update_keys(unsigned long* pkeys,const unsigned long* pcrc_32_tab,int
  * Initialize the encryption keys and the random header according to
  * the given password.
  */
-static void init_keys(const char* passwd,unsigned long* pkeys,const unsigned long* pcrc_32_tab)
+static void init_keys(const char* passwd,unsigned long* pkeys,const z_crc_t* pcrc_32_tab)
 {
     *(pkeys+0) = 305419896L;
     *(pkeys+1) = 591751049L;
@@ -79,8 +79,66 @@ static void init_keys(const char* passwd,unsigned long* pkeys,const unsigned lon
 #define zencode(pkeys,pcrc_32_tab,c,t) \
     (t=decrypt_byte(pkeys,pcrc_32_tab), update_keys(pkeys,pcrc_32_tab,c), t^(c))
 
+#ifdef INCLUDEDECRYPTINGCODE
+
+/***********************************************************************
+ * Decrypt len bytes of buf in place, as zdecode on each byte, with the
+ * keys held in 32-bit locals instead of being loaded and stored for every
+ * byte (only their low 32 bits matter)
+ */
+static void zdecode_block(unsigned long* pkeys, const z_crc_t* pcrc_32_tab,
+                          unsigned char* buf, size_t len)
+{
+    z_crc_t key0 = (z_crc_t)*(pkeys+0);
+    z_crc_t key1 = (z_crc_t)*(pkeys+1);
+    z_crc_t key2 = (z_crc_t)*(pkeys+2);
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        unsigned temp = ((unsigned)key2 & 0xffff) | 2;
+        unsigned c = buf[i] ^ (((temp * (temp ^ 1)) >> 8) & 0xff);
+        buf[i] = (unsigned char)c;
+        key0 = (z_crc_t)CRC32(key0, c);
+        key1 = (z_crc_t)((key1 + (key0 & 0xff)) * 134775813L + 1);
+        key2 = (z_crc_t)CRC32(key2, (unsigned)(key1 >> 24));
+    }
+
+    *(pkeys+0) = key0;
+    *(pkeys+1) = key1;
+    *(pkeys+2) = key2;
+}
+
+#endif
+
 #ifdef INCLUDECRYPTINGCODE_IFCRYPTALLOWED
 
+/***********************************************************************
+ * Encrypt len bytes of buf in place, as zencode on each byte
+ */
+static void zencode_block(unsigned long* pkeys, const z_crc_t* pcrc_32_tab,
+                          unsigned char* buf, size_t len)
+{
+    z_crc_t key0 = (z_crc_t)*(pkeys+0);
+    z_crc_t key1 = (z_crc_t)*(pkeys+1);
+    z_crc_t key2 = (z_crc_t)*(pkeys+2);
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        unsigned temp = ((unsigned)key2 & 0xffff) | 2;
+        unsigned c = buf[i];
+        buf[i] = (unsigned char)(c ^ (((temp * (temp ^ 1)) >> 8) & 0xff));
+        key0 = (z_crc_t)CRC32(key0, c);
+        key1 = (z_crc_t)((key1 + (key0 & 0xff)) * 134775813L + 1);
+        key2 = (z_crc_t)CRC32(key2, (unsigned)(key1 >> 24));
+    }
+
+    *(pkeys+0) = key0;
+    *(pkeys+1) = key1;
+    *(pkeys+2) = key2;
+}
+
 #define RAND_HEAD_LEN  12
    /* "last resort" source for second part of crypt seed pattern */
 #  ifndef ZCR_SEED2
@@ -91,7 +149,7 @@ static int crypthead(const char* passwd,      /* password string */
                      unsigned char* buf,      /* where to write header */
                      int bufSize,
                      unsigned long* pkeys,
-                     const unsigned long* pcrc_32_tab,
+                     const z_crc_t* pcrc_32_tab,
                      unsigned long crcForCrypting)
 {
     int n;                       /* index in random header */
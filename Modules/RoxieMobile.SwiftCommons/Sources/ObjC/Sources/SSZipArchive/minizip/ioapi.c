@@ -14,8 +14,19 @@
         #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+#include <string.h>
+
 #include "ioapi.h"
 
+#if (!defined(_WIN32)) && (!defined(WIN32))
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 voidpf call_zopen64 (const zlib_filefunc64_32_def* pfilefunc,const void*filename,int mode)
 {
     if (pfilefunc->zfile_func64.zopen64_file != NULL)
@@ -237,3 +248,616 @@ void fill_fopen64_filefunc (zlib_filefunc64_def*  pzlib_filefunc_def)
     pzlib_filefunc_def->zerror_file = ferror_file_func;
     pzlib_filefunc_def->opaque = NULL;
 }
+
+
+#if (!defined(_WIN32)) && (!defined(WIN32))
+
+/* mapping of the mmap backend, the whole file is mapped read-only and shared
+   by the streams duplicated with call_zdup64 */
+typedef struct mmap_mapping_s
+{
+    const unsigned char* base;
+    ZPOS64_T size;
+    long refcount;
+} mmap_mapping;
+
+/* stream of the mmap backend */
+typedef struct mmap_stream_s
+{
+    mmap_mapping* mapping;
+    ZPOS64_T pos;
+} mmap_stream;
+
+static voidpf  ZCALLBACK mmap64_file_func OF((voidpf opaque, const void* filename, int mode));
+static uLong   ZCALLBACK mmap_read_file_func OF((voidpf opaque, voidpf stream, void* buf, uLong size));
+static uLong   ZCALLBACK mmap_write_file_func OF((voidpf opaque, voidpf stream, const void* buf,uLong size));
+static ZPOS64_T ZCALLBACK mmap_tell64_file_func OF((voidpf opaque, voidpf stream));
+static long    ZCALLBACK mmap_seek64_file_func OF((voidpf opaque, voidpf stream, ZPOS64_T offset, int origin));
+static int     ZCALLBACK mmap_close_file_func OF((voidpf opaque, voidpf stream));
+static int     ZCALLBACK mmap_error_file_func OF((voidpf opaque, voidpf stream));
+
+static voidpf ZCALLBACK mmap64_file_func (voidpf opaque, const void* filename, int mode)
+{
+    mmap_stream* stream;
+    mmap_mapping* mapping;
+    struct stat st;
+    void* base = NULL;
+    int fd;
+
+    /* a mapping can only be read */
+    if ((filename==NULL) || ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER)!=ZLIB_FILEFUNC_MODE_READ))
+        return NULL;
+
+    fd = open((const char*)filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if ((fstat(fd, &st) != 0) || ((ZPOS64_T)(size_t)st.st_size != (ZPOS64_T)st.st_size))
+    {
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size > 0)
+    {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            close(fd);
+            return NULL;
+        }
+    }
+    /* the mapping stays valid once the descriptor is closed */
+    close(fd);
+
+    mapping = (mmap_mapping*)malloc(sizeof(mmap_mapping));
+    stream = (mmap_stream*)malloc(sizeof(mmap_stream));
+    if ((mapping == NULL) || (stream == NULL))
+    {
+        free(mapping);
+        free(stream);
+        if (base != NULL)
+            munmap(base, (size_t)st.st_size);
+        return NULL;
+    }
+    mapping->base = (const unsigned char*)base;
+    mapping->size = (ZPOS64_T)st.st_size;
+    mapping->refcount = 1;
+    stream->mapping = mapping;
+    stream->pos = 0;
+    return stream;
+}
+
+static uLong ZCALLBACK mmap_read_file_func (voidpf opaque, voidpf stream, void* buf, uLong size)
+{
+    mmap_stream* mstream = (mmap_stream*)stream;
+    uLong ret = size;
+    if (mstream->pos >= mstream->mapping->size)
+        return 0;
+    if (mstream->mapping->size - mstream->pos < ret)
+        ret = (uLong)(mstream->mapping->size - mstream->pos);
+    memcpy(buf, mstream->mapping->base + mstream->pos, (size_t)ret);
+    mstream->pos += ret;
+    return ret;
+}
+
+static uLong ZCALLBACK mmap_write_file_func (voidpf opaque, voidpf stream, const void* buf, uLong size)
+{
+    return 0;
+}
+
+static ZPOS64_T ZCALLBACK mmap_tell64_file_func (voidpf opaque, voidpf stream)
+{
+    return ((mmap_stream*)stream)->pos;
+}
+
+static long ZCALLBACK mmap_seek64_file_func (voidpf opaque, voidpf stream, ZPOS64_T offset, int origin)
+{
+    mmap_stream* mstream = (mmap_stream*)stream;
+    ZPOS64_T pos;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        pos = mstream->pos + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        pos = mstream->mapping->size + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        pos = offset;
+        break;
+    default: return -1;
+    }
+    if (pos > mstream->mapping->size)
+        return -1;
+    mstream->pos = pos;
+    return 0;
+}
+
+static int ZCALLBACK mmap_close_file_func (voidpf opaque, voidpf stream)
+{
+    mmap_stream* mstream = (mmap_stream*)stream;
+    mmap_mapping* mapping = mstream->mapping;
+    int ret = 0;
+    free(mstream);
+    if (__sync_sub_and_fetch(&mapping->refcount, 1) == 0)
+    {
+        if (mapping->base != NULL)
+            ret = munmap((void*)mapping->base, (size_t)mapping->size);
+        free(mapping);
+    }
+    return ret;
+}
+
+static int ZCALLBACK mmap_error_file_func (voidpf opaque, voidpf stream)
+{
+    return 0;
+}
+
+void fill_mmap_filefunc64 (zlib_filefunc64_def*  pzlib_filefunc_def)
+{
+    pzlib_filefunc_def->zopen64_file = mmap64_file_func;
+    pzlib_filefunc_def->zread_file = mmap_read_file_func;
+    pzlib_filefunc_def->zwrite_file = mmap_write_file_func;
+    pzlib_filefunc_def->ztell64_file = mmap_tell64_file_func;
+    pzlib_filefunc_def->zseek64_file = mmap_seek64_file_func;
+    pzlib_filefunc_def->zclose_file = mmap_close_file_func;
+    pzlib_filefunc_def->zerror_file = mmap_error_file_func;
+    pzlib_filefunc_def->opaque = NULL;
+}
+
+const void* call_zmap64 (const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T* psize)
+{
+    const mmap_stream* mstream = (const mmap_stream*)filestream;
+    if ((pfilefunc->zfile_func64.zread_file != mmap_read_file_func) || (mstream == NULL))
+        return NULL;
+    if (psize != NULL)
+        *psize = mstream->mapping->size;
+    return mstream->mapping->base;
+}
+
+
+/* stream of the pread backend, each stream keeps its own position */
+typedef struct pread_stream_s
+{
+    int fd;
+    ZPOS64_T pos;
+    int error;
+} pread_stream;
+
+static voidpf  ZCALLBACK pread64_file_func OF((voidpf opaque, const void* filename, int mode));
+static uLong   ZCALLBACK pread_read_file_func OF((voidpf opaque, voidpf stream, void* buf, uLong size));
+static uLong   ZCALLBACK pread_write_file_func OF((voidpf opaque, voidpf stream, const void* buf,uLong size));
+static ZPOS64_T ZCALLBACK pread_tell64_file_func OF((voidpf opaque, voidpf stream));
+static long    ZCALLBACK pread_seek64_file_func OF((voidpf opaque, voidpf stream, ZPOS64_T offset, int origin));
+static int     ZCALLBACK pread_close_file_func OF((voidpf opaque, voidpf stream));
+static int     ZCALLBACK pread_error_file_func OF((voidpf opaque, voidpf stream));
+
+static voidpf pread_stream_from_fd (int fd)
+{
+    pread_stream* stream = (pread_stream*)malloc(sizeof(pread_stream));
+    if (stream == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    stream->fd = fd;
+    stream->pos = 0;
+    stream->error = 0;
+    return stream;
+}
+
+static voidpf ZCALLBACK pread64_file_func (voidpf opaque, const void* filename, int mode)
+{
+    int fd;
+    int flags = 0;
+    if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER)==ZLIB_FILEFUNC_MODE_READ)
+        flags = O_RDONLY;
+    else
+    if (mode & ZLIB_FILEFUNC_MODE_EXISTING)
+        flags = O_RDWR;
+    else
+    if (mode & ZLIB_FILEFUNC_MODE_CREATE)
+        flags = O_RDWR | O_CREAT | O_TRUNC;
+    else
+        return NULL;
+
+    if (filename == NULL)
+        return NULL;
+    fd = open((const char*)filename, flags, 0666);
+    if (fd < 0)
+        return NULL;
+    return pread_stream_from_fd(fd);
+}
+
+static uLong ZCALLBACK pread_read_file_func (voidpf opaque, voidpf stream, void* buf, uLong size)
+{
+    pread_stream* pstream = (pread_stream*)stream;
+    uLong ret = 0;
+    while (ret < size)
+    {
+        ssize_t n = pread(pstream->fd, (char*)buf + ret, (size_t)(size - ret), (off_t)(pstream->pos + ret));
+        if (n < 0)
+        {
+            pstream->error = 1;
+            break;
+        }
+        if (n == 0)
+            break;
+        ret += (uLong)n;
+    }
+    pstream->pos += ret;
+    return ret;
+}
+
+static uLong ZCALLBACK pread_write_file_func (voidpf opaque, voidpf stream, const void* buf, uLong size)
+{
+    pread_stream* pstream = (pread_stream*)stream;
+    uLong ret = 0;
+    while (ret < size)
+    {
+        ssize_t n = pwrite(pstream->fd, (const char*)buf + ret, (size_t)(size - ret), (off_t)(pstream->pos + ret));
+        if (n <= 0)
+        {
+            pstream->error = 1;
+            break;
+        }
+        ret += (uLong)n;
+    }
+    pstream->pos += ret;
+    return ret;
+}
+
+static ZPOS64_T ZCALLBACK pread_tell64_file_func (voidpf opaque, voidpf stream)
+{
+    return ((pread_stream*)stream)->pos;
+}
+
+static long ZCALLBACK pread_seek64_file_func (voidpf opaque, voidpf stream, ZPOS64_T offset, int origin)
+{
+    pread_stream* pstream = (pread_stream*)stream;
+    struct stat st;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        pstream->pos += offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        if (fstat(pstream->fd, &st) != 0)
+            return -1;
+        pstream->pos = (ZPOS64_T)st.st_size + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        pstream->pos = offset;
+        break;
+    default: return -1;
+    }
+    return 0;
+}
+
+static int ZCALLBACK pread_close_file_func (voidpf opaque, voidpf stream)
+{
+    pread_stream* pstream = (pread_stream*)stream;
+    int ret = close(pstream->fd);
+    free(pstream);
+    return ret;
+}
+
+static int ZCALLBACK pread_error_file_func (voidpf opaque, voidpf stream)
+{
+    return ((pread_stream*)stream)->error;
+}
+
+void fill_pread_filefunc64 (zlib_filefunc64_def*  pzlib_filefunc_def)
+{
+    pzlib_filefunc_def->zopen64_file = pread64_file_func;
+    pzlib_filefunc_def->zread_file = pread_read_file_func;
+    pzlib_filefunc_def->zwrite_file = pread_write_file_func;
+    pzlib_filefunc_def->ztell64_file = pread_tell64_file_func;
+    pzlib_filefunc_def->zseek64_file = pread_seek64_file_func;
+    pzlib_filefunc_def->zclose_file = pread_close_file_func;
+    pzlib_filefunc_def->zerror_file = pread_error_file_func;
+    pzlib_filefunc_def->opaque = NULL;
+}
+
+voidpf call_zdup64 (const zlib_filefunc64_32_def* pfilefunc,voidpf filestream)
+{
+    if (filestream == NULL)
+        return NULL;
+
+    if (pfilefunc->zfile_func64.zread_file == mmap_read_file_func)
+    {
+        mmap_stream* mstream = (mmap_stream*)filestream;
+        mmap_stream* stream = (mmap_stream*)malloc(sizeof(mmap_stream));
+        if (stream == NULL)
+            return NULL;
+        __sync_add_and_fetch(&mstream->mapping->refcount, 1);
+        stream->mapping = mstream->mapping;
+        stream->pos = 0;
+        return stream;
+    }
+
+    if (pfilefunc->zfile_func64.zread_file == pread_read_file_func)
+    {
+        int fd = dup(((pread_stream*)filestream)->fd);
+        if (fd < 0)
+            return NULL;
+        return pread_stream_from_fd(fd);
+    }
+
+    return NULL;
+}
+
+int call_zadvise64 (const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T offset, ZPOS64_T size)
+{
+    int fd = -1;
+
+    if ((filestream == NULL) || (size == 0))
+        return -1;
+
+    if (pfilefunc->zfile_func64.zread_file == mmap_read_file_func)
+    {
+        /* the pages of the mapping are read in advance */
+        const mmap_mapping* mapping = ((const mmap_stream*)filestream)->mapping;
+        uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+        uintptr_t start;
+        uintptr_t end;
+        if ((mapping->base == NULL) || (offset >= mapping->size))
+            return -1;
+        if (size > mapping->size - offset)
+            size = mapping->size - offset;
+        start = (uintptr_t)(mapping->base + offset) & ~(page_size - 1);
+        end = (uintptr_t)(mapping->base + offset + size);
+        return madvise((void*)start, (size_t)(end - start), MADV_WILLNEED);
+    }
+
+    if (pfilefunc->zfile_func64.zread_file == pread_read_file_func)
+        fd = ((pread_stream*)filestream)->fd;
+    else if (pfilefunc->zfile_func64.zread_file == fread_file_func)
+        fd = fileno((FILE*)filestream);
+    if (fd < 0)
+        return -1;
+
+#if defined(F_RDADVISE)
+    {
+        struct radvisory ra;
+        if (size > (ZPOS64_T)INT_MAX)
+            size = (ZPOS64_T)INT_MAX;
+        ra.ra_offset = (off_t)offset;
+        ra.ra_count = (int)size;
+        return fcntl(fd, F_RDADVISE, &ra);
+    }
+#elif defined(POSIX_FADV_WILLNEED)
+    return posix_fadvise(fd, (off_t)offset, (off_t)size, POSIX_FADV_WILLNEED);
+#else
+    return -1;
+#endif
+}
+
+#else
+
+void fill_mmap_filefunc64 (zlib_filefunc64_def*  pzlib_filefunc_def)
+{
+    fill_fopen64_filefunc(pzlib_filefunc_def);
+}
+
+const void* call_zmap64 (const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T* psize)
+{
+    return NULL;
+}
+
+void fill_pread_filefunc64 (zlib_filefunc64_def*  pzlib_filefunc_def)
+{
+    fill_fopen64_filefunc(pzlib_filefunc_def);
+}
+
+voidpf call_zdup64 (const zlib_filefunc64_32_def* pfilefunc,voidpf filestream)
+{
+    return NULL;
+}
+
+int call_zadvise64 (const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T offset, ZPOS64_T size)
+{
+    return -1;
+}
+
+#endif
+
+
+static voidpf ZCALLBACK malloc_alloc_mem_func (voidpf opaque, size_t size)
+{
+    (void)opaque;
+    return malloc(size);
+}
+
+static void ZCALLBACK malloc_free_mem_func (voidpf opaque, voidpf address)
+{
+    (void)opaque;
+    free(address);
+}
+
+void fill_malloc_allocator (zlib_allocator_def* pallocator)
+{
+    pallocator->zalloc_mem = malloc_alloc_mem_func;
+    pallocator->zfree_mem = malloc_free_mem_func;
+    pallocator->zrelease_mem = NULL;
+    pallocator->opaque = NULL;
+}
+
+/* each allocation of the arena is preceded by an arena_header, on ARENA_ALIGN bytes */
+#define ARENA_ALIGN (16)
+#define ARENA_ROUND(size) (((size)+(ARENA_ALIGN-1)) & ~(size_t)(ARENA_ALIGN-1))
+#define ARENA_DEFAULT_BLOCK_SIZE (65536)
+
+/* block of the arena allocator, followed by its data */
+typedef struct arena_block_s
+{
+    struct arena_block_s* prev;
+    struct arena_block_s* next;
+    size_t size;                /* size of the data */
+    size_t used;                /* bytes of the data already allocated */
+    size_t live;                /* number of allocations not freed */
+} arena_block;
+
+typedef struct arena_header_s
+{
+    arena_block* block;         /* block of the allocation */
+    size_t size;                /* rounded size of the allocation */
+} arena_header;
+
+#define ARENA_BLOCK_HEADER ARENA_ROUND(sizeof(arena_block))
+#define ARENA_BLOCK_DATA(block) ((unsigned char*)(block)+ARENA_BLOCK_HEADER)
+#define ARENA_HEADER(address) ((arena_header*)((unsigned char*)(address)-ARENA_ALIGN))
+
+typedef struct arena_s
+{
+    arena_block* blocks;        /* the current block first */
+    size_t block_size;
+    size_t size;                /* bytes taken from malloc */
+} arena;
+
+static void arena_unlink_block (arena* a, arena_block* block)
+{
+    if (block->prev != NULL)
+        block->prev->next = block->next;
+    else
+        a->blocks = block->next;
+    if (block->next != NULL)
+        block->next->prev = block->prev;
+    a->size -= ARENA_BLOCK_HEADER + block->size;
+    free(block);
+}
+
+static voidpf ZCALLBACK arena_alloc_mem_func (voidpf opaque, size_t size)
+{
+    arena* a = (arena*)opaque;
+    arena_block* block = a->blocks;
+    size_t need = ARENA_ROUND(size) + ARENA_ALIGN;
+    arena_header* header;
+
+    if (need < size)
+        return NULL;
+    if ((block == NULL) || (block->size - block->used < need))
+    {
+        size_t block_size = (need > a->block_size) ? need : a->block_size;
+        block = (arena_block*)malloc(ARENA_BLOCK_HEADER + block_size);
+        if (block == NULL)
+            return NULL;
+        block->size = block_size;
+        block->used = 0;
+        block->live = 0;
+        a->size += ARENA_BLOCK_HEADER + block_size;
+        if ((need > a->block_size) && (a->blocks != NULL))
+        {
+            /* a large allocation gets its own block, the current one goes on */
+            block->prev = a->blocks;
+            block->next = a->blocks->next;
+            a->blocks->next = block;
+        }
+        else
+        {
+            block->prev = NULL;
+            block->next = a->blocks;
+            a->blocks = block;
+        }
+        if (block->next != NULL)
+            block->next->prev = block;
+    }
+
+    header = (arena_header*)(ARENA_BLOCK_DATA(block) + block->used);
+    header->block = block;
+    header->size = ARENA_ROUND(size);
+    block->used += need;
+    block->live++;
+    return (unsigned char*)header + ARENA_ALIGN;
+}
+
+static void ZCALLBACK arena_free_mem_func (voidpf opaque, voidpf address)
+{
+    arena* a = (arena*)opaque;
+    arena_header* header;
+    arena_block* block;
+
+    if (address == NULL)
+        return;
+    header = ARENA_HEADER(address);
+    block = header->block;
+    block->live--;
+
+    /* the last allocation of the current block is given back at once, which
+       is enough for zlib streams, freed in the reverse order of allocation.
+       A block without live allocation is reset if it is the current one, else
+       freed, so that the large buffers of zlib do not pile up */
+    if (block == a->blocks)
+    {
+        if ((unsigned char*)address + header->size == ARENA_BLOCK_DATA(block) + block->used)
+            block->used -= header->size + ARENA_ALIGN;
+        if (block->live == 0)
+            block->used = 0;
+    }
+    else if (block->live == 0)
+        arena_unlink_block(a, block);
+}
+
+static void ZCALLBACK arena_release_mem_func (voidpf opaque)
+{
+    arena* a = (arena*)opaque;
+    arena_block* block = a->blocks;
+    while (block != NULL)
+    {
+        arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(a);
+}
+
+int fill_arena_allocator (zlib_allocator_def* pallocator, size_t block_size)
+{
+    arena* a = (arena*)malloc(sizeof(arena));
+    if (a == NULL)
+        return -1;
+    a->blocks = NULL;
+    a->block_size = (block_size > 0) ? ARENA_ROUND(block_size) : ARENA_DEFAULT_BLOCK_SIZE;
+    a->size = sizeof(arena);
+
+    pallocator->zalloc_mem = arena_alloc_mem_func;
+    pallocator->zfree_mem = arena_free_mem_func;
+    pallocator->zrelease_mem = arena_release_mem_func;
+    pallocator->opaque = a;
+    return 0;
+}
+
+size_t arena_allocator_size (const zlib_allocator_def* pallocator)
+{
+    if ((pallocator == NULL) || (pallocator->zalloc_mem != arena_alloc_mem_func))
+        return 0;
+    return ((const arena*)pallocator->opaque)->size;
+}
+
+voidpf call_zalloc_mem (const zlib_allocator_def* pallocator, size_t size)
+{
+    return (*(pallocator->zalloc_mem))(pallocator->opaque,size);
+}
+
+void call_zfree_mem (const zlib_allocator_def* pallocator, voidpf address)
+{
+    if (address != NULL)
+        (*(pallocator->zfree_mem))(pallocator->opaque,address);
+}
+
+void call_zrelease_mem (const zlib_allocator_def* pallocator)
+{
+    if (pallocator->zrelease_mem != NULL)
+        (*(pallocator->zrelease_mem))(pallocator->opaque);
+}
+
+voidpf ZCALLBACK zlib_alloc_from_allocator (voidpf opaque, uInt items, uInt size)
+{
+    if ((size != 0) && (items > ((size_t)-1) / size))
+        return Z_NULL;
+    return call_zalloc_mem((const zlib_allocator_def*)opaque,(size_t)items*size);
+}
+
+void ZCALLBACK zlib_free_from_allocator (voidpf opaque, voidpf address)
+{
+    call_zfree_mem((const zlib_allocator_def*)opaque,address);
+}
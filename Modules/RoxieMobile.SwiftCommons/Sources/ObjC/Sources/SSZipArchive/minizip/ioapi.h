@@ -167,6 +167,15 @@ typedef struct zlib_filefunc64_def_s
 void fill_fopen64_filefunc OF((zlib_filefunc64_def* pzlib_filefunc_def));
 void fill_fopen_filefunc OF((zlib_filefunc_def* pzlib_filefunc_def));
 
+/* read-only backend mapping the whole file in memory, falls back to
+   fill_fopen64_filefunc where mmap is not available */
+void fill_mmap_filefunc64 OF((zlib_filefunc64_def* pzlib_filefunc_def));
+
+/* backend using positional reads and writes (pread/pwrite), each stream keeps
+   its own position so that duplicated streams can be used from several threads,
+   falls back to fill_fopen64_filefunc where pread is not available */
+void fill_pread_filefunc64 OF((zlib_filefunc64_def* pzlib_filefunc_def));
+
 /* now internal definition, only for zip.c and unzip.h */
 typedef struct zlib_filefunc64_32_def_s
 {
@@ -188,8 +197,55 @@ voidpf call_zopen64 OF((const zlib_filefunc64_32_def* pfilefunc,const void*filen
 long    call_zseek64 OF((const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T offset, int origin));
 ZPOS64_T call_ztell64 OF((const zlib_filefunc64_32_def* pfilefunc,voidpf filestream));
 
+/* base address and size of a stream opened with fill_mmap_filefunc64, NULL for other backends */
+const void* call_zmap64 OF((const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T* psize));
+/* new stream on the same file with its own position, for the mmap and pread backends,
+   NULL for other backends */
+voidpf call_zdup64 OF((const zlib_filefunc64_32_def* pfilefunc,voidpf filestream));
+/* hint that size bytes from offset will be read soon, so that the system reads
+   them in advance (F_RDADVISE, posix_fadvise or madvise), for the fopen, pread
+   and mmap backends. Return 0 if the hint was given */
+int call_zadvise64 OF((const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T offset, ZPOS64_T size));
+
 void    fill_zlib_filefunc64_32_def_from_filefunc32(zlib_filefunc64_32_def* p_filefunc64_32,const zlib_filefunc_def* p_filefunc32);
 
+
+typedef voidpf   (ZCALLBACK *alloc_mem_func)      OF((voidpf opaque, size_t size));
+typedef void     (ZCALLBACK *free_mem_func)       OF((voidpf opaque, voidpf address));
+typedef void     (ZCALLBACK *release_mem_func)    OF((voidpf opaque));
+
+/* allocator of the internal memory of a zipfile handle (buffers, central
+   directory, comments, zlib streams). zrelease_mem can be NULL, else it is
+   called once when the handle is closed (or when it cannot be opened), after
+   all the memory of the handle is freed */
+typedef struct zlib_allocator_def_s
+{
+    alloc_mem_func      zalloc_mem;
+    free_mem_func       zfree_mem;
+    release_mem_func    zrelease_mem;
+    voidpf              opaque;
+} zlib_allocator_def;
+
+/* allocator using malloc and free */
+void fill_malloc_allocator OF((zlib_allocator_def* pallocator));
+
+/* arena allocator : memory is taken from blocks of block_size bytes (64K if 0),
+   larger allocations get a block of their own. A free gives back the last
+   allocation of the current block, or a whole block once all its allocations
+   are freed, and all the blocks are freed at once by zrelease_mem, so the
+   allocator belongs to a single handle and must not be shared between threads.
+   Return -1 if out of memory */
+int fill_arena_allocator OF((zlib_allocator_def* pallocator, size_t block_size));
+/* number of bytes taken from malloc by an arena allocator, 0 for other allocators */
+size_t arena_allocator_size OF((const zlib_allocator_def* pallocator));
+
+voidpf call_zalloc_mem OF((const zlib_allocator_def* pallocator, size_t size));
+void   call_zfree_mem OF((const zlib_allocator_def* pallocator, voidpf address));
+void   call_zrelease_mem OF((const zlib_allocator_def* pallocator));
+/* zalloc and zfree of a z_stream, with the zlib_allocator_def* as opaque */
+voidpf ZCALLBACK zlib_alloc_from_allocator OF((voidpf opaque, uInt items, uInt size));
+void   ZCALLBACK zlib_free_from_allocator OF((voidpf opaque, voidpf address));
+
 #define ZOPEN64(filefunc,filename,mode)         (call_zopen64((&(filefunc)),(filename),(mode)))
 #define ZTELL64(filefunc,filestream)            (call_ztell64((&(filefunc)),(filestream)))
 #define ZSEEK64(filefunc,filestream,pos,mode)   (call_zseek64((&(filefunc)),(filestream),(pos),(mode)))
@@ -0,0 +1,375 @@
+/*
+  CRC-32 for Minizip
+  License: Same as ZLIB (www.gzip.org)
+
+  The slice-by-16 tables and the combination of CRCs follow crc32.c of
+  zlib, the PCLMULQDQ folding follows the Intel paper "Fast CRC Computation
+  for Generic Polynomials Using PCLMULQDQ Instruction".
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "mzcrc32.h"
+
+#ifndef local
+#  define local static
+#endif
+
+#if (!defined(_WIN32)) && (!defined(WIN32))
+#include <pthread.h>
+#define MZ_HAVE_PTHREAD
+#endif
+
+/* ARMv8 CRC32 instructions, checked at run time */
+#if defined(__aarch64__) && (defined(__clang__) || defined(__GNUC__))
+#define MZ_CRC32_ARMV8
+#  if defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#  elif defined(__linux__)
+#include <sys/auxv.h>
+#  endif
+#  if defined(__clang__)
+#    define MZ_CRC32_TARGET_ARMV8 __attribute__((target("crc")))
+#    define MZ_CRC32_ARMV8_B(c,x) __builtin_arm_crc32b((c),(x))
+#    define MZ_CRC32_ARMV8_D(c,x) __builtin_arm_crc32d((c),(x))
+#  else
+#    define MZ_CRC32_TARGET_ARMV8 __attribute__((target("+crc")))
+#    define MZ_CRC32_ARMV8_B(c,x) __builtin_aarch64_crc32b((c),(x))
+#    define MZ_CRC32_ARMV8_D(c,x) __builtin_aarch64_crc32x((c),(x))
+#  endif
+#endif
+
+/* PCLMULQDQ carry-less multiplications, checked at run time */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || defined(__GNUC__))
+#define MZ_CRC32_PCLMUL
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#define MZ_CRC32_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#endif
+
+#define MZ_CRC32_POLY (0xedb88320)
+
+local unsigned int mz_crc32_table[16][256];
+local unsigned int mz_crc32_x2n_table[32];
+local mz_crc32_func mz_crc32_default = NULL;  /* implementation chosen for the CPU */
+local mz_crc32_func mz_crc32_user = NULL;     /* implementation set by mzCrc32SetFunc */
+
+/* ===========================================================================
+   Multiply a and b modulo the CRC polynomial (bit 31 is x^0)
+*/
+local unsigned int mz_crc32_multmodp(unsigned int a, unsigned int b)
+{
+    unsigned int m = (unsigned int)1 << 31;
+    unsigned int p = 0;
+
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ MZ_CRC32_POLY : b >> 1;
+    }
+    return p;
+}
+
+/* ===========================================================================
+   Return x^(n * 2^k) modulo the CRC polynomial
+*/
+local unsigned int mz_crc32_x2nmodp(ZPOS64_T n, unsigned k)
+{
+    unsigned int p = (unsigned int)1 << 31;  /* x^0 == 1 */
+
+    while (n)
+    {
+        if (n & 1)
+            p = mz_crc32_multmodp(mz_crc32_x2n_table[k & 31], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+/* ===========================================================================
+   Slice-by-16: the inverted CRC c is updated 16 bytes at a time
+*/
+local unsigned int mz_crc32_slice16(unsigned int c, const unsigned char* buf, uLong len)
+{
+    const unsigned int (*t)[256] = (const unsigned int (*)[256])mz_crc32_table;
+
+    while (len >= 16)
+    {
+        unsigned int a = c ^ ((unsigned int)buf[0] | ((unsigned int)buf[1] << 8) |
+                              ((unsigned int)buf[2] << 16) | ((unsigned int)buf[3] << 24));
+        unsigned int b = (unsigned int)buf[4] | ((unsigned int)buf[5] << 8) |
+                         ((unsigned int)buf[6] << 16) | ((unsigned int)buf[7] << 24);
+        unsigned int d = (unsigned int)buf[8] | ((unsigned int)buf[9] << 8) |
+                         ((unsigned int)buf[10] << 16) | ((unsigned int)buf[11] << 24);
+        unsigned int e = (unsigned int)buf[12] | ((unsigned int)buf[13] << 8) |
+                         ((unsigned int)buf[14] << 16) | ((unsigned int)buf[15] << 24);
+
+        c = t[15][a & 0xff] ^ t[14][(a >> 8) & 0xff] ^ t[13][(a >> 16) & 0xff] ^ t[12][a >> 24] ^
+            t[11][b & 0xff] ^ t[10][(b >> 8) & 0xff] ^ t[9][(b >> 16) & 0xff] ^ t[8][b >> 24] ^
+            t[7][d & 0xff] ^ t[6][(d >> 8) & 0xff] ^ t[5][(d >> 16) & 0xff] ^ t[4][d >> 24] ^
+            t[3][e & 0xff] ^ t[2][(e >> 8) & 0xff] ^ t[1][(e >> 16) & 0xff] ^ t[0][e >> 24];
+        buf += 16;
+        len -= 16;
+    }
+    while (len > 0)
+    {
+        c = t[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+        len--;
+    }
+    return c;
+}
+
+local uLong mz_crc32_software(uLong crc, const unsigned char* buf, uLong len)
+{
+    return (uLong)~mz_crc32_slice16(~(unsigned int)crc, buf, len);
+}
+
+#ifdef MZ_CRC32_ARMV8
+/* ===========================================================================
+   ARMv8 CRC32 instructions, 8 bytes at a time
+*/
+MZ_CRC32_TARGET_ARMV8
+local uLong mz_crc32_armv8(uLong crc, const unsigned char* buf, uLong len)
+{
+    unsigned int c = ~(unsigned int)crc;
+
+    while ((len > 0) && (((size_t)buf & 7) != 0))
+    {
+        c = MZ_CRC32_ARMV8_B(c, *buf++);
+        len--;
+    }
+    while (len >= 32)
+    {
+        unsigned long long x[4];
+        memcpy(x, buf, sizeof(x));
+        c = MZ_CRC32_ARMV8_D(c, x[0]);
+        c = MZ_CRC32_ARMV8_D(c, x[1]);
+        c = MZ_CRC32_ARMV8_D(c, x[2]);
+        c = MZ_CRC32_ARMV8_D(c, x[3]);
+        buf += 32;
+        len -= 32;
+    }
+    while (len >= 8)
+    {
+        unsigned long long x;
+        memcpy(&x, buf, sizeof(x));
+        c = MZ_CRC32_ARMV8_D(c, x);
+        buf += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        c = MZ_CRC32_ARMV8_B(c, *buf++);
+        len--;
+    }
+    return (uLong)~c;
+}
+
+local int mz_crc32_has_armv8(void)
+{
+#  if defined(__ARM_FEATURE_CRC32)
+    return 1;
+#  elif defined(__APPLE__)
+    int value = 0;
+    size_t size = sizeof(value);
+    if (sysctlbyname("hw.optional.armv8_crc32", &value, &size, NULL, 0) != 0)
+        return 0;
+    return value != 0;
+#  elif defined(__linux__) && defined(HWCAP_CRC32)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#  else
+    return 0;
+#  endif
+}
+#endif /* MZ_CRC32_ARMV8 */
+
+#ifdef MZ_CRC32_PCLMUL
+/* ===========================================================================
+   Fold the inverted CRC c over buf with PCLMULQDQ, 64 bytes at a time.
+   len must be at least 64 and a multiple of 16.
+*/
+MZ_CRC32_TARGET_PCLMUL
+local unsigned int mz_crc32_fold(unsigned int c, const unsigned char* buf, uLong len)
+{
+    /* x^(4*128+32) mod P, x^(4*128-32) mod P, x^(128+32), x^(128-32), x^64, mu and P */
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000LL, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+    buf += 64;
+    len -= 64;
+
+    /* four 128 bits lanes, folded 512 bits forward */
+    x0 = k1k2;
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    /* fold the four lanes into one */
+    x0 = k3k4;
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* the remaining 128 bits blocks */
+    while (len >= 16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)buf)), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = k5k0;
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = poly;
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (unsigned int)_mm_extract_epi32(x1, 1);
+}
+
+local uLong mz_crc32_pclmul(uLong crc, const unsigned char* buf, uLong len)
+{
+    unsigned int c = ~(unsigned int)crc;
+
+    if (len >= 64)
+    {
+        uLong chunk = len & ~(uLong)15;
+        c = mz_crc32_fold(c, buf, chunk);
+        buf += chunk;
+        len -= chunk;
+    }
+    return (uLong)~mz_crc32_slice16(c, buf, len);
+}
+
+local int mz_crc32_has_pclmul(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return ((ecx & bit_PCLMUL) != 0) && ((ecx & bit_SSE4_1) != 0);
+}
+#endif /* MZ_CRC32_PCLMUL */
+
+/* ===========================================================================
+   Build the tables and choose the implementation, once
+*/
+local void mz_crc32_init(void)
+{
+    unsigned int n, k, c, p;
+
+    for (n = 0; n < 256; n++)
+    {
+        c = n;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ MZ_CRC32_POLY : c >> 1;
+        mz_crc32_table[0][n] = c;
+    }
+    for (n = 0; n < 256; n++)
+        for (k = 1; k < 16; k++)
+            mz_crc32_table[k][n] = (mz_crc32_table[k - 1][n] >> 8) ^
+                                   mz_crc32_table[0][mz_crc32_table[k - 1][n] & 0xff];
+
+    p = (unsigned int)1 << 30;  /* x^1 */
+    mz_crc32_x2n_table[0] = p;
+    for (n = 1; n < 32; n++)
+        mz_crc32_x2n_table[n] = p = mz_crc32_multmodp(p, p);
+
+    mz_crc32_default = mz_crc32_software;
+#ifdef MZ_CRC32_ARMV8
+    if (mz_crc32_has_armv8())
+        mz_crc32_default = mz_crc32_armv8;
+#endif
+#ifdef MZ_CRC32_PCLMUL
+    if (mz_crc32_has_pclmul())
+        mz_crc32_default = mz_crc32_pclmul;
+#endif
+}
+
+#ifdef MZ_HAVE_PTHREAD
+local pthread_once_t mz_crc32_once = PTHREAD_ONCE_INIT;
+#define MZ_CRC32_INIT() pthread_once(&mz_crc32_once, mz_crc32_init)
+#else
+local volatile int mz_crc32_initialised = 0;
+#define MZ_CRC32_INIT() if (!mz_crc32_initialised) { mz_crc32_init(); mz_crc32_initialised = 1; }
+#endif
+
+extern uLong ZEXPORT mzCrc32(uLong crc, const unsigned char* buf, uLong len)
+{
+    if (buf == NULL)
+        return 0;
+    if (mz_crc32_user != NULL)
+        return mz_crc32_user(crc, buf, len);
+    MZ_CRC32_INIT();
+    return mz_crc32_default(crc, buf, len);
+}
+
+extern uLong ZEXPORT mzCrc32Software(uLong crc, const unsigned char* buf, uLong len)
+{
+    if (buf == NULL)
+        return 0;
+    MZ_CRC32_INIT();
+    return mz_crc32_software(crc, buf, len);
+}
+
+extern void ZEXPORT mzCrc32SetFunc(mz_crc32_func crc_func)
+{
+    mz_crc32_user = crc_func;
+}
+
+extern uLong ZEXPORT mzCrc32Combine(uLong crc1, uLong crc2, ZPOS64_T len2)
+{
+    MZ_CRC32_INIT();
+    return (uLong)(mz_crc32_multmodp(mz_crc32_x2nmodp(len2, 3), (unsigned int)crc1) ^
+                   ((unsigned int)crc2 & 0xffffffff));
+}
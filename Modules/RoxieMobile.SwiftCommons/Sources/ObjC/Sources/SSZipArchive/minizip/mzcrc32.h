@@ -0,0 +1,52 @@
+/*
+  CRC-32 for Minizip
+  License: Same as ZLIB (www.gzip.org)
+
+  The CRC-32 of zip and unzip is computed by mzCrc32, which uses the
+  CRC instructions of the CPU when there are some (ARMv8 CRC32, or
+  PCLMULQDQ folding on x86), and a slice-by-16 table otherwise.
+*/
+
+#ifndef _mz_crc32_H
+#define _mz_crc32_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _ZLIB_H
+#include "zlib.h"
+#endif
+
+#include "ioapi.h"
+
+/* A CRC-32 implementation: update crc with the len bytes of buf, like
+   crc32() of zlib (the first crc is 0)
+*/
+typedef uLong (*mz_crc32_func) OF((uLong crc, const unsigned char* buf, uLong len));
+
+/* Update crc with the len bytes of buf, with the implementation set by
+   mzCrc32SetFunc, or the fastest one for the CPU
+*/
+extern uLong ZEXPORT mzCrc32 OF((uLong crc, const unsigned char* buf, uLong len));
+
+/* The portable slice-by-16 implementation, 16K of tables
+*/
+extern uLong ZEXPORT mzCrc32Software OF((uLong crc, const unsigned char* buf, uLong len));
+
+/* Replace the implementation used by mzCrc32 (NULL restores the default one).
+   To be called before any zipfile is read or written.
+*/
+extern void ZEXPORT mzCrc32SetFunc OF((mz_crc32_func crc_func));
+
+/* Return the CRC-32 of two consecutive chunks from the CRC-32 crc1 of the
+   first one and crc2 of the second one, of len2 bytes, so that chunks can be
+   checked in parallel
+*/
+extern uLong ZEXPORT mzCrc32Combine OF((uLong crc1, uLong crc2, ZPOS64_T len2));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _mz_crc32_H */
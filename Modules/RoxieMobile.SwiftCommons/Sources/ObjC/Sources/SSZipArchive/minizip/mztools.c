@@ -11,6 +11,18 @@
 #include "zlib.h"
 #include "unzip.h"
 #include "mztools.h"
+#include "mzcrc32.h"
+
+#if (!defined(_WIN32)) && (!defined(WIN32))
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#define MZ_HAVE_PTHREAD
+#endif
 
 #define READ_8(adr)  ((unsigned char)*(adr))
 #define READ_16(adr) ( READ_8(adr) | (READ_8(adr+1) << 8) )
@@ -282,3 +294,1134 @@ uLong* bytesRecovered;
   }
   return err;
 }
+
+
+/* One file to process by unzParallelForEachFile */
+typedef struct unz_parallel_job_s {
+  unz64_file_pos pos;
+  ZPOS64_T compressed_size;
+} unz_parallel_job;
+
+/* State shared by the workers of unzParallelForEachFile */
+typedef struct unz_parallel_s {
+  unz_parallel_job* jobs;
+  ZPOS64_T nb_jobs;
+  ZPOS64_T next_job;     /* next job to take, updated atomically */
+  int err;               /* first error, UNZ_OK while all is fine */
+  unz_parallel_file_func file_func;
+  voidpf opaque;
+} unz_parallel;
+
+typedef struct unz_parallel_worker_s {
+  unz_parallel* shared;
+  unzFile file;
+} unz_parallel_worker;
+
+static int unz_parallel_compare_jobs(const void* a, const void* b)
+{
+  const unz_parallel_job* job1 = (const unz_parallel_job*)a;
+  const unz_parallel_job* job2 = (const unz_parallel_job*)b;
+  if (job1->compressed_size != job2->compressed_size)
+    return (job1->compressed_size > job2->compressed_size) ? -1 : 1;
+  /* same size, keep the order of the zipfile */
+  return (job1->pos.num_of_file < job2->pos.num_of_file) ? -1 : 1;
+}
+
+static void* unz_parallel_run_worker(void* arg)
+{
+  unz_parallel_worker* worker = (unz_parallel_worker*)arg;
+  unz_parallel* shared = worker->shared;
+  for (;;) {
+    ZPOS64_T index;
+    int err;
+#ifdef MZ_HAVE_PTHREAD
+    if (__sync_fetch_and_add(&shared->err, 0) != UNZ_OK)
+      break;
+    index = __sync_fetch_and_add(&shared->next_job, 1);
+#else
+    if (shared->err != UNZ_OK)
+      break;
+    index = shared->next_job++;
+#endif
+    if (index >= shared->nb_jobs)
+      break;
+
+    err = unzGoToFilePos64(worker->file, &shared->jobs[index].pos);
+    if (err == UNZ_OK)
+      err = shared->file_func(shared->opaque, worker->file, shared->jobs[index].pos.num_of_file);
+    if (err != UNZ_OK) {
+#ifdef MZ_HAVE_PTHREAD
+      __sync_bool_compare_and_swap(&shared->err, UNZ_OK, err);
+#else
+      shared->err = err;
+#endif
+      break;
+    }
+  }
+  return NULL;
+}
+
+extern int ZEXPORT unzParallelForEachFile(file, nb_workers, file_func, opaque)
+unzFile file;
+int nb_workers;
+unz_parallel_file_func file_func;
+voidpf opaque;
+{
+  unz_parallel shared;
+  unz_global_info64 gi;
+  ZPOS64_T nb_jobs = 0;
+  int err;
+
+  if (file == NULL || file_func == NULL)
+    return UNZ_PARAMERROR;
+  if (unzGetGlobalInfo64(file, &gi) != UNZ_OK)
+    return UNZ_PARAMERROR;
+  if (gi.number_entry == 0)
+    return UNZ_OK;
+
+  /* the 2^16 files overflow hack : the number of files is only an estimate */
+  shared.nb_jobs = gi.number_entry;
+  if (gi.number_entry == 0xffff)
+    shared.nb_jobs = 0x10000;
+  if ((ZPOS64_T)(size_t)shared.nb_jobs != shared.nb_jobs ||
+      shared.nb_jobs > ((size_t)-1) / sizeof(unz_parallel_job))
+    return UNZ_INTERNALERROR;
+  shared.jobs = (unz_parallel_job*)malloc((size_t)(shared.nb_jobs > 0 ? shared.nb_jobs : 1) * sizeof(unz_parallel_job));
+  if (shared.jobs == NULL)
+    return UNZ_INTERNALERROR;
+
+  /* list the files, from the central directory only */
+  err = unzGoToFirstFile(file);
+  while (err == UNZ_OK) {
+    unz_file_info64 file_info;
+    if (nb_jobs == shared.nb_jobs) {
+      unz_parallel_job* jobs;
+      if (shared.nb_jobs > ((size_t)-1) / (2 * sizeof(unz_parallel_job))) {
+        err = UNZ_INTERNALERROR;
+        break;
+      }
+      jobs = (unz_parallel_job*)realloc(shared.jobs, (size_t)shared.nb_jobs * 2 * sizeof(unz_parallel_job));
+      if (jobs == NULL) {
+        err = UNZ_INTERNALERROR;
+        break;
+      }
+      shared.jobs = jobs;
+      shared.nb_jobs *= 2;
+    }
+    err = unzGetCurrentFileInfo64(file, &file_info, NULL, 0, NULL, 0, NULL, 0);
+    if (err == UNZ_OK)
+      err = unzGetFilePos64(file, &shared.jobs[nb_jobs].pos);
+    if (err != UNZ_OK)
+      break;
+    shared.jobs[nb_jobs].compressed_size = file_info.compressed_size;
+    nb_jobs++;
+    err = unzGoToNextFile(file);
+  }
+  if (err != UNZ_END_OF_LIST_OF_FILE) {
+    free(shared.jobs);
+    return err;
+  }
+
+  /* largest first, so that a big file does not end the work alone */
+  qsort(shared.jobs, (size_t)nb_jobs, sizeof(unz_parallel_job), unz_parallel_compare_jobs);
+
+  shared.nb_jobs = nb_jobs;
+  shared.next_job = 0;
+  shared.err = UNZ_OK;
+  shared.file_func = file_func;
+  shared.opaque = opaque;
+
+  if ((ZPOS64_T)nb_workers > nb_jobs)
+    nb_workers = (int)nb_jobs;
+
+#ifdef MZ_HAVE_PTHREAD
+  if (nb_workers > 1) {
+    unz_parallel_worker* workers = (unz_parallel_worker*)calloc((size_t)nb_workers, sizeof(unz_parallel_worker));
+    pthread_t* threads = (pthread_t*)calloc((size_t)nb_workers, sizeof(pthread_t));
+    int nb_started = 0;
+    int i;
+
+    if (workers != NULL && threads != NULL) {
+      /* the calling thread is the first worker, on the handle it gave */
+      workers[0].shared = &shared;
+      workers[0].file = file;
+      for (i = 1; i < nb_workers; i++) {
+        workers[i].shared = &shared;
+        workers[i].file = unzOpenClone(file);
+        if (workers[i].file == NULL)
+          break;
+        if (pthread_create(&threads[i], NULL, unz_parallel_run_worker, &workers[i]) != 0) {
+          unzClose(workers[i].file);
+          break;
+        }
+        nb_started++;
+      }
+
+      unz_parallel_run_worker(&workers[0]);
+
+      for (i = 1; i <= nb_started; i++) {
+        pthread_join(threads[i], NULL);
+        unzClose(workers[i].file);
+      }
+    }
+    else {
+      shared.err = UNZ_INTERNALERROR;
+    }
+    free(workers);
+    free(threads);
+  }
+  else
+#endif
+  {
+    unz_parallel_worker worker;
+    worker.shared = &shared;
+    worker.file = file;
+    unz_parallel_run_worker(&worker);
+  }
+
+  free(shared.jobs);
+  unzGoToFirstFile(file);
+  return shared.err;
+}
+
+
+#define UNZ_TEST_BUFSIZE (32768)
+
+/* State shared by the workers of unzTestArchive */
+typedef struct unz_test_s {
+  unz_test_report_func report_func;
+  voidpf opaque;
+  ZPOS64_T nb_failed;    /* number of bad files, updated atomically */
+#ifdef MZ_HAVE_PTHREAD
+  pthread_mutex_t report_mutex;
+#endif
+} unz_test;
+
+static int unz_test_file(voidpf opaque, unzFile file, ZPOS64_T num_of_file)
+{
+  unz_test* test = (unz_test*)opaque;
+  unz_test_result result;
+  unz_file_info64 file_info;
+  unsigned char buf[UNZ_TEST_BUFSIZE];
+  char* filename = NULL;
+  int err;
+
+  result.num_of_file = num_of_file;
+  result.uncompressed_size = 0;
+  err = unzGetCurrentFileInfo64(file, &file_info, NULL, 0, NULL, 0, NULL, 0);
+  if (err == UNZ_OK) {
+    filename = (char*)malloc(file_info.size_filename + 1);
+    if (filename == NULL)
+      return UNZ_INTERNALERROR;
+    err = unzGetCurrentFileInfo64(file, NULL, filename, file_info.size_filename + 1, NULL, 0, NULL, 0);
+  }
+
+  if (err != UNZ_OK) {
+    /* the central directory cannot be read */
+  }
+  else if ((file_info.flag & 1) != 0) {
+    /* nothing to check without the password */
+    err = UNZ_PARAMERROR;
+  }
+  else {
+    /* the local header is checked against the central one on opening */
+    err = unzOpenCurrentFile(file);
+    if (err == UNZ_OK) {
+      int read;
+      int err_close;
+      while ((read = unzReadCurrentFile(file, buf, sizeof(buf))) > 0)
+        result.uncompressed_size += (ZPOS64_T)read;
+      if (read < 0)
+        err = read;
+      else if (result.uncompressed_size != file_info.uncompressed_size)
+        err = UNZ_BADZIPFILE;
+      /* the CRC is checked when all the data was read */
+      err_close = unzCloseCurrentFile(file);
+      if (err == UNZ_OK)
+        err = err_close;
+    }
+  }
+
+  result.filename = (filename != NULL) ? filename : "";
+  result.err = err;
+  if (err != UNZ_OK) {
+#ifdef MZ_HAVE_PTHREAD
+    __sync_fetch_and_add(&test->nb_failed, 1);
+#else
+    test->nb_failed++;
+#endif
+  }
+  if (test->report_func != NULL) {
+#ifdef MZ_HAVE_PTHREAD
+    pthread_mutex_lock(&test->report_mutex);
+#endif
+    test->report_func(test->opaque, &result);
+#ifdef MZ_HAVE_PTHREAD
+    pthread_mutex_unlock(&test->report_mutex);
+#endif
+  }
+  free(filename);
+  return UNZ_OK;
+}
+
+extern int ZEXPORT unzTestArchive(file, nb_workers, report_func, opaque)
+unzFile file;
+int nb_workers;
+unz_test_report_func report_func;
+voidpf opaque;
+{
+  unz_test test;
+  int err;
+
+  if (file == NULL)
+    return UNZ_PARAMERROR;
+
+  test.report_func = report_func;
+  test.opaque = opaque;
+  test.nb_failed = 0;
+#ifdef MZ_HAVE_PTHREAD
+  if (nb_workers <= 0) {
+    long nb_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nb_workers = (nb_cpu > 0) ? (int)nb_cpu : 1;
+  }
+  if (pthread_mutex_init(&test.report_mutex, NULL) != 0)
+    return UNZ_INTERNALERROR;
+#endif
+
+  err = unzParallelForEachFile(file, nb_workers, unz_test_file, &test);
+
+#ifdef MZ_HAVE_PTHREAD
+  pthread_mutex_destroy(&test.report_mutex);
+#endif
+  if ((err == UNZ_OK) && (test.nb_failed > 0))
+    err = UNZ_BADZIPFILE;
+  return err;
+}
+
+
+/* One file to write by the queue, its path follows the structure */
+typedef struct unz_write_job_s {
+  struct unz_write_job_s* next;
+  voidp buf;
+  size_t len;
+  unsigned mode;
+  uLong dosDate;
+  char path[1];
+} unz_write_job;
+
+/* State of a queue of unzWriteQueueOpen */
+typedef struct unz_write_queue_s {
+  unz_write_job* first;  /* jobs not yet taken by a worker */
+  unz_write_job* last;
+  ZPOS64_T pending;      /* bytes of the jobs not yet written */
+  ZPOS64_T max_pending;
+  ZPOS64_T nb_failed;
+  int closing;
+  int nb_workers;        /* number of threads started, 0 to write on submission */
+#ifdef MZ_HAVE_PTHREAD
+  int has_mutex;         /* mutex and conditions initialized */
+  pthread_mutex_t mutex;
+  pthread_cond_t job_added;
+  pthread_cond_t job_done;
+  pthread_t* threads;
+#endif
+} unz_write_queue;
+
+#ifdef MZ_HAVE_PTHREAD
+static time_t unz_write_dos_date_to_time(uLong dosDate)
+{
+  struct tm newdate;
+  newdate.tm_sec = (int)(2 * (dosDate & 0x1f));
+  newdate.tm_min = (int)((dosDate >> 5) & 0x3f);
+  newdate.tm_hour = (int)((dosDate >> 11) & 0x1f);
+  newdate.tm_mday = (int)((dosDate >> 16) & 0x1f);
+  newdate.tm_mon = (int)((dosDate >> 21) & 0x0f) - 1;
+  newdate.tm_year = (int)((dosDate >> 25) & 0x7f) + 80;
+  newdate.tm_isdst = -1;
+  return mktime(&newdate);
+}
+
+static int unz_write_file(const unz_write_job* job)
+{
+  const char* p = (const char*)job->buf;
+  size_t left = job->len;
+  int err = UNZ_OK;
+  int fd;
+
+  do {
+    fd = open(job->path, O_WRONLY | O_CREAT | O_TRUNC, (job->mode != 0) ? (mode_t)(job->mode & 07777) : 0666);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return UNZ_ERRNO;
+
+  while (left > 0) {
+    ssize_t written = write(fd, p, left);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      err = UNZ_ERRNO;
+      break;
+    }
+    p += written;
+    left -= (size_t)written;
+  }
+
+  /* the mode given to open is masked by the umask, unlike the one of the zipfile */
+  if (err == UNZ_OK && job->mode != 0 && fchmod(fd, (mode_t)(job->mode & 07777)) != 0)
+    err = UNZ_ERRNO;
+  if (err == UNZ_OK && job->dosDate != 0) {
+    struct timeval times[2];
+    times[0].tv_sec = times[1].tv_sec = unz_write_dos_date_to_time(job->dosDate);
+    times[0].tv_usec = times[1].tv_usec = 0;
+    if (futimes(fd, times) != 0)
+      err = UNZ_ERRNO;
+  }
+  if (close(fd) != 0)
+    err = UNZ_ERRNO;
+  return err;
+}
+#else
+static int unz_write_file(const unz_write_job* job)
+{
+  int err = UNZ_OK;
+  FILE* fp = fopen(job->path, "wb");
+  if (fp == NULL)
+    return UNZ_ERRNO;
+  if (job->len > 0 && fwrite(job->buf, job->len, 1, fp) != 1)
+    err = UNZ_ERRNO;
+  if (fclose(fp) != 0)
+    err = UNZ_ERRNO;
+  return err;
+}
+#endif
+
+#ifdef MZ_HAVE_PTHREAD
+static void* unz_write_run_worker(void* arg)
+{
+  unz_write_queue* queue = (unz_write_queue*)arg;
+  pthread_mutex_lock(&queue->mutex);
+  for (;;) {
+    unz_write_job* job;
+    int err;
+    while (queue->first == NULL && !queue->closing)
+      pthread_cond_wait(&queue->job_added, &queue->mutex);
+    job = queue->first;
+    if (job == NULL)
+      break;
+    queue->first = job->next;
+    if (queue->first == NULL)
+      queue->last = NULL;
+    pthread_mutex_unlock(&queue->mutex);
+
+    err = unz_write_file(job);
+    free(job->buf);
+
+    pthread_mutex_lock(&queue->mutex);
+    if (err != UNZ_OK)
+      queue->nb_failed++;
+    queue->pending -= job->len;
+    pthread_cond_broadcast(&queue->job_done);
+    free(job);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return NULL;
+}
+#endif
+
+extern unzWriteQueue ZEXPORT unzWriteQueueOpen(nb_workers, max_pending)
+int nb_workers;
+ZPOS64_T max_pending;
+{
+  unz_write_queue* queue = (unz_write_queue*)calloc(1, sizeof(unz_write_queue));
+  if (queue == NULL)
+    return NULL;
+  queue->max_pending = max_pending;
+
+#ifdef MZ_HAVE_PTHREAD
+  if (nb_workers > 0) {
+    int i;
+    if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
+      free(queue);
+      return NULL;
+    }
+    pthread_cond_init(&queue->job_added, NULL);
+    pthread_cond_init(&queue->job_done, NULL);
+    queue->has_mutex = 1;
+    queue->threads = (pthread_t*)calloc((size_t)nb_workers, sizeof(pthread_t));
+    for (i = 0; queue->threads != NULL && i < nb_workers; i++) {
+      if (pthread_create(&queue->threads[i], NULL, unz_write_run_worker, queue) != 0)
+        break;
+      queue->nb_workers++;
+    }
+  }
+#else
+  (void)nb_workers;
+#endif
+  return (unzWriteQueue)queue;
+}
+
+extern int ZEXPORT unzWriteQueueSubmit(file, path, buf, len, mode, dosDate)
+unzWriteQueue file;
+const char* path;
+voidp buf;
+size_t len;
+unsigned mode;
+uLong dosDate;
+{
+  unz_write_queue* queue = (unz_write_queue*)file;
+  unz_write_job* job;
+  size_t path_len;
+  int err;
+
+  if (queue == NULL || path == NULL || (buf == NULL && len > 0)) {
+    free(buf);
+    return UNZ_PARAMERROR;
+  }
+  path_len = strlen(path);
+  job = (unz_write_job*)malloc(sizeof(unz_write_job) + path_len);
+  if (job == NULL) {
+    free(buf);
+    return UNZ_INTERNALERROR;
+  }
+  job->next = NULL;
+  job->buf = buf;
+  job->len = len;
+  job->mode = mode;
+  job->dosDate = dosDate;
+  memcpy(job->path, path, path_len + 1);
+
+#ifdef MZ_HAVE_PTHREAD
+  if (queue->nb_workers > 0) {
+    pthread_mutex_lock(&queue->mutex);
+    /* a file larger than max_pending is taken once the queue is empty */
+    while (queue->pending > 0 && queue->pending + len > queue->max_pending)
+      pthread_cond_wait(&queue->job_done, &queue->mutex);
+    queue->pending += len;
+    if (queue->last != NULL)
+      queue->last->next = job;
+    else
+      queue->first = job;
+    queue->last = job;
+    pthread_cond_signal(&queue->job_added);
+    pthread_mutex_unlock(&queue->mutex);
+    return UNZ_OK;
+  }
+#endif
+
+  /* no worker : the file is written now */
+  err = unz_write_file(job);
+  if (err != UNZ_OK)
+    queue->nb_failed++;
+  free(job->buf);
+  free(job);
+  return err;
+}
+
+extern int ZEXPORT unzWriteQueueClose(file, nb_failed)
+unzWriteQueue file;
+ZPOS64_T* nb_failed;
+{
+  unz_write_queue* queue = (unz_write_queue*)file;
+  int err;
+  if (queue == NULL)
+    return UNZ_PARAMERROR;
+
+#ifdef MZ_HAVE_PTHREAD
+  if (queue->has_mutex) {
+    int i;
+    /* the workers end once the queue is empty */
+    pthread_mutex_lock(&queue->mutex);
+    queue->closing = 1;
+    pthread_cond_broadcast(&queue->job_added);
+    pthread_mutex_unlock(&queue->mutex);
+    for (i = 0; i < queue->nb_workers; i++)
+      pthread_join(queue->threads[i], NULL);
+    free(queue->threads);
+    pthread_cond_destroy(&queue->job_added);
+    pthread_cond_destroy(&queue->job_done);
+    pthread_mutex_destroy(&queue->mutex);
+  }
+#endif
+
+  if (nb_failed != NULL)
+    *nb_failed = queue->nb_failed;
+  err = (queue->nb_failed > 0) ? UNZ_ERRNO : UNZ_OK;
+  free(queue);
+  return err;
+}
+
+
+#define ZIP_BUILDER_CHUNK (65536)
+/* files in progress per worker, so that a large file does not stop them */
+#define ZIP_BUILDER_JOBS_PER_WORKER (4)
+
+#define ZIP_BUILDER_JOB_FREE   (0)
+#define ZIP_BUILDER_JOB_QUEUED (1)
+#define ZIP_BUILDER_JOB_TAKEN  (2)
+#define ZIP_BUILDER_JOB_DONE   (3)
+
+/* One file of zipBuilderAddFile */
+typedef struct zip_builder_job_s {
+  char* path;
+  char* filename;
+  zip_fileinfo zipfi;
+  int has_zipfi;
+  int level;
+  int state;
+  int err;               /* ZIP_OK if the file was read and deflated */
+  uLong crc;
+  ZPOS64_T uncompressed_size;
+  ZPOS64_T compressed_size;
+  unsigned char* out;    /* deflated data held in memory, kept for the next job */
+  size_t out_len;
+  size_t out_capacity;
+  FILE* spill;           /* deflated data beyond max_held, NULL if none */
+} zip_builder_job;
+
+/* Stream and buffers of a thread deflating the files */
+typedef struct zip_builder_worker_s {
+  z_stream stream;
+  int stream_initialised;
+  int level;             /* level of stream */
+  unsigned char* in;
+  unsigned char* out;
+} zip_builder_worker;
+
+/* State of a builder of zipBuilderOpen. The jobs form a ring : filled by
+   zipBuilderAddFile at next_fill, taken by the workers in the same order,
+   and written to the zipfile at next_write. */
+typedef struct zip_builder_s {
+  zipFile file;
+  zip_builder_job* jobs;
+  int nb_jobs;
+  int next_fill;
+  int next_take;
+  int next_write;
+  int nb_pending;        /* jobs filled and not yet written */
+  size_t max_held;       /* deflated bytes held in memory by one job */
+  ZPOS64_T nb_failed;
+  int err;               /* error of the zipfile, ZIP_OK while all is fine */
+  zip_builder_worker inline_worker; /* used on the calling thread */
+  int closing;
+  int nb_workers;        /* number of threads started, 0 to deflate on addition */
+#ifdef MZ_HAVE_PTHREAD
+  int has_mutex;         /* mutex and conditions initialized */
+  pthread_mutex_t mutex;
+  pthread_cond_t job_added;
+  pthread_cond_t job_done;
+  pthread_t* threads;
+#endif
+} zip_builder;
+
+static int zip_builder_init_worker(zip_builder_worker* worker)
+{
+  memset(worker, 0, sizeof(zip_builder_worker));
+  worker->in = (unsigned char*)malloc(ZIP_BUILDER_CHUNK);
+  worker->out = (unsigned char*)malloc(ZIP_BUILDER_CHUNK);
+  return (worker->in != NULL && worker->out != NULL) ? ZIP_OK : ZIP_INTERNALERROR;
+}
+
+static void zip_builder_free_worker(zip_builder_worker* worker)
+{
+  if (worker->stream_initialised)
+    deflateEnd(&worker->stream);
+  free(worker->in);
+  free(worker->out);
+}
+
+static FILE* zip_builder_tmpfile(void)
+{
+#ifdef MZ_HAVE_PTHREAD
+  /* tmpfile creates its file in P_tmpdir, outside of the sandbox of an iOS
+     application, whose temporary directory is given by TMPDIR */
+  const char* dir = getenv("TMPDIR");
+  if (dir != NULL && dir[0] != 0) {
+    size_t dir_len = strlen(dir);
+    char* name = (char*)malloc(dir_len + 32);
+    FILE* fp = NULL;
+    int fd;
+    if (name == NULL)
+      return NULL;
+    snprintf(name, dir_len + 32, "%s%szipbuilder.XXXXXX", dir, (dir[dir_len - 1] == '/') ? "" : "/");
+    fd = mkstemp(name);
+    if (fd >= 0) {
+      unlink(name);
+      fp = fdopen(fd, "w+b");
+      if (fp == NULL)
+        close(fd);
+    }
+    free(name);
+    return fp;
+  }
+#endif
+  return tmpfile();
+}
+
+/* Keep len bytes of deflated data of job, in memory up to max_held bytes,
+   then in a temporary file */
+static int zip_builder_output(zip_builder_job* job, const unsigned char* buf, size_t len, size_t max_held)
+{
+  if (len == 0)
+    return ZIP_OK;
+  job->compressed_size += len;
+  if (job->out_len + len > max_held) {
+    if (job->spill == NULL && (job->spill = zip_builder_tmpfile()) == NULL)
+      return ZIP_ERRNO;
+    if (job->out_len > 0 && fwrite(job->out, job->out_len, 1, job->spill) != 1)
+      return ZIP_ERRNO;
+    job->out_len = 0;
+    if (len > 0 && fwrite(buf, len, 1, job->spill) != 1)
+      return ZIP_ERRNO;
+    return ZIP_OK;
+  }
+  if (job->out_len + len > job->out_capacity) {
+    size_t capacity = (job->out_capacity > 0) ? job->out_capacity : ZIP_BUILDER_CHUNK;
+    unsigned char* out;
+    while (capacity < job->out_len + len)
+      capacity *= 2;
+    if (capacity > max_held)
+      capacity = max_held;
+    out = (unsigned char*)realloc(job->out, capacity);
+    if (out == NULL)
+      return ZIP_INTERNALERROR;
+    job->out = out;
+    job->out_capacity = capacity;
+  }
+  memcpy(job->out + job->out_len, buf, len);
+  job->out_len += len;
+  return ZIP_OK;
+}
+
+/* Read and deflate the file of job, in raw deflate (or stored for level 0) */
+static int zip_builder_deflate_file(zip_builder_worker* worker, zip_builder_job* job, size_t max_held)
+{
+  int err = ZIP_OK;
+  FILE* fp = fopen(job->path, "rb");
+  if (fp == NULL)
+    return ZIP_ERRNO;
+
+  if (job->level != 0) {
+    if (worker->stream_initialised && worker->level != job->level) {
+      deflateEnd(&worker->stream);
+      worker->stream_initialised = 0;
+    }
+    if (worker->stream_initialised) {
+      deflateReset(&worker->stream);
+    } else {
+      memset(&worker->stream, 0, sizeof(z_stream));
+      if (deflateInit2(&worker->stream, job->level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fclose(fp);
+        return ZIP_INTERNALERROR;
+      }
+      worker->stream_initialised = 1;
+      worker->level = job->level;
+    }
+  }
+
+  for (;;) {
+    size_t len = fread(worker->in, 1, ZIP_BUILDER_CHUNK, fp);
+    int flush = (len < ZIP_BUILDER_CHUNK) ? Z_FINISH : Z_NO_FLUSH;
+    if (flush == Z_FINISH && ferror(fp)) {
+      err = ZIP_ERRNO;
+      break;
+    }
+    job->crc = mzCrc32(job->crc, worker->in, (uLong)len);
+    job->uncompressed_size += len;
+
+    if (job->level == 0) {
+      err = zip_builder_output(job, worker->in, len, max_held);
+    } else {
+      worker->stream.next_in = worker->in;
+      worker->stream.avail_in = (uInt)len;
+      do {
+        worker->stream.next_out = worker->out;
+        worker->stream.avail_out = ZIP_BUILDER_CHUNK;
+        if (deflate(&worker->stream, flush) == Z_STREAM_ERROR) {
+          err = ZIP_INTERNALERROR;
+          break;
+        }
+        err = zip_builder_output(job, worker->out, ZIP_BUILDER_CHUNK - worker->stream.avail_out, max_held);
+      } while (err == ZIP_OK && worker->stream.avail_out == 0);
+    }
+    if (err != ZIP_OK || flush == Z_FINISH)
+      break;
+  }
+  fclose(fp);
+
+  /* a file which the deflate does not make smaller is read again, and stored */
+  if (err == ZIP_OK && job->level != 0 && job->compressed_size >= job->uncompressed_size) {
+    if (job->spill != NULL)
+      fclose(job->spill);
+    job->spill = NULL;
+    job->out_len = 0;
+    job->crc = 0;
+    job->uncompressed_size = 0;
+    job->compressed_size = 0;
+    job->level = 0;
+    return zip_builder_deflate_file(worker, job, max_held);
+  }
+  return err;
+}
+
+/* Write the deflated file of job to the zipfile, through its raw path */
+static int zip_builder_write_job(zip_builder* builder, zip_builder_job* job)
+{
+  int err;
+  if (job->err != ZIP_OK) {
+    builder->nb_failed++;
+    return ZIP_OK;
+  }
+
+  err = zipOpenNewFileInZip2_64(builder->file, job->filename, job->has_zipfi ? &job->zipfi : NULL,
+                                NULL, 0, NULL, 0, NULL, (job->level != 0) ? Z_DEFLATED : 0, job->level, 1,
+                                (job->uncompressed_size >= 0xffffffff) || (job->compressed_size >= 0xffffffff));
+  if (err == ZIP_OK && job->spill != NULL) {
+    /* the spilled data comes before the data held in memory */
+    if (fseek(job->spill, 0, SEEK_SET) != 0)
+      err = ZIP_ERRNO;
+    while (err == ZIP_OK) {
+      size_t len = fread(builder->inline_worker.in, 1, ZIP_BUILDER_CHUNK, job->spill);
+      if (len == 0) {
+        if (ferror(job->spill))
+          err = ZIP_ERRNO;
+        break;
+      }
+      err = zipWriteInFileInZip(builder->file, builder->inline_worker.in, (unsigned)len);
+    }
+  }
+  if (err == ZIP_OK && job->out_len > 0)
+    err = zipWriteInFileInZip(builder->file, job->out, (unsigned)job->out_len);
+  if (err == ZIP_OK)
+    err = zipCloseFileInZipRaw64(builder->file, job->uncompressed_size, job->crc);
+  return err;
+}
+
+static void zip_builder_release_job(zip_builder_job* job)
+{
+  free(job->path);
+  free(job->filename);
+  job->path = NULL;
+  job->filename = NULL;
+  if (job->spill != NULL)
+    fclose(job->spill);
+  job->spill = NULL;
+  job->out_len = 0;
+}
+
+#ifdef MZ_HAVE_PTHREAD
+static void* zip_builder_run_worker(void* arg)
+{
+  zip_builder* builder = (zip_builder*)arg;
+  zip_builder_worker worker;
+  int err = zip_builder_init_worker(&worker);
+
+  pthread_mutex_lock(&builder->mutex);
+  for (;;) {
+    zip_builder_job* job;
+    while ((job = &builder->jobs[builder->next_take])->state != ZIP_BUILDER_JOB_QUEUED && !builder->closing)
+      pthread_cond_wait(&builder->job_added, &builder->mutex);
+    if (job->state != ZIP_BUILDER_JOB_QUEUED)
+      break;
+    job->state = ZIP_BUILDER_JOB_TAKEN;
+    builder->next_take = (builder->next_take + 1) % builder->nb_jobs;
+    pthread_mutex_unlock(&builder->mutex);
+
+    job->err = (err == ZIP_OK) ? zip_builder_deflate_file(&worker, job, builder->max_held) : err;
+
+    pthread_mutex_lock(&builder->mutex);
+    job->state = ZIP_BUILDER_JOB_DONE;
+    pthread_cond_broadcast(&builder->job_done);
+  }
+  pthread_mutex_unlock(&builder->mutex);
+  zip_builder_free_worker(&worker);
+  return NULL;
+}
+
+/* Write to the zipfile the deflated files at the head of the ring, waiting
+   for them while more than nb_max files are pending */
+static int zip_builder_write_jobs(zip_builder* builder, int nb_max)
+{
+  while (builder->err == ZIP_OK && builder->nb_pending > 0) {
+    zip_builder_job* job = &builder->jobs[builder->next_write];
+    int state;
+    pthread_mutex_lock(&builder->mutex);
+    while (job->state != ZIP_BUILDER_JOB_DONE && builder->nb_pending > nb_max)
+      pthread_cond_wait(&builder->job_done, &builder->mutex);
+    state = job->state;
+    pthread_mutex_unlock(&builder->mutex);
+    if (state != ZIP_BUILDER_JOB_DONE)
+      break;
+
+    builder->err = zip_builder_write_job(builder, job);
+    zip_builder_release_job(job);
+    /* the workers look at the state of the next job to take */
+    pthread_mutex_lock(&builder->mutex);
+    job->state = ZIP_BUILDER_JOB_FREE;
+    pthread_mutex_unlock(&builder->mutex);
+    builder->next_write = (builder->next_write + 1) % builder->nb_jobs;
+    builder->nb_pending--;
+  }
+  return builder->err;
+}
+#endif
+
+extern zipBuilder ZEXPORT zipBuilderOpen(file, nb_workers, max_pending)
+zipFile file;
+int nb_workers;
+ZPOS64_T max_pending;
+{
+  zip_builder* builder;
+  if (file == NULL)
+    return NULL;
+  builder = (zip_builder*)calloc(1, sizeof(zip_builder));
+  if (builder == NULL)
+    return NULL;
+  builder->file = file;
+  builder->nb_jobs = 1;
+  if (zip_builder_init_worker(&builder->inline_worker) != ZIP_OK) {
+    zip_builder_free_worker(&builder->inline_worker);
+    free(builder);
+    return NULL;
+  }
+
+#ifdef MZ_HAVE_PTHREAD
+  if (nb_workers > 0 && pthread_mutex_init(&builder->mutex, NULL) == 0) {
+    builder->nb_jobs = nb_workers * ZIP_BUILDER_JOBS_PER_WORKER;
+    pthread_cond_init(&builder->job_added, NULL);
+    pthread_cond_init(&builder->job_done, NULL);
+    builder->has_mutex = 1;
+    builder->threads = (pthread_t*)calloc((size_t)nb_workers, sizeof(pthread_t));
+  }
+#else
+  (void)nb_workers;
+#endif
+
+  builder->jobs = (zip_builder_job*)calloc((size_t)builder->nb_jobs, sizeof(zip_builder_job));
+  builder->max_held = (size_t)(max_pending / (ZPOS64_T)builder->nb_jobs);
+  if (builder->max_held < ZIP_BUILDER_CHUNK)
+    builder->max_held = ZIP_BUILDER_CHUNK;
+
+#ifdef MZ_HAVE_PTHREAD
+  if (builder->threads != NULL && builder->jobs != NULL) {
+    int i;
+    for (i = 0; i < nb_workers; i++) {
+      if (pthread_create(&builder->threads[i], NULL, zip_builder_run_worker, builder) != 0)
+        break;
+      builder->nb_workers++;
+    }
+  }
+#endif
+
+  if (builder->jobs == NULL) {
+    zipBuilderClose((zipBuilder)builder, NULL);
+    return NULL;
+  }
+  return (zipBuilder)builder;
+}
+
+extern int ZEXPORT zipBuilderAddFile(builder, path, filename, zipfi, level)
+zipBuilder builder;
+const char* path;
+const char* filename;
+const zip_fileinfo* zipfi;
+int level;
+{
+  zip_builder* b = (zip_builder*)builder;
+  zip_builder_job* job;
+  if (b == NULL || path == NULL || filename == NULL)
+    return ZIP_PARAMERROR;
+  if (b->err != ZIP_OK)
+    return b->err;
+
+#ifdef MZ_HAVE_PTHREAD
+  /* make room in the ring */
+  if (b->nb_workers > 0 && zip_builder_write_jobs(b, b->nb_jobs - 1) != ZIP_OK)
+    return b->err;
+#endif
+
+  job = &b->jobs[b->next_fill];
+  job->path = strdup(path);
+  job->filename = strdup(filename);
+  if (job->path == NULL || job->filename == NULL) {
+    zip_builder_release_job(job);
+    return ZIP_INTERNALERROR;
+  }
+  job->has_zipfi = (zipfi != NULL);
+  if (zipfi != NULL)
+    job->zipfi = *zipfi;
+  job->level = level;
+  job->err = ZIP_OK;
+  job->crc = 0;
+  job->uncompressed_size = 0;
+  job->compressed_size = 0;
+
+#ifdef MZ_HAVE_PTHREAD
+  if (b->nb_workers > 0) {
+    pthread_mutex_lock(&b->mutex);
+    job->state = ZIP_BUILDER_JOB_QUEUED;
+    pthread_cond_signal(&b->job_added);
+    pthread_mutex_unlock(&b->mutex);
+    b->next_fill = (b->next_fill + 1) % b->nb_jobs;
+    b->nb_pending++;
+    /* the files already deflated are written without waiting */
+    return zip_builder_write_jobs(b, b->nb_jobs);
+  }
+#endif
+
+  /* no worker : the file is deflated and written now */
+  job->err = zip_builder_deflate_file(&b->inline_worker, job, b->max_held);
+  b->err = zip_builder_write_job(b, job);
+  zip_builder_release_job(job);
+  return b->err;
+}
+
+extern int ZEXPORT zipBuilderClose(builder, nb_failed)
+zipBuilder builder;
+ZPOS64_T* nb_failed;
+{
+  zip_builder* b = (zip_builder*)builder;
+  int err;
+  int i;
+  if (b == NULL)
+    return ZIP_PARAMERROR;
+
+#ifdef MZ_HAVE_PTHREAD
+  if (b->has_mutex) {
+    if (b->nb_workers > 0)
+      zip_builder_write_jobs(b, 0);
+    /* after an error of the zipfile, the workers end the files already queued */
+    pthread_mutex_lock(&b->mutex);
+    b->closing = 1;
+    pthread_cond_broadcast(&b->job_added);
+    pthread_mutex_unlock(&b->mutex);
+    for (i = 0; i < b->nb_workers; i++)
+      pthread_join(b->threads[i], NULL);
+    free(b->threads);
+    pthread_cond_destroy(&b->job_added);
+    pthread_cond_destroy(&b->job_done);
+    pthread_mutex_destroy(&b->mutex);
+  }
+#endif
+
+  for (i = 0; b->jobs != NULL && i < b->nb_jobs; i++) {
+    zip_builder_release_job(&b->jobs[i]);
+    free(b->jobs[i].out);
+  }
+  free(b->jobs);
+  zip_builder_free_worker(&b->inline_worker);
+
+  if (nb_failed != NULL)
+    *nb_failed = b->nb_failed;
+  err = b->err;
+  free(b);
+  return err;
+}
+
+#define ZIP_COPY_BUFSIZE (65536)
+
+extern int ZEXPORT zipCopyEntryFrom(file, source, filename)
+zipFile file;
+unzFile source;
+const char* filename;
+{
+  unz_file_info64 info;
+  zip_fileinfo zipfi;
+  char* name = NULL;
+  char* extra_global = NULL;
+  char* extra_local = NULL;
+  char* comment = NULL;
+  voidp buf = NULL;
+  int size_extra_global;
+  int size_extra_local = 0;
+  int method = 0;
+  int level = 0;
+  int opened = 0;
+  int err;
+
+  if (file == NULL || source == NULL)
+    return ZIP_PARAMERROR;
+  err = unzGetCurrentFileInfo64(source, &info, NULL, 0, NULL, 0, NULL, 0);
+  if (err != UNZ_OK)
+    return err;
+  /* their check byte comes from the time given in the data descriptor */
+  if ((info.flag & 1) != 0 && (info.flag & 8) != 0)
+    return ZIP_PARAMERROR;
+
+  name = (char*)malloc(info.size_filename + 1);
+  extra_global = (char*)malloc(info.size_file_extra + 1);
+  comment = (char*)malloc(info.size_file_comment + 1);
+  buf = malloc(ZIP_COPY_BUFSIZE);
+  if (name == NULL || extra_global == NULL || comment == NULL || buf == NULL)
+    err = ZIP_INTERNALERROR;
+  if (err == ZIP_OK)
+    err = unzGetCurrentFileInfo64(source, NULL, name, info.size_filename + 1,
+                                  extra_global, info.size_file_extra,
+                                  comment, info.size_file_comment + 1);
+  if (err == ZIP_OK)
+    err = unzOpenCurrentFile2(source, &method, &level, 1);
+
+  if (err == ZIP_OK) {
+    opened = 1;
+    size_extra_local = unzGetLocalExtrafield(source, NULL, 0);
+    if (size_extra_local < 0)
+      err = size_extra_local;
+  }
+  if (err == ZIP_OK && size_extra_local > 0) {
+    extra_local = (char*)malloc((size_t)size_extra_local);
+    if (extra_local == NULL)
+      err = ZIP_INTERNALERROR;
+    else if (unzGetLocalExtrafield(source, extra_local, (unsigned)size_extra_local) != size_extra_local)
+      err = ZIP_ERRNO;
+  }
+
+  if (err == ZIP_OK) {
+    /* zip writes the zip64 extra fields itself, from the sizes given here */
+    size_extra_global = (int)info.size_file_extra;
+    zipRemoveExtraInfoBlock(extra_global, &size_extra_global, 0x0001);
+    if (extra_local != NULL)
+      zipRemoveExtraInfoBlock(extra_local, &size_extra_local, 0x0001);
+
+    memset(&zipfi, 0, sizeof(zip_fileinfo));
+    zipfi.dosDate = info.dosDate;
+    zipfi.internal_fa = info.internal_fa;
+    zipfi.external_fa = info.external_fa;
+
+    /* level 0 keeps the compression bits of the flag, without the data descriptor */
+    err = zipOpenNewFileInZip4_64(file, (filename != NULL) ? filename : name, &zipfi,
+                                  extra_local, (uInt)size_extra_local,
+                                  extra_global, (uInt)size_extra_global,
+                                  (info.size_file_comment > 0) ? comment : NULL,
+                                  (int)info.compression_method, 0, 1,
+                                  -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+                                  NULL, 0, info.version, info.flag & ~(uLong)8,
+                                  (info.uncompressed_size >= 0xffffffff) || (info.compressed_size >= 0xffffffff));
+  }
+
+  if (err == ZIP_OK) {
+    int read;
+    while ((read = unzReadCurrentFile(source, buf, ZIP_COPY_BUFSIZE)) > 0) {
+      err = zipWriteInFileInZip(file, buf, (unsigned)read);
+      if (err != ZIP_OK)
+        break;
+    }
+    if (read < 0 && err == ZIP_OK)
+      err = read;
+    /* the file is closed even after an error, so that file stays consistent */
+    if (err == ZIP_OK)
+      err = zipCloseFileInZipRaw64(file, info.uncompressed_size, info.crc);
+    else
+      zipCloseFileInZipRaw64(file, info.uncompressed_size, info.crc);
+  }
+
+  if (opened) {
+    int close_err = unzCloseCurrentFile(source);
+    if (err == ZIP_OK)
+      err = close_err;
+  }
+  free(name);
+  free(extra_global);
+  free(extra_local);
+  free(comment);
+  free(buf);
+  return err;
+}
@@ -16,6 +16,7 @@ extern "C" {
 #endif
 
 #include "unzip.h"
+#include "zip.h"
 
 /* Repair a ZIP file (missing central directory)
    file: file to recover
@@ -28,4 +29,154 @@ extern int ZEXPORT unzRepair(const char* file,
                              uLong* nRecovered,
                              uLong* bytesRecovered);
 
+/* Callback of unzParallelForEachFile, called from a worker thread with a
+   handle positioned on the file num_of_file (not opened).
+   Return UNZ_OK to go on, any other value stops the processing.
+*/
+typedef int (*unz_parallel_file_func) OF((voidpf opaque,
+                                          unzFile file,
+                                          ZPOS64_T num_of_file));
+
+/* Call file_func for every file of an opened zipfile, on nb_workers threads.
+   file: zipfile opened with fill_pread_filefunc64 or fill_mmap_filefunc64,
+         each worker uses its own unzOpenClone handle ; with another backend the
+         files are processed one after another on the calling thread
+   nb_workers: number of threads, 1 or less to process on the calling thread
+   The largest files (by compressed size) are dispatched first, so that the
+   workers end at about the same time. file_func must be thread safe.
+   Return UNZ_OK, or the first value other than UNZ_OK returned by file_func.
+   The current file of file is reset to the first file.
+*/
+extern int ZEXPORT unzParallelForEachFile(unzFile file,
+                                          int nb_workers,
+                                          unz_parallel_file_func file_func,
+                                          voidpf opaque);
+
+/* Result of the test of one file by unzTestArchive */
+typedef struct unz_test_result_s {
+  ZPOS64_T num_of_file;        /* index of the file in the zipfile */
+  const char* filename;        /* name of the file, valid during the callback only */
+  ZPOS64_T uncompressed_size;  /* number of bytes inflated */
+  int err;                     /* UNZ_OK, UNZ_CRCERROR, UNZ_BADZIPFILE if the local
+                                  header or the size do not match the central
+                                  directory, UNZ_PARAMERROR if the file is
+                                  encrypted, or another error */
+} unz_test_result;
+
+/* Callback of unzTestArchive, called once per file, one call at a time */
+typedef void (*unz_test_report_func) OF((voidpf opaque,
+                                         const unz_test_result* result));
+
+/* Test every file of an opened zipfile : inflate it without writing it
+   anywhere, and check its CRC, its size and its local header.
+   The files are tested by unzParallelForEachFile on nb_workers threads (0 for
+   one per online processor), see there for the backends.
+   report_func (can be NULL) receives the result of each file, in no given order.
+   Return UNZ_OK if every file is good, UNZ_BADZIPFILE if some are not, or
+   another error if the zipfile cannot be tested.
+*/
+extern int ZEXPORT unzTestArchive(unzFile file,
+                                  int nb_workers,
+                                  unz_test_report_func report_func,
+                                  voidpf opaque);
+
+/* Queue of files written on worker threads, so that the extraction of many
+   small files is not held up by the latency of open, write and close */
+typedef voidp unzWriteQueue;
+
+/* Open a queue writing the files submitted to it on nb_workers threads.
+   nb_workers: number of files written at the same time, 0 to write each file
+               on the calling thread when it is submitted
+   max_pending: number of bytes held by the queue before unzWriteQueueSubmit
+                waits for some writes to end
+   Return NULL if the queue cannot be created.
+*/
+extern unzWriteQueue ZEXPORT unzWriteQueueOpen(int nb_workers,
+                                               ZPOS64_T max_pending);
+
+/* Add a file to write to the queue.
+   path: file to create or truncate, its directory must exist
+   buf, len: content of the file ; the queue takes buf, allocated with malloc,
+             and frees it once it is written, or on error
+   mode: permissions of the file (the high 16 bits of external_fa of a
+         unix zipfile), 0 to keep the default ones
+   dosDate: modification date of the file in the format of unz_file_info,
+            0 to keep the current date
+   Return UNZ_OK if the file is queued (or written, without workers).
+*/
+extern int ZEXPORT unzWriteQueueSubmit(unzWriteQueue file,
+                                       const char* path,
+                                       voidp buf,
+                                       size_t len,
+                                       unsigned mode,
+                                       uLong dosDate);
+
+/* Wait for all the files of the queue to be written, and free it.
+   nb_failed (can be NULL) receives the number of files which could not be
+   written.
+   Return UNZ_OK if every file was written, UNZ_ERRNO otherwise.
+*/
+extern int ZEXPORT unzWriteQueueClose(unzWriteQueue file,
+                                      ZPOS64_T* nb_failed);
+
+/* Builder adding many files to a zipfile, deflated on worker threads and
+   written to the zipfile in the order they were added */
+typedef voidp zipBuilder;
+
+/* Open a builder adding files to file, opened by zipOpen.
+   nb_workers: number of files deflated at the same time, 0 to deflate each
+               file on the calling thread when it is added
+   max_pending: number of bytes of deflated data held in memory by the
+                builder ; a file deflated to more than max_pending divided by
+                the number of files in progress (4 per worker) is kept in a
+                temporary file until it is written to the zipfile
+   No other file may be opened in file until zipBuilderClose.
+   Return NULL if the builder cannot be created.
+*/
+extern zipBuilder ZEXPORT zipBuilderOpen(zipFile file,
+                                         int nb_workers,
+                                         ZPOS64_T max_pending);
+
+/* Add the file at path to the zipfile, under filename.
+   zipfi (can be NULL), level: as for zipOpenNewFileInZip, level 0 stores
+                               the file, as is done for a file which the
+                               deflate does not make smaller
+   The file is read and deflated by a worker, then written to the zipfile by
+   a later call of zipBuilderAddFile or by zipBuilderClose, through the raw
+   path of zipOpenNewFileInZip2_64 and zipCloseFileInZipRaw64.
+   A file which cannot be read or deflated is left out of the zipfile and
+   counted by zipBuilderClose.
+   Return ZIP_OK, or the error of the zipfile if a file could not be
+   written to it (the following files are then left out).
+*/
+extern int ZEXPORT zipBuilderAddFile(zipBuilder builder,
+                                     const char* path,
+                                     const char* filename,
+                                     const zip_fileinfo* zipfi,
+                                     int level);
+
+/* Write the files still in progress to the zipfile, and free the builder.
+   The zipfile stays open.
+   nb_failed (can be NULL) receives the number of files left out.
+   Return ZIP_OK, or the error of the zipfile if a file could not be written
+   to it.
+*/
+extern int ZEXPORT zipBuilderClose(zipBuilder builder,
+                                   ZPOS64_T* nb_failed);
+
+/* Copy the current file of source to file, as a new file named filename
+   (NULL to keep its name), without inflating and deflating it : the
+   compressed data is copied as it is, through unzOpenCurrentFile2 and
+   zipCloseFileInZipRaw64, with the crc, the sizes, the date, the attributes,
+   the comment and the extra fields of the file (but for the zip64 ones,
+   which zip writes again if needed).
+   An encrypted file is copied encrypted, but for one written with a data
+   descriptor, which zip does not write (ZIP_PARAMERROR).
+   No file may be opened in source.
+   Return ZIP_OK, or the error of unzip or zip (their codes are the same).
+*/
+extern int ZEXPORT zipCopyEntryFrom(zipFile file,
+                                    unzFile source,
+                                    const char* filename);
+
 #endif
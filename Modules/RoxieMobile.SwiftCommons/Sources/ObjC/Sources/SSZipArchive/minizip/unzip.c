@@ -74,6 +74,7 @@
 
 #include "zlib.h"
 #include "unzip.h"
+#include "mzcrc32.h"
 
 #ifdef STDC
 #  include <stddef.h>
@@ -118,6 +119,9 @@
 #define SIZECENTRALDIRITEM (0x2e)
 #define SIZEZIPLOCALHEADER (0x1e)
 
+/* value of unz64_s.stream_pos when the position of the stream is unknown */
+#define UNZ_STREAM_POS_UNKNOWN ((ZPOS64_T)-1)
+
 
 const char unz_copyright[] =
    " unzip 1.01 Copyright 1998-2004 Gilles Vollant - http://www.winimage.com/zLibDll";
@@ -129,6 +133,28 @@ typedef struct unz_file_info64_internal_s
 } unz_file_info64_internal;
 
 
+/* unz64_seek_point_s contain a checkpoint of the inflate state, from which
+    inflate can be restarted in the middle of a deflated file */
+typedef struct unz64_seek_point_s
+{
+    ZPOS64_T out;                  /* offset in the uncompressed data */
+    ZPOS64_T in;                   /* offset in the compressed data of the first full byte */
+    int bits;                      /* number of bits (0..7) of the byte before in to use */
+    uInt window_size;              /* size of window, up to 32K */
+    unsigned char* window;         /* uncompressed data before out, used as dictionary */
+} unz64_seek_point;
+
+/* unz64_seek_index_s contain the checkpoints of a deflated file,
+    used by unzSeekCurrentFile64 */
+typedef struct unz64_seek_index_s
+{
+    ZPOS64_T span;                 /* uncompressed bytes between two checkpoints */
+    uLong count;                   /* number of checkpoints */
+    uLong capacity;                /* number of checkpoints allocated */
+    unz64_seek_point* points;
+} unz64_seek_index;
+
+
 /* file_in_zip_read_info_s contain internal information about a file in zipfile,
     when reading and decompress it */
 typedef struct
@@ -142,6 +168,7 @@ typedef struct
 
     ZPOS64_T pos_in_zipfile;       /* position in byte on the zipfile, for fseek*/
     uLong stream_initialised;   /* flag set if stream structure is initialised*/
+    int inflate_allocated;      /* 1 if inflate state of stream is allocated, kept between files */
 
     ZPOS64_T offset_local_extrafield;/* offset of the local extra field */
     uInt  size_local_extrafield;/* size of the local extra field */
@@ -157,9 +184,51 @@ typedef struct
     uLong compression_method;   /* compression method (0==store) */
     ZPOS64_T byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
     int   raw;
+    const unsigned char* mapped_data; /* zipfile mapped in memory, NULL if not mapped */
+    ZPOS64_T mapped_size;             /* size of the mapped zipfile */
+
+    ZPOS64_T pos_in_zipfile_start;       /* pos_in_zipfile of the first byte of data */
+    ZPOS64_T rest_read_compressed_start; /* rest_read_compressed of the first byte of data */
+    int check_crc;                    /* 0 once a seek skipped some data, the CRC cannot be checked */
+    ZPOS64_T read_ahead_pos;          /* end of the compressed data already hinted for read-ahead */
+    unz64_seek_index* seek_index;     /* checkpoints for unzSeekCurrentFile64, NULL if none */
+#ifndef NOUNCRYPT
+    unsigned long keys_start[3];      /* keys at the first byte of data, to rewind */
+#endif
 } file_in_zip64_read_info_s;
 
 
+/* unz64_central_dir_s contain the raw central directory of the zipfile,
+   loaded in memory with a single read when the zipfile is opened.
+   It is never modified afterwards, and shared by the handles made by unzOpenClone */
+typedef struct unz64_central_dir_s
+{
+    unsigned char* data;           /* central directory records */
+    ZPOS64_T size;                 /* size of the central directory */
+    long refcount;                 /* number of handles using it */
+} unz64_central_dir;
+
+
+/* unz64_name_index_entry_s contain one slot of the filename hash table */
+typedef struct unz64_name_index_entry_s
+{
+    const unsigned char* name;     /* filename in the cached central dir, NULL if slot is free */
+    uLong size_name;               /* length of the filename, up to a zero */
+    uLong hash;                    /* case folded hash of the filename */
+    ZPOS64_T pos_in_zip_directory; /* offset of the record in zip file directory */
+    ZPOS64_T num_of_file;          /* # of file */
+} unz64_name_index_entry;
+
+/* unz64_name_index_s contain the optional filename index of the zipfile,
+   built on demand by unzBuildFileNameIndex */
+typedef struct unz64_name_index_s
+{
+    unz64_name_index_entry* entries;
+    uLong mask;                    /* number of slots - 1, a power of two - 1 */
+    long refcount;                 /* number of handles using it */
+} unz64_name_index;
+
+
 /* unz64_s contain internal information about the zipfile
 */
 typedef struct
@@ -177,6 +246,8 @@ typedef struct
     ZPOS64_T size_central_dir;     /* size of the central directory  */
     ZPOS64_T offset_central_dir;   /* offset of start of central directory with
                                    respect to the starting disk number */
+    unz64_central_dir* central_dir; /* central directory cached in memory */
+    unz64_name_index* name_index;  /* filename index, NULL until it is built */
 
     unz_file_info64 cur_file_info; /* public info about the current file in zip*/
     unz_file_info64_internal cur_file_info_internal; /* private info about it*/
@@ -186,17 +257,37 @@ typedef struct
 
     int isZip64;
 
+    zlib_allocator_def allocator;  /* allocator of the internal memory of the handle */
+    uLong read_buffer_size;        /* size of the read buffer of the current file */
+    file_in_zip64_read_info_s* pfile_in_zip_read_spare; /* info of the last closed file,
+                                      with its read buffer and inflate state, reused
+                                      by the next unzOpenCurrentFile */
+    ZPOS64_T seek_index_span;      /* span of the seek index built on the first seek, 0 for none */
+    uLong read_ahead_depth;        /* number of read buffers hinted for read-ahead, 0 for none */
+    ZPOS64_T stream_pos;           /* position of filestream, to avoid useless seeks,
+                                      UNZ_STREAM_POS_UNKNOWN if unknown */
+
 #    ifndef NOUNCRYPT
     unsigned long keys[3];     /* keys defining the pseudo-random sequence */
-    const unsigned long* pcrc_32_tab;
+    const z_crc_t* pcrc_32_tab;
 #    endif
 } unz64_s;
 
 
 #ifndef NOUNCRYPT
+#define INCLUDEDECRYPTINGCODE
 #include "crypt.h"
 #endif
 
+/* the central directory and the filename index are shared between threads
+   by unzOpenClone */
+#ifndef UNZ_ATOMIC_INCREMENT
+#define UNZ_ATOMIC_INCREMENT(p) __sync_add_and_fetch((p),1)
+#endif
+#ifndef UNZ_ATOMIC_DECREMENT
+#define UNZ_ATOMIC_DECREMENT(p) __sync_sub_and_fetch((p),1)
+#endif
+
 /* ===========================================================================
      Read a byte from a gz_stream; update next_in and avail_in. Return EOF
    for end of file.
@@ -293,56 +384,24 @@ local int unz64local_getLong (const zlib_filefunc64_32_def* pzlib_filefunc_def,
     return err;
 }
 
-local int unz64local_getLong64 OF((
-    const zlib_filefunc64_32_def* pzlib_filefunc_def,
-    voidpf filestream,
-    ZPOS64_T *pX));
-
-
-local int unz64local_getLong64 (const zlib_filefunc64_32_def* pzlib_filefunc_def,
-                            voidpf filestream,
-                            ZPOS64_T *pX)
+/* ===========================================================================
+   Reads a short, a long or a long64 in LSB order from a memory buffer
+   (the central directory cached in memory, or the tail of the zipfile).
+*/
+local uLong unz64local_getShortFromBuffer (const unsigned char* p)
 {
-    ZPOS64_T x ;
-    int i = 0;
-    int err;
-
-    err = unz64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x = (ZPOS64_T)i;
-
-    if (err==UNZ_OK)
-        err = unz64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x |= ((ZPOS64_T)i)<<8;
-
-    if (err==UNZ_OK)
-        err = unz64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x |= ((ZPOS64_T)i)<<16;
-
-    if (err==UNZ_OK)
-        err = unz64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x |= ((ZPOS64_T)i)<<24;
-
-    if (err==UNZ_OK)
-        err = unz64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x |= ((ZPOS64_T)i)<<32;
-
-    if (err==UNZ_OK)
-        err = unz64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x |= ((ZPOS64_T)i)<<40;
-
-    if (err==UNZ_OK)
-        err = unz64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x |= ((ZPOS64_T)i)<<48;
+    return (uLong)p[0] | ((uLong)p[1]<<8);
+}
 
-    if (err==UNZ_OK)
-        err = unz64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x |= ((ZPOS64_T)i)<<56;
+local uLong unz64local_getLongFromBuffer (const unsigned char* p)
+{
+    return (uLong)p[0] | ((uLong)p[1]<<8) | ((uLong)p[2]<<16) | ((uLong)p[3]<<24);
+}
 
-    if (err==UNZ_OK)
-        *pX = x;
-    else
-        *pX = 0;
-    return err;
+local ZPOS64_T unz64local_getLong64FromBuffer (const unsigned char* p)
+{
+    return (ZPOS64_T)unz64local_getLongFromBuffer(p) |
+           ((ZPOS64_T)unz64local_getLongFromBuffer(p+4)<<32);
 }
 
 /* My own strcmpi / strcasecmp */
@@ -401,175 +460,316 @@ extern int ZEXPORT unzStringFileNameCompare (const char*  fileName1,
     return STRCMPCASENOSENTIVEFUNCTION(fileName1,fileName2);
 }
 
-#ifndef BUFREADCOMMENT
-#define BUFREADCOMMENT (0x400)
-#endif
+#define SIZEENDOFCENTRALDIR (0x16)
+#define SIZEZIP64LOCATOR (0x14)
+#define SIZEZIP64ENDOFCENTRALDIR (0x38)
+
+/* unz64_end_of_central_dir contain the end of central directory record of a
+   zipfile, or its zip64 end of central directory record */
+typedef struct unz64_end_of_central_dir_s
+{
+    ZPOS64_T central_pos;          /* position of the record */
+    int isZip64;                   /* 1 if the record is the zip64 one */
+    uLong number_disk;             /* number of the current disk */
+    uLong number_disk_with_CD;     /* number the the disk with central dir */
+    ZPOS64_T number_entry;         /* number of entries on this disk */
+    ZPOS64_T number_entry_CD;      /* total number of entries in the central dir */
+    ZPOS64_T size_central_dir;     /* size of the central directory  */
+    ZPOS64_T offset_central_dir;   /* offset of start of central directory */
+    uLong size_comment;            /* size of the global comment, 0 for zip64 */
+} unz64_end_of_central_dir;
 
 /*
-  Locate the Central directory of a zipfile (at the end, just before
-    the global comment)
+  Find the last signature of the end of central directory record in buf,
+    preferring the one whose comment ends exactly at the end of buf
+  return -1 if there is none
 */
-local ZPOS64_T unz64local_SearchCentralDir OF((const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream));
-local ZPOS64_T unz64local_SearchCentralDir(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream)
+local long unz64local_FindEndOfCentralDir(const unsigned char* buf, uLong uBufSize)
 {
-    unsigned char* buf;
-    ZPOS64_T uSizeFile;
-    ZPOS64_T uBackRead;
-    ZPOS64_T uMaxBack=0xffff; /* maximum size of global comment */
-    ZPOS64_T uPosFound=0;
+    long lFound = -1;
+    long i;
 
-    if (ZSEEK64(*pzlib_filefunc_def,filestream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
-        return 0;
-
-
-    uSizeFile = ZTELL64(*pzlib_filefunc_def,filestream);
+    if (uBufSize<SIZEENDOFCENTRALDIR)
+        return -1;
+    /* without comment, the record is at the very end and found by the first test */
+    for (i=(long)(uBufSize-SIZEENDOFCENTRALDIR); i>=0; i--)
+    {
+        if ((buf[i]!=0x50) || (unz64local_getLongFromBuffer(buf+i)!=0x06054b50))
+            continue;
+        if ((uLong)i+SIZEENDOFCENTRALDIR+unz64local_getShortFromBuffer(buf+i+20)==uBufSize)
+            return i;
+        if (lFound<0)
+            lFound = i;
+    }
+    return lFound;
+}
 
-    if (uMaxBack>uSizeFile)
-        uMaxBack = uSizeFile;
+/*
+  Read the zip64 end of central directory record pointed by the zip64 locator
+    just before the end of central directory record.
+  return 0 if there is no usable zip64 record
+*/
+local int unz64local_ReadZip64EndOfCentralDir(const zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                              voidpf filestream,
+                                              const unsigned char* buf, ZPOS64_T uBufPos, uLong uBufSize,
+                                              long lPosLocator,
+                                              unz64_end_of_central_dir* pend)
+{
+    unsigned char record[SIZEZIP64ENDOFCENTRALDIR];
+    const unsigned char* p;
+    ZPOS64_T relativeOffset;
 
-    buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
-    if (buf==NULL)
+    p = buf+lPosLocator;
+    if (unz64local_getLongFromBuffer(p)!=0x07064b50)
+        return 0;
+    /* number of the disk with the start of the zip64 end of central directory */
+    if (unz64local_getLongFromBuffer(p+4)!=0)
+        return 0;
+    /* relative offset of the zip64 end of central directory record */
+    relativeOffset = unz64local_getLong64FromBuffer(p+8);
+    /* total number of disks */
+    if (unz64local_getLongFromBuffer(p+16)!=1)
         return 0;
 
-    uBackRead = 4;
-    while (uBackRead<uMaxBack)
+    /* the record is usually in the tail already read */
+    if ((relativeOffset>=uBufPos) && (relativeOffset+SIZEZIP64ENDOFCENTRALDIR<=uBufPos+uBufSize))
+        p = buf+(relativeOffset-uBufPos);
+    else
     {
-        uLong uReadSize;
-        ZPOS64_T uReadPos ;
-        int i;
-        if (uBackRead+BUFREADCOMMENT>uMaxBack)
-            uBackRead = uMaxBack;
-        else
-            uBackRead+=BUFREADCOMMENT;
-        uReadPos = uSizeFile-uBackRead ;
-
-        uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
-                     (BUFREADCOMMENT+4) : (uLong)(uSizeFile-uReadPos);
-        if (ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            break;
-
-        if (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
-            break;
-
-        for (i=(int)uReadSize-3; (i--)>0;)
-            if (((*(buf+i))==0x50) && ((*(buf+i+1))==0x4b) &&
-                ((*(buf+i+2))==0x05) && ((*(buf+i+3))==0x06))
-            {
-                uPosFound = uReadPos+i;
-                break;
-            }
-
-        if (uPosFound!=0)
-            break;
+        if (ZSEEK64(*pzlib_filefunc_def,filestream,relativeOffset,ZLIB_FILEFUNC_SEEK_SET)!=0)
+            return 0;
+        if (ZREAD64(*pzlib_filefunc_def,filestream,record,SIZEZIP64ENDOFCENTRALDIR)!=SIZEZIP64ENDOFCENTRALDIR)
+            return 0;
+        p = record;
     }
-    TRYFREE(buf);
-    return uPosFound;
-}
+    if (unz64local_getLongFromBuffer(p)!=0x06064b50)
+        return 0;
 
+    pend->central_pos = relativeOffset;
+    pend->isZip64 = 1;
+    /* p+4 size of the record, p+12 version made by, p+14 version needed to extract */
+    pend->number_disk = unz64local_getLongFromBuffer(p+16);
+    pend->number_disk_with_CD = unz64local_getLongFromBuffer(p+20);
+    pend->number_entry = unz64local_getLong64FromBuffer(p+24);
+    pend->number_entry_CD = unz64local_getLong64FromBuffer(p+32);
+    pend->size_central_dir = unz64local_getLong64FromBuffer(p+40);
+    pend->offset_central_dir = unz64local_getLong64FromBuffer(p+48);
+    pend->size_comment = 0;
+    return 1;
+}
 
 /*
-  Locate the Central directory 64 of a zipfile (at the end, just before
-    the global comment)
+  Locate and read the end of central directory record of a zipfile (at the end,
+    just before the global comment), or the zip64 one if there is one.
+  The tail of the zipfile, which holds the record, the global comment and the
+    zip64 locator, is read with a single read.
 */
-local ZPOS64_T unz64local_SearchCentralDir64 OF((
-    const zlib_filefunc64_32_def* pzlib_filefunc_def,
-    voidpf filestream));
-
-local ZPOS64_T unz64local_SearchCentralDir64(const zlib_filefunc64_32_def* pzlib_filefunc_def,
-                                      voidpf filestream)
+local int unz64local_ReadEndOfCentralDir OF((const zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                             const zlib_allocator_def* pallocator,
+                                             voidpf filestream,
+                                             unz64_end_of_central_dir* pend));
+local int unz64local_ReadEndOfCentralDir(const zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                         const zlib_allocator_def* pallocator,
+                                         voidpf filestream,
+                                         unz64_end_of_central_dir* pend)
 {
     unsigned char* buf;
     ZPOS64_T uSizeFile;
-    ZPOS64_T uBackRead;
-    ZPOS64_T uMaxBack=0xffff; /* maximum size of global comment */
-    ZPOS64_T uPosFound=0;
-    uLong uL;
-                ZPOS64_T relativeOffset;
+    ZPOS64_T uReadPos;
+    uLong uReadSize;
+    uLong uMaxBack = SIZEENDOFCENTRALDIR+0xffff+SIZEZIP64LOCATOR; /* maximum size of the tail */
+    long lPos;
+    const unsigned char* p;
 
     if (ZSEEK64(*pzlib_filefunc_def,filestream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
-        return 0;
-
-
+        return UNZ_ERRNO;
     uSizeFile = ZTELL64(*pzlib_filefunc_def,filestream);
+    if (uSizeFile==(ZPOS64_T)-1)
+        return UNZ_ERRNO;
 
-    if (uMaxBack>uSizeFile)
-        uMaxBack = uSizeFile;
+    uReadSize = (uSizeFile<uMaxBack) ? (uLong)uSizeFile : uMaxBack;
+    uReadPos = uSizeFile-uReadSize;
+    if (uReadSize<SIZEENDOFCENTRALDIR)
+        return UNZ_ERRNO;
 
-    buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
+    buf = (unsigned char*)call_zalloc_mem(pallocator,uReadSize);
     if (buf==NULL)
-        return 0;
+        return UNZ_INTERNALERROR;
+    if ((ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0) ||
+        (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize))
+    {
+        call_zfree_mem(pallocator,buf);
+        return UNZ_ERRNO;
+    }
 
-    uBackRead = 4;
-    while (uBackRead<uMaxBack)
+    lPos = unz64local_FindEndOfCentralDir(buf,uReadSize);
+    if (lPos<0)
     {
-        uLong uReadSize;
-        ZPOS64_T uReadPos;
-        int i;
-        if (uBackRead+BUFREADCOMMENT>uMaxBack)
-            uBackRead = uMaxBack;
-        else
-            uBackRead+=BUFREADCOMMENT;
-        uReadPos = uSizeFile-uBackRead ;
+        call_zfree_mem(pallocator,buf);
+        return UNZ_ERRNO;
+    }
 
-        uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
-                     (BUFREADCOMMENT+4) : (uLong)(uSizeFile-uReadPos);
-        if (ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            break;
+    if ((lPos<SIZEZIP64LOCATOR) ||
+        (!unz64local_ReadZip64EndOfCentralDir(pzlib_filefunc_def,filestream,buf,uReadPos,uReadSize,
+                                              lPos-SIZEZIP64LOCATOR,pend)))
+    {
+        p = buf+lPos;
+        pend->central_pos = uReadPos+lPos;
+        pend->isZip64 = 0;
+        pend->number_disk = unz64local_getShortFromBuffer(p+4);
+        pend->number_disk_with_CD = unz64local_getShortFromBuffer(p+6);
+        pend->number_entry = unz64local_getShortFromBuffer(p+8);
+        pend->number_entry_CD = unz64local_getShortFromBuffer(p+10);
+        pend->size_central_dir = unz64local_getLongFromBuffer(p+12);
+        pend->offset_central_dir = unz64local_getLongFromBuffer(p+16);
+        pend->size_comment = unz64local_getShortFromBuffer(p+20);
+    }
+    call_zfree_mem(pallocator,buf);
 
-        if (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
-            break;
+    if ((pend->number_entry_CD!=pend->number_entry) ||
+        (pend->number_disk_with_CD!=0) ||
+        (pend->number_disk!=0))
+        return UNZ_BADZIPFILE;
+    if (pend->central_pos<pend->offset_central_dir+pend->size_central_dir)
+        return UNZ_BADZIPFILE;
+    return UNZ_OK;
+}
 
-        for (i=(int)uReadSize-3; (i--)>0;)
-            if (((*(buf+i))==0x50) && ((*(buf+i+1))==0x4b) &&
-                ((*(buf+i+2))==0x06) && ((*(buf+i+3))==0x07))
-            {
-                uPosFound = uReadPos+i;
-                break;
-            }
+/*
+  Read the whole central directory of a zipfile in memory with a single read,
+    so that browsing the directory does not need any further I/O.
+  return NULL if the central directory cannot be read
+*/
+local unz64_central_dir* unz64local_LoadCentralDir OF((
+    const zlib_filefunc64_32_def* pzlib_filefunc_def,
+    const zlib_allocator_def* pallocator,
+    voidpf filestream,
+    ZPOS64_T offset_central_dir,
+    ZPOS64_T size_central_dir));
+
+local unz64_central_dir* unz64local_LoadCentralDir(const zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                                   const zlib_allocator_def* pallocator,
+                                                   voidpf filestream,
+                                                   ZPOS64_T offset_central_dir,
+                                                   ZPOS64_T size_central_dir)
+{
+    unz64_central_dir* central_dir;
 
-        if (uPosFound!=0)
-            break;
+    /* the central directory must be addressable in memory */
+    if ((ZPOS64_T)(size_t)size_central_dir != size_central_dir ||
+        (ZPOS64_T)(uLong)size_central_dir != size_central_dir)
+        return NULL;
+
+    central_dir = (unz64_central_dir*)call_zalloc_mem(pallocator,sizeof(unz64_central_dir));
+    if (central_dir==NULL)
+        return NULL;
+
+    central_dir->size = size_central_dir;
+    central_dir->data = NULL;
+    central_dir->refcount = 1;
+    if (size_central_dir==0)
+        return central_dir;
+
+    central_dir->data = (unsigned char*)call_zalloc_mem(pallocator,(size_t)size_central_dir);
+    if (central_dir->data==NULL)
+    {
+        call_zfree_mem(pallocator,central_dir);
+        return NULL;
     }
-    TRYFREE(buf);
-    if (uPosFound == 0)
-        return 0;
 
-    /* Zip64 end of central directory locator */
-    if (ZSEEK64(*pzlib_filefunc_def,filestream, uPosFound,ZLIB_FILEFUNC_SEEK_SET)!=0)
-        return 0;
+    if ((ZSEEK64(*pzlib_filefunc_def,filestream,offset_central_dir,ZLIB_FILEFUNC_SEEK_SET)!=0) ||
+        (ZREAD64(*pzlib_filefunc_def,filestream,central_dir->data,(uLong)size_central_dir)!=size_central_dir))
+    {
+        call_zfree_mem(pallocator,central_dir->data);
+        call_zfree_mem(pallocator,central_dir);
+        return NULL;
+    }
+    return central_dir;
+}
 
-    /* the signature, already checked */
-    if (unz64local_getLong(pzlib_filefunc_def,filestream,&uL)!=UNZ_OK)
-        return 0;
+local void unz64local_FreeCentralDir(const zlib_allocator_def* pallocator, unz64_central_dir* central_dir)
+{
+    if (central_dir==NULL)
+        return;
+    if (UNZ_ATOMIC_DECREMENT(&central_dir->refcount)!=0)
+        return;
+    call_zfree_mem(pallocator,central_dir->data);
+    call_zfree_mem(pallocator,central_dir);
+}
 
-    /* number of the disk with the start of the zip64 end of  central directory */
-    if (unz64local_getLong(pzlib_filefunc_def,filestream,&uL)!=UNZ_OK)
-        return 0;
-    if (uL != 0)
-        return 0;
+local void unz64local_FreeNameIndex(const zlib_allocator_def* pallocator, unz64_name_index* name_index)
+{
+    if (name_index==NULL)
+        return;
+    if (UNZ_ATOMIC_DECREMENT(&name_index->refcount)!=0)
+        return;
+    call_zfree_mem(pallocator,name_index->entries);
+    call_zfree_mem(pallocator,name_index);
+}
 
-    /* relative offset of the zip64 end of central directory record */
-    if (unz64local_getLong64(pzlib_filefunc_def,filestream,&relativeOffset)!=UNZ_OK)
-        return 0;
+/*
+  Length of a filename of the central directory (not zero terminated):
+    a zero ends it, as for a C string
+*/
+local uLong unz64local_FileNameLength(const unsigned char* name, uLong size_name)
+{
+    const unsigned char* end = (const unsigned char*)memchr(name,0,size_name);
+    if (end!=NULL)
+        return (uLong)(end-name);
+    return size_name;
+}
 
-    /* total number of disks */
-    if (unz64local_getLong(pzlib_filefunc_def,filestream,&uL)!=UNZ_OK)
-        return 0;
-    if (uL != 1)
-        return 0;
+/*
+  Hash a filename, ascii letters folded to upper case so that the same
+    value serves both the case sensitive and the case insensitive lookup
+*/
+local uLong unz64local_HashFileName(const unsigned char* name, uLong size_name)
+{
+    uLong hash = 2166136261UL;
+    uLong i;
+    for (i=0;i<size_name;i++)
+    {
+        unsigned char c = name[i];
+        if ((c>='a') && (c<='z'))
+            c -= 0x20;
+        hash = ((hash ^ c) * 16777619UL) & 0xffffffffUL;
+    }
+    return hash;
+}
 
-    /* Goto end of central directory record */
-    if (ZSEEK64(*pzlib_filefunc_def,filestream, relativeOffset,ZLIB_FILEFUNC_SEEK_SET)!=0)
-        return 0;
+/*
+  Compare a filename of the central directory (not zero terminated) with
+    szFileName, using the same rules as unzStringFileNameCompare
+  return 1 if they are equal
+*/
+local int unz64local_FileNameMatch(const unsigned char* name, uLong size_name,
+                                   const char* szFileName, uLong size_szFileName,
+                                   int iCaseSensitivity)
+{
+    uLong i;
 
-     /* the signature */
-    if (unz64local_getLong(pzlib_filefunc_def,filestream,&uL)!=UNZ_OK)
+    size_name = unz64local_FileNameLength(name,size_name);
+    if (size_name!=size_szFileName)
         return 0;
 
-    if (uL != 0x06064b50)
-        return 0;
+    if (iCaseSensitivity==0)
+        iCaseSensitivity=CASESENSITIVITYDEFAULTVALUE;
 
-    return relativeOffset;
+    if (iCaseSensitivity==1)
+        return memcmp(name,szFileName,size_name)==0;
+
+    for (i=0;i<size_name;i++)
+    {
+        unsigned char c1 = name[i];
+        unsigned char c2 = (unsigned char)szFileName[i];
+        if ((c1>='a') && (c1<='z'))
+            c1 -= 0x20;
+        if ((c2>='a') && (c2<='z'))
+            c2 -= 0x20;
+        if (c1!=c2)
+            return 0;
+    }
+    return 1;
 }
 
 /*
@@ -583,25 +783,26 @@ local ZPOS64_T unz64local_SearchCentralDir64(const zlib_filefunc64_32_def* pzlib
 */
 local unzFile unzOpenInternal (const void *path,
                                zlib_filefunc64_32_def* pzlib_filefunc64_32_def,
-                               int is64bitOpenFunction)
+                               int is64bitOpenFunction,
+                               const unz_open_options* options)
 {
     unz64_s us;
     unz64_s *s;
     ZPOS64_T central_pos;
-    uLong   uL;
-
-    uLong number_disk;          /* number of the current dist, used for
-                                   spaning ZIP, unsupported, always 0*/
-    uLong number_disk_with_CD;  /* number the the disk with central dir, used
-                                   for spaning ZIP, unsupported, always 0*/
-    ZPOS64_T number_entry_CD;      /* total number of entries in
-                                   the central dir
-                                   (same than number_entry on nospan) */
+    unz64_end_of_central_dir end_of_central_dir;
 
     int err=UNZ_OK;
 
+    if ((options!=NULL) && (options->allocator!=NULL))
+        us.allocator = *options->allocator;
+    else
+        fill_malloc_allocator(&us.allocator);
+
     if (unz_copyright[0]!=' ')
+    {
+        call_zrelease_mem(&us.allocator);
         return NULL;
+    }
 
     us.z_filefunc.zseek32_file = NULL;
     us.z_filefunc.ztell32_file = NULL;
@@ -618,146 +819,65 @@ local unzFile unzOpenInternal (const void *path,
                                                  ZLIB_FILEFUNC_MODE_READ |
                                                  ZLIB_FILEFUNC_MODE_EXISTING);
     if (us.filestream==NULL)
-        return NULL;
-
-    central_pos = unz64local_SearchCentralDir64(&us.z_filefunc,us.filestream);
-    if (central_pos)
-    {
-        uLong uS;
-        ZPOS64_T uL64;
-
-        us.isZip64 = 1;
-
-        if (ZSEEK64(us.z_filefunc, us.filestream,
-                                      central_pos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-        err=UNZ_ERRNO;
-
-        /* the signature, already checked */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* size of zip64 end of central directory record */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&uL64)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* version made by */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&uS)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* version needed to extract */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&uS)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* number of this disk */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&number_disk)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* number of the disk with the start of the central directory */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&number_disk_with_CD)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* total number of entries in the central directory on this disk */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&us.gi.number_entry)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* total number of entries in the central directory */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&number_entry_CD)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        if ((number_entry_CD!=us.gi.number_entry) ||
-            (number_disk_with_CD!=0) ||
-            (number_disk!=0))
-            err=UNZ_BADZIPFILE;
-
-        /* size of the central directory */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&us.size_central_dir)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* offset of start of central directory with respect to the
-          starting disk number */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&us.offset_central_dir)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        us.gi.size_comment = 0;
-    }
-    else
     {
-        central_pos = unz64local_SearchCentralDir(&us.z_filefunc,us.filestream);
-        if (central_pos==0)
-            err=UNZ_ERRNO;
-
-        us.isZip64 = 0;
-
-        if (ZSEEK64(us.z_filefunc, us.filestream,
-                                        central_pos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            err=UNZ_ERRNO;
-
-        /* the signature, already checked */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* number of this disk */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&number_disk)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* number of the disk with the start of the central directory */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&number_disk_with_CD)!=UNZ_OK)
-            err=UNZ_ERRNO;
-
-        /* total number of entries in the central dir on this disk */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
-            err=UNZ_ERRNO;
-        us.gi.number_entry = uL;
-
-        /* total number of entries in the central dir */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
-            err=UNZ_ERRNO;
-        number_entry_CD = uL;
-
-        if ((number_entry_CD!=us.gi.number_entry) ||
-            (number_disk_with_CD!=0) ||
-            (number_disk!=0))
-            err=UNZ_BADZIPFILE;
-
-        /* size of the central directory */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
-            err=UNZ_ERRNO;
-        us.size_central_dir = uL;
-
-        /* offset of start of central directory with respect to the
-            starting disk number */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
-            err=UNZ_ERRNO;
-        us.offset_central_dir = uL;
-
-        /* zipfile comment length */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&us.gi.size_comment)!=UNZ_OK)
-            err=UNZ_ERRNO;
+        call_zrelease_mem(&us.allocator);
+        return NULL;
     }
 
-    if ((central_pos<us.offset_central_dir+us.size_central_dir) &&
-        (err==UNZ_OK))
-        err=UNZ_BADZIPFILE;
-
+    err = unz64local_ReadEndOfCentralDir(&us.z_filefunc,&us.allocator,us.filestream,&end_of_central_dir);
     if (err!=UNZ_OK)
     {
         ZCLOSE64(us.z_filefunc, us.filestream);
+        call_zrelease_mem(&us.allocator);
         return NULL;
     }
 
+    central_pos = end_of_central_dir.central_pos;
+    us.isZip64 = end_of_central_dir.isZip64;
+    us.gi.number_entry = end_of_central_dir.number_entry;
+    us.gi.size_comment = end_of_central_dir.size_comment;
+    us.size_central_dir = end_of_central_dir.size_central_dir;
+    us.offset_central_dir = end_of_central_dir.offset_central_dir;
+
     us.byte_before_the_zipfile = central_pos -
                             (us.offset_central_dir+us.size_central_dir);
     us.central_pos = central_pos;
     us.pfile_in_zip_read = NULL;
+    us.pfile_in_zip_read_spare = NULL;
     us.encrypted = 0;
+    us.name_index = NULL;
+    us.stream_pos = UNZ_STREAM_POS_UNKNOWN;
+
+    us.read_buffer_size = UNZ_BUFSIZE;
+    if ((options!=NULL) && (options->read_buffer_size>0))
+        us.read_buffer_size = options->read_buffer_size;
+    if (us.read_buffer_size > (uLong)(uInt)-1)
+        us.read_buffer_size = (uLong)(uInt)-1;
+    us.seek_index_span = (options!=NULL) ? options->seek_index_span : 0;
+    us.read_ahead_depth = (options!=NULL) ? options->read_ahead_depth : 0;
+
+    us.central_dir = unz64local_LoadCentralDir(&us.z_filefunc, &us.allocator, us.filestream,
+                                               us.offset_central_dir+us.byte_before_the_zipfile,
+                                               us.size_central_dir);
+    if (us.central_dir==NULL)
+    {
+        ZCLOSE64(us.z_filefunc, us.filestream);
+        call_zrelease_mem(&us.allocator);
+        return NULL;
+    }
 
-
-    s=(unz64_s*)ALLOC(sizeof(unz64_s));
+    s=(unz64_s*)call_zalloc_mem(&us.allocator,sizeof(unz64_s));
     if( s != NULL)
     {
         *s=us;
         unzGoToFirstFile((unzFile)s);
     }
+    else
+    {
+        unz64local_FreeCentralDir(&us.allocator,us.central_dir);
+        ZCLOSE64(us.z_filefunc, us.filestream);
+        call_zrelease_mem(&us.allocator);
+    }
     return (unzFile)s;
 }
 
@@ -769,10 +889,10 @@ extern unzFile ZEXPORT unzOpen2 (const char *path,
     {
         zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
         fill_zlib_filefunc64_32_def_from_filefunc32(&zlib_filefunc64_32_def_fill,pzlib_filefunc32_def);
-        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 0);
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 0, NULL);
     }
     else
-        return unzOpenInternal(path, NULL, 0);
+        return unzOpenInternal(path, NULL, 0, NULL);
 }
 
 extern unzFile ZEXPORT unzOpen2_64 (const void *path,
@@ -784,20 +904,92 @@ extern unzFile ZEXPORT unzOpen2_64 (const void *path,
         zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
         zlib_filefunc64_32_def_fill.ztell32_file = NULL;
         zlib_filefunc64_32_def_fill.zseek32_file = NULL;
-        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 1);
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 1, NULL);
     }
     else
-        return unzOpenInternal(path, NULL, 1);
-}
-
-extern unzFile ZEXPORT unzOpen (const char *path)
-{
-    return unzOpenInternal(path, NULL, 0);
+        return unzOpenInternal(path, NULL, 1, NULL);
 }
 
-extern unzFile ZEXPORT unzOpen64 (const void *path)
+extern unzFile ZEXPORT unzOpen3 (const void *path,
+                                  zlib_filefunc64_def* pzlib_filefunc_def,
+                                  const unz_open_options* options)
 {
-    return unzOpenInternal(path, NULL, 1);
+    if (pzlib_filefunc_def != NULL)
+    {
+        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
+        zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
+        zlib_filefunc64_32_def_fill.ztell32_file = NULL;
+        zlib_filefunc64_32_def_fill.zseek32_file = NULL;
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 1, options);
+    }
+    else
+        return unzOpenInternal(path, NULL, 1, options);
+}
+
+/*
+  Open a new handle on a zipfile already opened, sharing its central directory
+    and its filename index. The new handle has its own stream and its own
+    current file, so that each handle can be used by a different thread.
+*/
+extern unzFile ZEXPORT unzOpenClone (unzFile file)
+{
+    unz64_s* s;
+    unz64_s* clone;
+    voidpf filestream;
+
+    if (file==NULL)
+        return NULL;
+    s=(unz64_s*)file;
+
+    /* the memory of an allocator released at close (an arena) belongs to one handle */
+    if (s->allocator.zrelease_mem!=NULL)
+        return NULL;
+
+    filestream = call_zdup64(&s->z_filefunc,s->filestream);
+    if (filestream==NULL)
+        return NULL;
+
+    clone=(unz64_s*)call_zalloc_mem(&s->allocator,sizeof(unz64_s));
+    if (clone==NULL)
+    {
+        ZCLOSE64(s->z_filefunc, filestream);
+        return NULL;
+    }
+
+    *clone=*s;
+    clone->filestream = filestream;
+    clone->pfile_in_zip_read = NULL;
+    clone->pfile_in_zip_read_spare = NULL;
+    clone->encrypted = 0;
+    clone->stream_pos = UNZ_STREAM_POS_UNKNOWN;
+
+    UNZ_ATOMIC_INCREMENT(&clone->central_dir->refcount);
+    if (clone->name_index!=NULL)
+        UNZ_ATOMIC_INCREMENT(&clone->name_index->refcount);
+
+    unzGoToFirstFile((unzFile)clone);
+    return (unzFile)clone;
+}
+
+extern unzFile ZEXPORT unzOpen (const char *path)
+{
+    return unzOpenInternal(path, NULL, 0, NULL);
+}
+
+extern unzFile ZEXPORT unzOpen64 (const void *path)
+{
+    return unzOpenInternal(path, NULL, 1, NULL);
+}
+
+local void unz64local_FreeReadInfo (const zlib_allocator_def* pallocator,
+                                    file_in_zip64_read_info_s* pfile_in_zip_read_info)
+{
+    if (pfile_in_zip_read_info==NULL)
+        return;
+    if (pfile_in_zip_read_info->inflate_allocated)
+        inflateEnd(&pfile_in_zip_read_info->stream);
+    call_zfree_mem(pallocator,pfile_in_zip_read_info->read_buffer);
+    call_zfree_mem(pallocator,pfile_in_zip_read_info);
 }
 
 /*
@@ -808,6 +1000,7 @@ extern unzFile ZEXPORT unzOpen64 (const void *path)
 extern int ZEXPORT unzClose (unzFile file)
 {
     unz64_s* s;
+    zlib_allocator_def allocator;
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz64_s*)file;
@@ -815,8 +1008,13 @@ extern int ZEXPORT unzClose (unzFile file)
     if (s->pfile_in_zip_read!=NULL)
         unzCloseCurrentFile(file);
 
+    allocator = s->allocator;
+    unz64local_FreeReadInfo(&allocator,s->pfile_in_zip_read_spare);
     ZCLOSE64(s->z_filefunc, s->filestream);
-    TRYFREE(s);
+    unz64local_FreeNameIndex(&allocator,s->name_index);
+    unz64local_FreeCentralDir(&allocator,s->central_dir);
+    call_zfree_mem(&allocator,s);
+    call_zrelease_mem(&allocator);
     return UNZ_OK;
 }
 
@@ -865,6 +1063,52 @@ local void unz64local_DosDateToTmuDate (ZPOS64_T ulDosDate, tm_unz* ptm)
 /*
   Get Info about the current file in the zipfile, with internal only info
 */
+/*
+  Read the 64 bits values of the ZIP64 extra field of a central directory record,
+    for the values set to 0xffffffff in the record
+*/
+local void unz64local_ReadZip64ExtraField(const unsigned char* p, uLong size_file_extra,
+                                          ZPOS64_T* puncompressed_size,
+                                          ZPOS64_T* pcompressed_size,
+                                          ZPOS64_T* poffset_curfile)
+{
+    const unsigned char* extra = p;
+    while (extra+4 <= p+size_file_extra)
+    {
+        uLong headerId = unz64local_getShortFromBuffer(extra);
+        uLong dataSize = unz64local_getShortFromBuffer(extra+2);
+        const unsigned char* data = extra+4;
+        const unsigned char* data_end = data+dataSize;
+
+        if (data_end > p+size_file_extra)
+            break;
+
+        /* ZIP64 extra fields */
+        if (headerId == 0x0001)
+        {
+            if ((*puncompressed_size == (ZPOS64_T)(unsigned long)-1) && (data+8 <= data_end))
+            {
+                *puncompressed_size = unz64local_getLong64FromBuffer(data);
+                data += 8;
+            }
+
+            if ((*pcompressed_size == (ZPOS64_T)(unsigned long)-1) && (data+8 <= data_end))
+            {
+                *pcompressed_size = unz64local_getLong64FromBuffer(data);
+                data += 8;
+            }
+
+            if ((*poffset_curfile == (ZPOS64_T)(unsigned long)-1) && (data+8 <= data_end))
+            {
+                /* Relative Header offset */
+                *poffset_curfile = unz64local_getLong64FromBuffer(data);
+            }
+        }
+
+        extra = data_end;
+    }
+}
+
 local int unz64local_GetCurrentFileInfoInternal OF((unzFile file,
                                                   unz_file_info64 *pfile_info,
                                                   unz_file_info64_internal
@@ -890,82 +1134,52 @@ local int unz64local_GetCurrentFileInfoInternal (unzFile file,
     unz64_s* s;
     unz_file_info64 file_info;
     unz_file_info64_internal file_info_internal;
-    int err=UNZ_OK;
-    uLong uMagic;
-    long lSeek=0;
-    uLong uL;
+    const unsigned char* p;
+    ZPOS64_T pos;
 
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz64_s*)file;
-    if (ZSEEK64(s->z_filefunc, s->filestream,
-              s->pos_in_central_dir+s->byte_before_the_zipfile,
-              ZLIB_FILEFUNC_SEEK_SET)!=0)
-        err=UNZ_ERRNO;
 
+    /* the record is decoded from the central directory cached in memory */
+    if (s->pos_in_central_dir<s->offset_central_dir)
+        return UNZ_BADZIPFILE;
+    pos = s->pos_in_central_dir - s->offset_central_dir;
+    if ((pos>s->central_dir->size) || (s->central_dir->size-pos<SIZECENTRALDIRITEM))
+        return UNZ_BADZIPFILE;
+    p = s->central_dir->data + pos;
 
     /* we check the magic */
-    if (err==UNZ_OK)
-    {
-        if (unz64local_getLong(&s->z_filefunc, s->filestream,&uMagic) != UNZ_OK)
-            err=UNZ_ERRNO;
-        else if (uMagic!=0x02014b50)
-            err=UNZ_BADZIPFILE;
-    }
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.version) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.version_needed) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.flag) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.compression_method) != UNZ_OK)
-        err=UNZ_ERRNO;
+    if (unz64local_getLongFromBuffer(p)!=0x02014b50)
+        return UNZ_BADZIPFILE;
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&file_info.dosDate) != UNZ_OK)
-        err=UNZ_ERRNO;
+    file_info.version = unz64local_getShortFromBuffer(p+4);
+    file_info.version_needed = unz64local_getShortFromBuffer(p+6);
+    file_info.flag = unz64local_getShortFromBuffer(p+8);
+    file_info.compression_method = unz64local_getShortFromBuffer(p+10);
+    file_info.dosDate = unz64local_getLongFromBuffer(p+12);
 
     unz64local_DosDateToTmuDate(file_info.dosDate,&file_info.tmu_date);
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&file_info.crc) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uL) != UNZ_OK)
-        err=UNZ_ERRNO;
-    file_info.compressed_size = uL;
-
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uL) != UNZ_OK)
-        err=UNZ_ERRNO;
-    file_info.uncompressed_size = uL;
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.size_filename) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.size_file_extra) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.size_file_comment) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.disk_num_start) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.internal_fa) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&file_info.external_fa) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-                // relative offset of local header
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uL) != UNZ_OK)
-        err=UNZ_ERRNO;
-    file_info_internal.offset_curfile = uL;
+    file_info.crc = unz64local_getLongFromBuffer(p+16);
+    file_info.compressed_size = unz64local_getLongFromBuffer(p+20);
+    file_info.uncompressed_size = unz64local_getLongFromBuffer(p+24);
+    file_info.size_filename = unz64local_getShortFromBuffer(p+28);
+    file_info.size_file_extra = unz64local_getShortFromBuffer(p+30);
+    file_info.size_file_comment = unz64local_getShortFromBuffer(p+32);
+    file_info.disk_num_start = unz64local_getShortFromBuffer(p+34);
+    file_info.internal_fa = unz64local_getShortFromBuffer(p+36);
+    file_info.external_fa = unz64local_getLongFromBuffer(p+38);
+
+    // relative offset of local header
+    file_info_internal.offset_curfile = unz64local_getLongFromBuffer(p+42);
+
+    if (s->central_dir->size-pos-SIZECENTRALDIRITEM <
+        file_info.size_filename+file_info.size_file_extra+file_info.size_file_comment)
+        return UNZ_BADZIPFILE;
+    p += SIZECENTRALDIRITEM;
 
-    lSeek+=file_info.size_filename;
-    if ((err==UNZ_OK) && (szFileName!=NULL))
+    if (szFileName!=NULL)
     {
         uLong uSizeRead ;
         if (file_info.size_filename<fileNameBufferSize)
@@ -977,107 +1191,30 @@ local int unz64local_GetCurrentFileInfoInternal (unzFile file,
             uSizeRead = fileNameBufferSize;
 
         if ((file_info.size_filename>0) && (fileNameBufferSize>0))
-            if (ZREAD64(s->z_filefunc, s->filestream,szFileName,uSizeRead)!=uSizeRead)
-                err=UNZ_ERRNO;
-        lSeek -= uSizeRead;
+            memcpy(szFileName,p,uSizeRead);
     }
+    p += file_info.size_filename;
 
     // Read extrafield
-    if ((err==UNZ_OK) && (extraField!=NULL))
+    if (extraField!=NULL)
     {
-        ZPOS64_T uSizeRead ;
+        uLong uSizeRead ;
         if (file_info.size_file_extra<extraFieldBufferSize)
             uSizeRead = file_info.size_file_extra;
         else
             uSizeRead = extraFieldBufferSize;
 
-        if (lSeek!=0)
-        {
-            if (ZSEEK64(s->z_filefunc, s->filestream,lSeek,ZLIB_FILEFUNC_SEEK_CUR)==0)
-                lSeek=0;
-            else
-                err=UNZ_ERRNO;
-        }
-
         if ((file_info.size_file_extra>0) && (extraFieldBufferSize>0))
-            if (ZREAD64(s->z_filefunc, s->filestream,extraField,(uLong)uSizeRead)!=uSizeRead)
-                err=UNZ_ERRNO;
-
-        lSeek += file_info.size_file_extra - (uLong)uSizeRead;
+            memcpy(extraField,p,uSizeRead);
     }
-    else
-        lSeek += file_info.size_file_extra;
-
-
-    if ((err==UNZ_OK) && (file_info.size_file_extra != 0))
-    {
-                                uLong acc = 0;
-
-        // since lSeek now points to after the extra field we need to move back
-        lSeek -= file_info.size_file_extra;
-
-        if (lSeek!=0)
-        {
-            if (ZSEEK64(s->z_filefunc, s->filestream,lSeek,ZLIB_FILEFUNC_SEEK_CUR)==0)
-                lSeek=0;
-            else
-                err=UNZ_ERRNO;
-        }
-
-        while(acc < file_info.size_file_extra)
-        {
-            uLong headerId;
-                                                uLong dataSize;
-
-            if (unz64local_getShort(&s->z_filefunc, s->filestream,&headerId) != UNZ_OK)
-                err=UNZ_ERRNO;
-
-            if (unz64local_getShort(&s->z_filefunc, s->filestream,&dataSize) != UNZ_OK)
-                err=UNZ_ERRNO;
-
-            /* ZIP64 extra fields */
-            if (headerId == 0x0001)
-            {
-                                                        uLong uL;
-
-                                                                if(file_info.uncompressed_size == (ZPOS64_T)(unsigned long)-1)
-                                                                {
-                                                                        if (unz64local_getLong64(&s->z_filefunc, s->filestream,&file_info.uncompressed_size) != UNZ_OK)
-                                                                                        err=UNZ_ERRNO;
-                                                                }
-
-                                                                if(file_info.compressed_size == (ZPOS64_T)(unsigned long)-1)
-                                                                {
-                                                                        if (unz64local_getLong64(&s->z_filefunc, s->filestream,&file_info.compressed_size) != UNZ_OK)
-                                                                                  err=UNZ_ERRNO;
-                                                                }
-
-                                                                if(file_info_internal.offset_curfile == (ZPOS64_T)(unsigned long)-1)
-                                                                {
-                                                                        /* Relative Header offset */
-                                                                        if (unz64local_getLong64(&s->z_filefunc, s->filestream,&file_info_internal.offset_curfile) != UNZ_OK)
-                                                                                err=UNZ_ERRNO;
-                                                                }
-
-                                                                if(file_info.disk_num_start == (unsigned long)-1)
-                                                                {
-                                                                        /* Disk Start Number */
-                                                                        if (unz64local_getLong(&s->z_filefunc, s->filestream,&uL) != UNZ_OK)
-                                                                                err=UNZ_ERRNO;
-                                                                }
-
-            }
-            else
-            {
-                if (ZSEEK64(s->z_filefunc, s->filestream,dataSize,ZLIB_FILEFUNC_SEEK_CUR)!=0)
-                    err=UNZ_ERRNO;
-            }
 
-            acc += 2 + 2 + dataSize;
-        }
-    }
+    unz64local_ReadZip64ExtraField(p,file_info.size_file_extra,
+                                   &file_info.uncompressed_size,
+                                   &file_info.compressed_size,
+                                   &file_info_internal.offset_curfile);
+    p += file_info.size_file_extra;
 
-    if ((err==UNZ_OK) && (szComment!=NULL))
+    if (szComment!=NULL)
     {
         uLong uSizeRead ;
         if (file_info.size_file_comment<commentBufferSize)
@@ -1088,38 +1225,17 @@ local int unz64local_GetCurrentFileInfoInternal (unzFile file,
         else
             uSizeRead = commentBufferSize;
 
-        if (lSeek!=0)
-        {
-            if (ZSEEK64(s->z_filefunc, s->filestream,lSeek,ZLIB_FILEFUNC_SEEK_CUR)==0)
-			{
-#ifndef __clang_analyzer__
-                lSeek=0;
-#endif
-			}
-            else
-                err=UNZ_ERRNO;
-        }
-
         if ((file_info.size_file_comment>0) && (commentBufferSize>0))
-            if (ZREAD64(s->z_filefunc, s->filestream,szComment,uSizeRead)!=uSizeRead)
-                err=UNZ_ERRNO;
-#ifndef __clang_analyzer__
-        lSeek+=file_info.size_file_comment - uSizeRead;
-#endif
+            memcpy(szComment,p,uSizeRead);
     }
-#ifndef __clang_analyzer__
-    else
-        lSeek+=file_info.size_file_comment;
-#endif
 
-
-    if ((err==UNZ_OK) && (pfile_info!=NULL))
+    if (pfile_info!=NULL)
         *pfile_info=file_info;
 
-    if ((err==UNZ_OK) && (pfile_info_internal!=NULL))
+    if (pfile_info_internal!=NULL)
         *pfile_info_internal=file_info_internal;
 
-    return err;
+    return UNZ_OK;
 }
 
 
@@ -1230,131 +1346,530 @@ extern int ZEXPORT unzGoToNextFile (unzFile  file)
 
 
 /*
-  Try locate the file szFileName in the zipfile.
-  For the iCaseSensitivity signification, see unzipStringFileNameCompare
-
-  return value :
-  UNZ_OK if the file is found. It becomes the current file.
-  UNZ_END_OF_LIST_OF_FILE if the file is not found
+  Build the filename index of the zipfile, a hash table over the cached central
+    directory. Once built, unzLocateFile and unzLocateFiles no longer scan the
+    directory.
+  return UNZ_OK if there is no problem
 */
-extern int ZEXPORT unzLocateFile (unzFile file, const char *szFileName, int iCaseSensitivity)
+extern int ZEXPORT unzBuildFileNameIndex (unzFile file)
 {
     unz64_s* s;
-    int err;
-
-    /* We remember the 'current' position in the file so that we can jump
-     * back there if we fail.
-     */
-    unz_file_info64 cur_file_infoSaved;
-    unz_file_info64_internal cur_file_info_internalSaved;
-    ZPOS64_T num_fileSaved;
-    ZPOS64_T pos_in_central_dirSaved;
-
+    unz64_name_index* name_index;
+    ZPOS64_T max_entries;
+    ZPOS64_T pos;
+    ZPOS64_T num_file;
+    uLong nb_slots;
 
     if (file==NULL)
         return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    if (s->name_index!=NULL)
+        return UNZ_OK;
 
-    if (strlen(szFileName)>=UNZ_MAXFILENAMEINZIP)
-        return UNZ_PARAMERROR;
+    /* each record takes at least SIZECENTRALDIRITEM bytes */
+    max_entries = s->central_dir->size / SIZECENTRALDIRITEM;
+    if ((s->gi.number_entry != 0xffff) && (s->gi.number_entry < max_entries))   /* 2^16 files overflow hack */
+        max_entries = s->gi.number_entry;
 
-    s=(unz64_s*)file;
-    if (!s->current_file_ok)
-        return UNZ_END_OF_LIST_OF_FILE;
+    nb_slots = 16;
+    while ((ZPOS64_T)nb_slots < max_entries*2)
+    {
+        if (nb_slots > ((uLong)-1)/(2*sizeof(unz64_name_index_entry)))
+            return UNZ_INTERNALERROR;
+        nb_slots *= 2;
+    }
 
-    /* Save the current state */
-    num_fileSaved = s->num_file;
-    pos_in_central_dirSaved = s->pos_in_central_dir;
-    cur_file_infoSaved = s->cur_file_info;
-    cur_file_info_internalSaved = s->cur_file_info_internal;
+    name_index = (unz64_name_index*)call_zalloc_mem(&s->allocator,sizeof(unz64_name_index));
+    if (name_index==NULL)
+        return UNZ_INTERNALERROR;
+    name_index->entries = (unz64_name_index_entry*)call_zalloc_mem(&s->allocator,nb_slots*sizeof(unz64_name_index_entry));
+    if (name_index->entries==NULL)
+    {
+        call_zfree_mem(&s->allocator,name_index);
+        return UNZ_INTERNALERROR;
+    }
+    memset(name_index->entries,0,nb_slots*sizeof(unz64_name_index_entry));
+    name_index->mask = nb_slots-1;
+    name_index->refcount = 1;
 
-    err = unzGoToFirstFile(file);
+    pos = 0;
+    for (num_file=0;num_file<max_entries;num_file++)
+    {
+        const unsigned char* p = s->central_dir->data + pos;
+        uLong size_filename, size_file_extra, size_file_comment, size_name, hash, slot;
+
+        if ((s->central_dir->size-pos<SIZECENTRALDIRITEM) ||
+            (unz64local_getLongFromBuffer(p)!=0x02014b50))
+            break;
+        size_filename = unz64local_getShortFromBuffer(p+28);
+        size_file_extra = unz64local_getShortFromBuffer(p+30);
+        size_file_comment = unz64local_getShortFromBuffer(p+32);
+        if (s->central_dir->size-pos-SIZECENTRALDIRITEM <
+            size_filename+size_file_extra+size_file_comment)
+            break;
+
+        /* linear probing keeps the first of duplicated names ahead, as the scan does;
+           the name is hashed up to a zero, the length unz64local_FileNameMatch compares */
+        size_name = unz64local_FileNameLength(p+SIZECENTRALDIRITEM,size_filename);
+        hash = unz64local_HashFileName(p+SIZECENTRALDIRITEM,size_name);
+        slot = hash & name_index->mask;
+        while (name_index->entries[slot].name!=NULL)
+            slot = (slot+1) & name_index->mask;
+
+        name_index->entries[slot].name = p+SIZECENTRALDIRITEM;
+        name_index->entries[slot].size_name = size_name;
+        name_index->entries[slot].hash = hash;
+        name_index->entries[slot].pos_in_zip_directory = s->offset_central_dir + pos;
+        name_index->entries[slot].num_of_file = num_file;
+
+        pos += SIZECENTRALDIRITEM + size_filename + size_file_extra + size_file_comment;
+    }
+
+    s->name_index = name_index;
+    return UNZ_OK;
+}
+
+/*
+  Find szFileName in the zipfile without changing the current file.
+  return UNZ_OK and fill *file_pos if the file is found
+  return UNZ_END_OF_LIST_OF_FILE if the file is not found
+*/
+local int unz64local_FindFile (unz64_s* s, const char *szFileName, int iCaseSensitivity,
+                               unz64_file_pos* file_pos)
+{
+    uLong size_szFileName = (uLong)strlen(szFileName);
+    ZPOS64_T pos;
+    ZPOS64_T num_file;
 
-    while (err == UNZ_OK)
+    if (s->name_index!=NULL)
     {
-        char szCurrentFileName[UNZ_MAXFILENAMEINZIP+1];
-        err = unzGetCurrentFileInfo64(file,NULL,
-                                    szCurrentFileName,sizeof(szCurrentFileName)-1,
-                                    NULL,0,NULL,0);
-        if (err == UNZ_OK)
+        const unz64_name_index* name_index = s->name_index;
+        uLong hash = unz64local_HashFileName((const unsigned char*)szFileName,size_szFileName);
+        uLong slot = hash & name_index->mask;
+
+        while (name_index->entries[slot].name!=NULL)
         {
-            if (unzStringFileNameCompare(szCurrentFileName,
-                                            szFileName,iCaseSensitivity)==0)
+            const unz64_name_index_entry* entry = &name_index->entries[slot];
+            if ((entry->hash==hash) &&
+                unz64local_FileNameMatch(entry->name,entry->size_name,
+                                         szFileName,size_szFileName,iCaseSensitivity))
+            {
+                file_pos->pos_in_zip_directory = entry->pos_in_zip_directory;
+                file_pos->num_of_file = entry->num_of_file;
                 return UNZ_OK;
-            err = unzGoToNextFile(file);
+            }
+            slot = (slot+1) & name_index->mask;
         }
+        return UNZ_END_OF_LIST_OF_FILE;
     }
 
-    /* We failed, so restore the state of the 'current file' to where we
-     * were.
-     */
-    s->num_file = num_fileSaved ;
-    s->pos_in_central_dir = pos_in_central_dirSaved ;
-    s->cur_file_info = cur_file_infoSaved;
-    s->cur_file_info_internal = cur_file_info_internalSaved;
-    return err;
-}
+    /* no index, scan the cached central directory */
+    pos = 0;
+    for (num_file=0;;num_file++)
+    {
+        const unsigned char* p = s->central_dir->data + pos;
+        uLong size_filename;
 
+        if (s->gi.number_entry != 0xffff)    /* 2^16 files overflow hack */
+            if (num_file==s->gi.number_entry)
+                break;
+        if ((s->central_dir->size-pos<SIZECENTRALDIRITEM) ||
+            (unz64local_getLongFromBuffer(p)!=0x02014b50))
+            break;
 
-/*
-///////////////////////////////////////////
-// Contributed by Ryan Haksi (mailto://cryogen@infoserve.net)
-// I need random access
-//
-// Further optimization could be realized by adding an ability
-// to cache the directory in memory. The goal being a single
-// comprehensive file read to put the file I need in a memory.
-*/
+        size_filename = unz64local_getShortFromBuffer(p+28);
+        if (s->central_dir->size-pos-SIZECENTRALDIRITEM < size_filename)
+            break;
+        if (unz64local_FileNameMatch(p+SIZECENTRALDIRITEM,size_filename,
+                                     szFileName,size_szFileName,iCaseSensitivity))
+        {
+            file_pos->pos_in_zip_directory = s->offset_central_dir + pos;
+            file_pos->num_of_file = num_file;
+            return UNZ_OK;
+        }
+
+        pos += SIZECENTRALDIRITEM + size_filename +
+               unz64local_getShortFromBuffer(p+30) + unz64local_getShortFromBuffer(p+32);
+    }
+    return UNZ_END_OF_LIST_OF_FILE;
+}
 
 /*
-typedef struct unz_file_pos_s
-{
-    ZPOS64_T pos_in_zip_directory;   // offset in file
-    ZPOS64_T num_of_file;            // # of file
-} unz_file_pos;
-*/
+  Try locate the file szFileName in the zipfile.
+  For the iCaseSensitivity signification, see unzipStringFileNameCompare
 
-extern int ZEXPORT unzGetFilePos64(unzFile file, unz64_file_pos*  file_pos)
+  return value :
+  UNZ_OK if the file is found. It becomes the current file.
+  UNZ_END_OF_LIST_OF_FILE if the file is not found
+*/
+extern int ZEXPORT unzLocateFile (unzFile file, const char *szFileName, int iCaseSensitivity)
 {
     unz64_s* s;
+    unz64_file_pos file_pos;
+    int err;
 
-    if (file==NULL || file_pos==NULL)
+    if (file==NULL || szFileName==NULL)
         return UNZ_PARAMERROR;
+
     s=(unz64_s*)file;
     if (!s->current_file_ok)
         return UNZ_END_OF_LIST_OF_FILE;
 
-    file_pos->pos_in_zip_directory  = s->pos_in_central_dir;
-    file_pos->num_of_file           = s->num_file;
-
-    return UNZ_OK;
-}
-
-extern int ZEXPORT unzGetFilePos(
-    unzFile file,
-    unz_file_pos* file_pos)
-{
-    unz64_file_pos file_pos64;
-    int err = unzGetFilePos64(file,&file_pos64);
-    if (err==UNZ_OK)
-    {
-        file_pos->pos_in_zip_directory = (uLong)file_pos64.pos_in_zip_directory;
-        file_pos->num_of_file = (uLong)file_pos64.num_of_file;
-    }
-    return err;
+    /* the current file is left untouched if we fail */
+    err = unz64local_FindFile(s,szFileName,iCaseSensitivity,&file_pos);
+    if (err!=UNZ_OK)
+        return err;
+    return unzGoToFilePos64(file,&file_pos);
 }
 
-extern int ZEXPORT unzGoToFilePos64(unzFile file, const unz64_file_pos* file_pos)
+/*
+  Locate count filenames at once, without changing the current file.
+  return the number of files found, or a negative error code
+*/
+extern int ZEXPORT unzLocateFiles (unzFile file, const char* const* szFileNames, uLong count,
+                                   int iCaseSensitivity, unz64_file_pos* file_pos)
 {
     unz64_s* s;
-    int err;
+    uLong i;
+    int found = 0;
 
-    if (file==NULL || file_pos==NULL)
+    if (file==NULL || (count>0 && (szFileNames==NULL || file_pos==NULL)))
         return UNZ_PARAMERROR;
     s=(unz64_s*)file;
 
-    /* jump to the right spot */
-    s->pos_in_central_dir = file_pos->pos_in_zip_directory;
-    s->num_file           = file_pos->num_of_file;
+    for (i=0;i<count;i++)
+    {
+        if ((szFileNames[i]!=NULL) &&
+            (unz64local_FindFile(s,szFileNames[i],iCaseSensitivity,&file_pos[i])==UNZ_OK))
+            found++;
+        else
+        {
+            file_pos[i].pos_in_zip_directory = 0;
+            file_pos[i].num_of_file = 0;
+        }
+    }
+    return found;
+}
+
+/*
+  Call select_func for every file of the central directory, and list the
+    positions of the files it selects. No local header is read, and the
+    current file is not changed.
+  return UNZ_OK if there is no problem
+*/
+extern int ZEXPORT unzSelectFiles (unzFile file, unz_select_func select_func, voidpf opaque,
+                                   unz64_file_pos** pfile_pos, ZPOS64_T* pcount)
+{
+    unz64_s* s;
+    ZPOS64_T saved_num_file;
+    ZPOS64_T saved_pos_in_central_dir;
+    unz_file_info64 saved_file_info;
+    unz_file_info64_internal saved_file_info_internal;
+    int saved_current_file_ok;
+    unz64_file_pos* file_pos = NULL;
+    ZPOS64_T count = 0;
+    ZPOS64_T capacity = 0;
+    char* szFileName = NULL;
+    uLong size_szFileName = 0;
+    int err;
+
+    if (file==NULL || select_func==NULL || pfile_pos==NULL || pcount==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    *pfile_pos = NULL;
+    *pcount = 0;
+    if (s->gi.number_entry==0)
+        return UNZ_OK;
+
+    saved_num_file = s->num_file;
+    saved_pos_in_central_dir = s->pos_in_central_dir;
+    saved_file_info = s->cur_file_info;
+    saved_file_info_internal = s->cur_file_info_internal;
+    saved_current_file_ok = s->current_file_ok;
+
+    /* the central directory is cached, going through it costs no i/o */
+    err = unzGoToFirstFile(file);
+    while (err==UNZ_OK)
+    {
+        unz_file_info64 file_info;
+        err = unzGetCurrentFileInfo64(file,&file_info,NULL,0,NULL,0,NULL,0);
+        if ((err==UNZ_OK) && (file_info.size_filename+1>size_szFileName))
+        {
+            TRYFREE(szFileName);
+            size_szFileName = file_info.size_filename+1;
+            szFileName = (char*)ALLOC(size_szFileName);
+            if (szFileName==NULL)
+                err = UNZ_INTERNALERROR;
+        }
+        if (err==UNZ_OK)
+            err = unzGetCurrentFileInfo64(file,NULL,szFileName,size_szFileName,NULL,0,NULL,0);
+        if (err!=UNZ_OK)
+            break;
+        szFileName[file_info.size_filename] = '\0';
+
+        if (select_func(opaque,szFileName,&file_info))
+        {
+            if (count==capacity)
+            {
+                unz64_file_pos* grown;
+                ZPOS64_T new_capacity = (capacity==0) ? 16 : capacity*2;
+                if ((ZPOS64_T)(size_t)new_capacity!=new_capacity ||
+                    new_capacity > ((size_t)-1)/sizeof(unz64_file_pos))
+                {
+                    err = UNZ_INTERNALERROR;
+                    break;
+                }
+                grown = (unz64_file_pos*)realloc(file_pos,(size_t)new_capacity*sizeof(unz64_file_pos));
+                if (grown==NULL)
+                {
+                    err = UNZ_INTERNALERROR;
+                    break;
+                }
+                file_pos = grown;
+                capacity = new_capacity;
+            }
+            file_pos[count].pos_in_zip_directory = s->pos_in_central_dir;
+            file_pos[count].num_of_file = s->num_file;
+            count++;
+        }
+        err = unzGoToNextFile(file);
+    }
+
+    s->num_file = saved_num_file;
+    s->pos_in_central_dir = saved_pos_in_central_dir;
+    s->cur_file_info = saved_file_info;
+    s->cur_file_info_internal = saved_file_info_internal;
+    s->current_file_ok = saved_current_file_ok;
+    TRYFREE(szFileName);
+
+    if (err!=UNZ_END_OF_LIST_OF_FILE)
+    {
+        TRYFREE(file_pos);
+        return err;
+    }
+    *pfile_pos = file_pos;
+    *pcount = count;
+    return UNZ_OK;
+}
+
+local int unz64local_UpperCase (unsigned char c, int iCaseSensitivity)
+{
+    if ((iCaseSensitivity!=1) && (c>='a') && (c<='z'))
+        return c - 0x20;
+    return c;
+}
+
+/*
+  Match the end of szFileName against the end of pattern, see unzGlobMatch.
+  Every star tries the positions in turn, which is quick for the few stars
+    of a path pattern.
+*/
+local int unz64local_GlobMatch (const char* pattern, const char* szFileName, int iCaseSensitivity)
+{
+    while (*pattern!='\0')
+    {
+        unsigned char c = (unsigned char)*szFileName;
+
+        if (*pattern=='*')
+        {
+            int any_directory = (pattern[1]=='*');
+            pattern += any_directory ? 2 : 1;
+            /* the / following ** is optional, so that ** also matches no directory */
+            if (any_directory && (*pattern=='/') &&
+                unz64local_GlobMatch(pattern+1,szFileName,iCaseSensitivity))
+                return 1;
+            for (;;)
+            {
+                if (unz64local_GlobMatch(pattern,szFileName,iCaseSensitivity))
+                    return 1;
+                if ((*szFileName=='\0') || ((*szFileName=='/') && !any_directory))
+                    return 0;
+                szFileName++;
+            }
+        }
+
+        if ((c=='\0') || (c=='/' && *pattern!='/'))
+            return 0;
+
+        if (*pattern=='?')
+            pattern++;
+        else if (*pattern=='[')
+        {
+            const char* p = pattern+1;
+            int negate = 0;
+            int matched = 0;
+            if ((*p=='!') || (*p=='^'))
+            {
+                negate = 1;
+                p++;
+            }
+            /* a ] first in the class is one of its characters */
+            do
+            {
+                unsigned char low = (unsigned char)*p;
+                unsigned char high = low;
+                if (low=='\0')
+                    return 0;
+                if ((p[1]=='-') && (p[2]!=']') && (p[2]!='\0'))
+                {
+                    high = (unsigned char)p[2];
+                    p += 2;
+                }
+                p++;
+                if (iCaseSensitivity==1)
+                {
+                    if ((c>=low) && (c<=high))
+                        matched = 1;
+                }
+                else if (((c>=low) && (c<=high)) ||
+                         ((unz64local_UpperCase(c,iCaseSensitivity)>=unz64local_UpperCase(low,iCaseSensitivity)) &&
+                          (unz64local_UpperCase(c,iCaseSensitivity)<=unz64local_UpperCase(high,iCaseSensitivity))))
+                    matched = 1;
+            } while (*p!=']');
+            if (matched==negate)
+                return 0;
+            pattern = p+1;
+        }
+        else
+        {
+            if ((*pattern=='\\') && (pattern[1]!='\0'))
+                pattern++;
+            if (unz64local_UpperCase((unsigned char)*pattern,iCaseSensitivity)!=
+                unz64local_UpperCase(c,iCaseSensitivity))
+                return 0;
+            pattern++;
+        }
+        szFileName++;
+    }
+    return *szFileName=='\0';
+}
+
+/*
+  Match szFileName against a glob pattern, see unzip.h for the syntax.
+  return 1 if it matches, 0 otherwise
+*/
+extern int ZEXPORT unzGlobMatch (const char* szPattern, const char* szFileName, int iCaseSensitivity)
+{
+    if (szPattern==NULL || szFileName==NULL)
+        return 0;
+    if (iCaseSensitivity==0)
+        iCaseSensitivity=CASESENSITIVITYDEFAULTVALUE;
+    return unz64local_GlobMatch(szPattern,szFileName,iCaseSensitivity);
+}
+
+typedef struct unz64_select_pattern_s
+{
+    const char* pattern;
+    uLong size_pattern;
+    int iCaseSensitivity;
+} unz64_select_pattern;
+
+local int unz64local_SelectPrefix (voidpf opaque, const char* szFileName, const unz_file_info64* file_info)
+{
+    const unz64_select_pattern* select = (const unz64_select_pattern*)opaque;
+    uLong i;
+    (void)file_info;
+    for (i=0;i<select->size_pattern;i++)
+    {
+        if ((szFileName[i]=='\0') ||
+            (unz64local_UpperCase((unsigned char)szFileName[i],select->iCaseSensitivity)!=
+             unz64local_UpperCase((unsigned char)select->pattern[i],select->iCaseSensitivity)))
+            return 0;
+    }
+    return 1;
+}
+
+local int unz64local_SelectGlob (voidpf opaque, const char* szFileName, const unz_file_info64* file_info)
+{
+    const unz64_select_pattern* select = (const unz64_select_pattern*)opaque;
+    (void)file_info;
+    return unz64local_GlobMatch(select->pattern,szFileName,select->iCaseSensitivity);
+}
+
+extern int ZEXPORT unzSelectFilesWithPrefix (unzFile file, const char* szPrefix, int iCaseSensitivity,
+                                             unz64_file_pos** pfile_pos, ZPOS64_T* pcount)
+{
+    unz64_select_pattern select;
+    if (szPrefix==NULL)
+        return UNZ_PARAMERROR;
+    select.pattern = szPrefix;
+    select.size_pattern = (uLong)strlen(szPrefix);
+    select.iCaseSensitivity = (iCaseSensitivity==0) ? CASESENSITIVITYDEFAULTVALUE : iCaseSensitivity;
+    return unzSelectFiles(file,unz64local_SelectPrefix,&select,pfile_pos,pcount);
+}
+
+extern int ZEXPORT unzSelectFilesMatching (unzFile file, const char* szPattern, int iCaseSensitivity,
+                                           unz64_file_pos** pfile_pos, ZPOS64_T* pcount)
+{
+    unz64_select_pattern select;
+    if (szPattern==NULL)
+        return UNZ_PARAMERROR;
+    select.pattern = szPattern;
+    select.size_pattern = (uLong)strlen(szPattern);
+    select.iCaseSensitivity = (iCaseSensitivity==0) ? CASESENSITIVITYDEFAULTVALUE : iCaseSensitivity;
+    return unzSelectFiles(file,unz64local_SelectGlob,&select,pfile_pos,pcount);
+}
+
+/*
+///////////////////////////////////////////
+// Contributed by Ryan Haksi (mailto://cryogen@infoserve.net)
+// I need random access
+//
+// Further optimization could be realized by adding an ability
+// to cache the directory in memory. The goal being a single
+// comprehensive file read to put the file I need in a memory.
+*/
+
+/*
+typedef struct unz_file_pos_s
+{
+    ZPOS64_T pos_in_zip_directory;   // offset in file
+    ZPOS64_T num_of_file;            // # of file
+} unz_file_pos;
+*/
+
+extern int ZEXPORT unzGetFilePos64(unzFile file, unz64_file_pos*  file_pos)
+{
+    unz64_s* s;
+
+    if (file==NULL || file_pos==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    if (!s->current_file_ok)
+        return UNZ_END_OF_LIST_OF_FILE;
+
+    file_pos->pos_in_zip_directory  = s->pos_in_central_dir;
+    file_pos->num_of_file           = s->num_file;
+
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzGetFilePos(
+    unzFile file,
+    unz_file_pos* file_pos)
+{
+    unz64_file_pos file_pos64;
+    int err = unzGetFilePos64(file,&file_pos64);
+    if (err==UNZ_OK)
+    {
+        file_pos->pos_in_zip_directory = (uLong)file_pos64.pos_in_zip_directory;
+        file_pos->num_of_file = (uLong)file_pos64.num_of_file;
+    }
+    return err;
+}
+
+extern int ZEXPORT unzGoToFilePos64(unzFile file, const unz64_file_pos* file_pos)
+{
+    unz64_s* s;
+    int err;
+
+    if (file==NULL || file_pos==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+
+    /* jump to the right spot */
+    s->pos_in_central_dir = file_pos->pos_in_zip_directory;
+    s->num_file           = file_pos->num_of_file;
 
     /* set the current file */
     err = unz64local_GetCurrentFileInfoInternal(file,&s->cur_file_info,
@@ -1378,6 +1893,141 @@ extern int ZEXPORT unzGoToFilePos(
     return unzGoToFilePos64(file,&file_pos64);
 }
 
+/*
+  Count the records of the central directory cached in memory, and the total
+    size of their file names
+*/
+local int unz64local_CountCentralDir(const unz64_central_dir* central_dir,
+                                     ZPOS64_T* pnumber_entry, ZPOS64_T* psize_filenames)
+{
+    ZPOS64_T pos = 0;
+    ZPOS64_T number_entry = 0;
+    ZPOS64_T size_filenames = 0;
+
+    while (central_dir->size-pos>=SIZECENTRALDIRITEM)
+    {
+        const unsigned char* p = central_dir->data+pos;
+        uLong size_filename;
+        ZPOS64_T size_record;
+
+        if (unz64local_getLongFromBuffer(p)!=0x02014b50)
+            break;
+        size_filename = unz64local_getShortFromBuffer(p+28);
+        size_record = SIZECENTRALDIRITEM + size_filename +
+                      unz64local_getShortFromBuffer(p+30) + unz64local_getShortFromBuffer(p+32);
+        if (central_dir->size-pos<size_record)
+            return UNZ_BADZIPFILE;
+
+        number_entry++;
+        size_filenames += size_filename+1;
+        pos += size_record;
+    }
+
+    *pnumber_entry = number_entry;
+    *psize_filenames = size_filenames;
+    return UNZ_OK;
+}
+
+/*
+  Decode the whole central directory in a table allocated with a single block
+*/
+extern int ZEXPORT unzGetDirectory (unzFile file, unz_directory** pdirectory)
+{
+    unz64_s* s;
+    unz_directory* directory;
+    ZPOS64_T number_entry, size_filenames;
+    ZPOS64_T size_header, size_arrays, size_total;
+    unsigned char* arena;
+    ZPOS64_T pos = 0;
+    ZPOS64_T i;
+    uLong filename_offset = 0;
+    int err;
+
+    if ((file==NULL) || (pdirectory==NULL))
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    *pdirectory = NULL;
+
+    err = unz64local_CountCentralDir(s->central_dir,&number_entry,&size_filenames);
+    if (err!=UNZ_OK)
+        return err;
+
+    /* the arrays of 64 bits values first, to keep them aligned */
+    size_header = (sizeof(unz_directory)+sizeof(ZPOS64_T)-1)/sizeof(ZPOS64_T)*sizeof(ZPOS64_T);
+    size_arrays = number_entry*(4*sizeof(ZPOS64_T)+5*sizeof(uLong)) + (number_entry+1)*sizeof(uLong);
+    size_total = size_header+size_arrays+size_filenames;
+    if ((size_filenames!=(ZPOS64_T)(uLong)size_filenames) ||
+        (size_total!=(ZPOS64_T)(size_t)size_total) ||
+        (size_total/(4*sizeof(ZPOS64_T)+6*sizeof(uLong)+1)<number_entry))
+        return UNZ_INTERNALERROR;
+
+    arena = (unsigned char*)ALLOC((size_t)size_total);
+    if (arena==NULL)
+        return UNZ_INTERNALERROR;
+
+    directory = (unz_directory*)arena;
+    arena += size_header;
+    directory->number_entry = number_entry;
+    directory->pos_in_zip_directory = (ZPOS64_T*)arena;
+    arena += number_entry*sizeof(ZPOS64_T);
+    directory->offset_local_header = (ZPOS64_T*)arena;
+    arena += number_entry*sizeof(ZPOS64_T);
+    directory->compressed_size = (ZPOS64_T*)arena;
+    arena += number_entry*sizeof(ZPOS64_T);
+    directory->uncompressed_size = (ZPOS64_T*)arena;
+    arena += number_entry*sizeof(ZPOS64_T);
+    directory->crc = (uLong*)arena;
+    arena += number_entry*sizeof(uLong);
+    directory->dosDate = (uLong*)arena;
+    arena += number_entry*sizeof(uLong);
+    directory->compression_method = (uLong*)arena;
+    arena += number_entry*sizeof(uLong);
+    directory->flag = (uLong*)arena;
+    arena += number_entry*sizeof(uLong);
+    directory->external_fa = (uLong*)arena;
+    arena += number_entry*sizeof(uLong);
+    directory->filename_offset = (uLong*)arena;
+    arena += (number_entry+1)*sizeof(uLong);
+    directory->filenames = (char*)arena;
+
+    for (i=0;i<number_entry;i++)
+    {
+        const unsigned char* p = s->central_dir->data+pos;
+        uLong size_filename = unz64local_getShortFromBuffer(p+28);
+        uLong size_file_extra = unz64local_getShortFromBuffer(p+30);
+
+        directory->pos_in_zip_directory[i] = s->offset_central_dir+pos;
+        directory->flag[i] = unz64local_getShortFromBuffer(p+8);
+        directory->compression_method[i] = unz64local_getShortFromBuffer(p+10);
+        directory->dosDate[i] = unz64local_getLongFromBuffer(p+12);
+        directory->crc[i] = unz64local_getLongFromBuffer(p+16);
+        directory->compressed_size[i] = unz64local_getLongFromBuffer(p+20);
+        directory->uncompressed_size[i] = unz64local_getLongFromBuffer(p+24);
+        directory->external_fa[i] = unz64local_getLongFromBuffer(p+38);
+        directory->offset_local_header[i] = unz64local_getLongFromBuffer(p+42);
+        unz64local_ReadZip64ExtraField(p+SIZECENTRALDIRITEM+size_filename,size_file_extra,
+                                       &directory->uncompressed_size[i],
+                                       &directory->compressed_size[i],
+                                       &directory->offset_local_header[i]);
+
+        directory->filename_offset[i] = filename_offset;
+        memcpy(directory->filenames+filename_offset,p+SIZECENTRALDIRITEM,size_filename);
+        directory->filenames[filename_offset+size_filename] = '\0';
+        filename_offset += size_filename+1;
+
+        pos += SIZECENTRALDIRITEM + size_filename + size_file_extra + unz64local_getShortFromBuffer(p+32);
+    }
+    directory->filename_offset[number_entry] = filename_offset;
+
+    *pdirectory = directory;
+    return UNZ_OK;
+}
+
+extern void ZEXPORT unzFreeDirectory (unz_directory* directory)
+{
+    TRYFREE(directory);
+}
+
 /*
 // Unzip Helper Functions - should be here?
 ///////////////////////////////////////////
@@ -1403,6 +2053,7 @@ local int unz64local_CheckCurrentFileCoherencyHeader (unz64_s* s, uInt* piSizeVa
     *poffset_local_extrafield = 0;
     *psize_local_extrafield = 0;
 
+    s->stream_pos = UNZ_STREAM_POS_UNKNOWN;
     if (ZSEEK64(s->z_filefunc, s->filestream,s->cur_file_info_internal.offset_curfile +
                                 s->byte_before_the_zipfile,ZLIB_FILEFUNC_SEEK_SET)!=0)
         return UNZ_ERRNO;
@@ -1473,6 +2124,43 @@ local int unz64local_CheckCurrentFileCoherencyHeader (unz64_s* s, uInt* piSizeVa
     return err;
 }
 
+/*
+  Hint the system to read in advance the next read_ahead_depth read buffers of
+    compressed data, so that the disk works while the current buffer inflates.
+  The hint is given again once less than half of the window is ahead.
+*/
+local uLong unz64local_ReadAt OF((unz64_s* s, ZPOS64_T pos, voidp buf, uLong size));
+
+local void unz64local_ReadAhead (unz64_s* s, file_in_zip64_read_info_s* pfile_in_zip_read_info)
+{
+    ZPOS64_T window;
+    ZPOS64_T end;
+    ZPOS64_T size;
+
+    if (s->read_ahead_depth==0)
+        return;
+    window = (ZPOS64_T)s->read_ahead_depth * s->read_buffer_size;
+    end = pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->rest_read_compressed;
+    /* a mapped zipfile hands the whole compressed data to inflate at once */
+    if (pfile_in_zip_read_info->mapped_data!=NULL)
+        window = pfile_in_zip_read_info->rest_read_compressed;
+
+    /* after a seek, the window restarts from the current position */
+    if (pfile_in_zip_read_info->read_ahead_pos < pfile_in_zip_read_info->pos_in_zipfile)
+        pfile_in_zip_read_info->read_ahead_pos = pfile_in_zip_read_info->pos_in_zipfile;
+    if ((pfile_in_zip_read_info->read_ahead_pos >= end) ||
+        (pfile_in_zip_read_info->read_ahead_pos - pfile_in_zip_read_info->pos_in_zipfile > window/2))
+        return;
+
+    size = pfile_in_zip_read_info->pos_in_zipfile + window - pfile_in_zip_read_info->read_ahead_pos;
+    if (size > end - pfile_in_zip_read_info->read_ahead_pos)
+        size = end - pfile_in_zip_read_info->read_ahead_pos;
+    call_zadvise64(&s->z_filefunc,s->filestream,
+                   pfile_in_zip_read_info->read_ahead_pos + pfile_in_zip_read_info->byte_before_the_zipfile,
+                   size);
+    pfile_in_zip_read_info->read_ahead_pos += size;
+}
+
 /*
   Open for reading data the current file in the zipfile.
   If there is no error and the file is opened, the return value is UNZ_OK.
@@ -1505,20 +2193,29 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
     if (unz64local_CheckCurrentFileCoherencyHeader(s,&iSizeVar, &offset_local_extrafield,&size_local_extrafield)!=UNZ_OK)
         return UNZ_BADZIPFILE;
 
-    pfile_in_zip_read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
+    /* the read buffer and the inflate state of the last file are reused */
+    pfile_in_zip_read_info = s->pfile_in_zip_read_spare;
+    s->pfile_in_zip_read_spare = NULL;
     if (pfile_in_zip_read_info==NULL)
-        return UNZ_INTERNALERROR;
+    {
+        pfile_in_zip_read_info = (file_in_zip64_read_info_s*)call_zalloc_mem(&s->allocator,sizeof(file_in_zip64_read_info_s));
+        if (pfile_in_zip_read_info==NULL)
+            return UNZ_INTERNALERROR;
+        pfile_in_zip_read_info->read_buffer=(char*)call_zalloc_mem(&s->allocator,s->read_buffer_size);
+        pfile_in_zip_read_info->inflate_allocated=0;
+    }
 
-    pfile_in_zip_read_info->read_buffer=(char*)ALLOC(UNZ_BUFSIZE);
     pfile_in_zip_read_info->offset_local_extrafield = offset_local_extrafield;
     pfile_in_zip_read_info->size_local_extrafield = size_local_extrafield;
     pfile_in_zip_read_info->pos_local_extrafield=0;
     pfile_in_zip_read_info->raw=raw;
     pfile_in_zip_read_info->byte_before_the_zipfile = 0;
+    pfile_in_zip_read_info->check_crc = 1;
+    pfile_in_zip_read_info->seek_index = NULL;
 
     if (pfile_in_zip_read_info->read_buffer==NULL)
     {
-        TRYFREE(pfile_in_zip_read_info);
+        unz64local_FreeReadInfo(&s->allocator,pfile_in_zip_read_info);
         return UNZ_INTERNALERROR;
     }
 
@@ -1555,6 +2252,8 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
     pfile_in_zip_read_info->compression_method = s->cur_file_info.compression_method;
     pfile_in_zip_read_info->filestream=s->filestream;
     pfile_in_zip_read_info->z_filefunc=s->z_filefunc;
+    pfile_in_zip_read_info->mapped_data=(const unsigned char*)call_zmap64(&s->z_filefunc,s->filestream,
+                                                                         &pfile_in_zip_read_info->mapped_size);
 #ifndef __clang_analyzer__
     pfile_in_zip_read_info->byte_before_the_zipfile=s->byte_before_the_zipfile;
 #endif
@@ -1569,9 +2268,6 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
       pfile_in_zip_read_info->bstream.opaque = (voidpf)0;
       pfile_in_zip_read_info->bstream.state = (voidpf)0;
 
-      pfile_in_zip_read_info->stream.zalloc = (alloc_func)0;
-      pfile_in_zip_read_info->stream.zfree = (free_func)0;
-      pfile_in_zip_read_info->stream.opaque = (voidpf)0;
       pfile_in_zip_read_info->stream.next_in = (voidpf)0;
       pfile_in_zip_read_info->stream.avail_in = 0;
 
@@ -1580,7 +2276,7 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
         pfile_in_zip_read_info->stream_initialised=Z_BZIP2ED;
       else
       {
-        TRYFREE(pfile_in_zip_read_info);
+        unz64local_FreeReadInfo(&s->allocator,pfile_in_zip_read_info);
         return err;
       }
 #else
@@ -1589,18 +2285,25 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
     }
     else if ((s->cur_file_info.compression_method==Z_DEFLATED) && (!raw))
     {
-      pfile_in_zip_read_info->stream.zalloc = (alloc_func)0;
-      pfile_in_zip_read_info->stream.zfree = (free_func)0;
-      pfile_in_zip_read_info->stream.opaque = (voidpf)0;
       pfile_in_zip_read_info->stream.next_in = 0;
       pfile_in_zip_read_info->stream.avail_in = 0;
 
-      err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
+      if (pfile_in_zip_read_info->inflate_allocated)
+        err=inflateReset(&pfile_in_zip_read_info->stream);
+      else
+      {
+        pfile_in_zip_read_info->stream.zalloc = zlib_alloc_from_allocator;
+        pfile_in_zip_read_info->stream.zfree = zlib_free_from_allocator;
+        pfile_in_zip_read_info->stream.opaque = (voidpf)&s->allocator;
+        err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
+        if (err == Z_OK)
+          pfile_in_zip_read_info->inflate_allocated=1;
+      }
       if (err == Z_OK)
         pfile_in_zip_read_info->stream_initialised=Z_DEFLATED;
       else
       {
-        TRYFREE(pfile_in_zip_read_info);
+        unz64local_FreeReadInfo(&s->allocator,pfile_in_zip_read_info);
         return err;
       }
         /* windowBits is passed < 0 to tell that there is no zlib header.
@@ -1630,24 +2333,35 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
     if (password != NULL)
     {
         int i;
-        s->pcrc_32_tab = (const unsigned long*)get_crc_table();
+        if (s->pfile_in_zip_read->rest_read_compressed<12)
+            return UNZ_BADZIPFILE;
+        s->pcrc_32_tab = get_crc_table();
         init_keys(password,s->keys,s->pcrc_32_tab);
-        if (ZSEEK64(s->z_filefunc, s->filestream,
+        /* through unz64local_ReadAt, which knows where the stream is */
+        if (unz64local_ReadAt(s,
                   s->pfile_in_zip_read->pos_in_zipfile +
                      s->pfile_in_zip_read->byte_before_the_zipfile,
-                  SEEK_SET)!=0)
-            return UNZ_INTERNALERROR;
-        if(ZREAD64(s->z_filefunc, s->filestream,source, 12)<12)
+                  source,12)!=12)
             return UNZ_INTERNALERROR;
 
         for (i = 0; i<12; i++)
             zdecode(s->keys,s->pcrc_32_tab,source[i]);
 
+        /* the compressed size counts the encryption header */
         s->pfile_in_zip_read->pos_in_zipfile+=12;
+        s->pfile_in_zip_read->rest_read_compressed-=12;
         s->encrypted=1;
     }
 #    endif
 
+    pfile_in_zip_read_info->pos_in_zipfile_start = pfile_in_zip_read_info->pos_in_zipfile;
+    pfile_in_zip_read_info->rest_read_compressed_start = pfile_in_zip_read_info->rest_read_compressed;
+#    ifndef NOUNCRYPT
+    memcpy(pfile_in_zip_read_info->keys_start,s->keys,sizeof(s->keys));
+#    endif
+
+    pfile_in_zip_read_info->read_ahead_pos = pfile_in_zip_read_info->pos_in_zipfile;
+    unz64local_ReadAhead(s,pfile_in_zip_read_info);
 
     return UNZ_OK;
 }
@@ -1667,6 +2381,47 @@ extern int ZEXPORT unzOpenCurrentFile2 (unzFile file, int* method, int* level, i
     return unzOpenCurrentFile3(file, method, level, raw, NULL);
 }
 
+/*
+  Give a direct pointer to the data of the current file, when the zipfile was
+    opened with the fill_mmap_filefunc64 backend and the file is stored (method 0)
+    and not encrypted. Nothing is copied, and the CRC is not checked.
+*/
+extern int ZEXPORT unzGetCurrentFileMappedData (unzFile file, const void** pdata, ZPOS64_T* psize)
+{
+    unz64_s* s;
+    const unsigned char* mapped_data;
+    ZPOS64_T mapped_size;
+    ZPOS64_T pos;
+    uInt iSizeVar;
+    ZPOS64_T offset_local_extrafield;
+    uInt  size_local_extrafield;
+
+    if (file==NULL || pdata==NULL || psize==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+
+    if ((s->cur_file_info.compression_method!=0) || ((s->cur_file_info.flag & 1)!=0))
+        return UNZ_PARAMERROR;
+
+    mapped_data = (const unsigned char*)call_zmap64(&s->z_filefunc,s->filestream,&mapped_size);
+    if (mapped_data==NULL)
+        return UNZ_PARAMERROR;
+
+    if (unz64local_CheckCurrentFileCoherencyHeader(s,&iSizeVar,&offset_local_extrafield,&size_local_extrafield)!=UNZ_OK)
+        return UNZ_BADZIPFILE;
+
+    pos = s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER + iSizeVar +
+          s->byte_before_the_zipfile;
+    if ((pos>mapped_size) || (mapped_size-pos<s->cur_file_info.compressed_size))
+        return UNZ_BADZIPFILE;
+
+    *pdata = mapped_data+pos;
+    *psize = s->cur_file_info.compressed_size;
+    return UNZ_OK;
+}
+
 /** Addition for GDAL : START */
 
 extern ZPOS64_T ZEXPORT unzGetCurrentFileZStreamPos64( unzFile file)
@@ -1685,6 +2440,30 @@ extern ZPOS64_T ZEXPORT unzGetCurrentFileZStreamPos64( unzFile file)
 
 /** Addition for GDAL : END */
 
+/*
+  Read size bytes at pos in the zipfile, seeking only if the stream is not
+    already there (sequential reads of the current file need no seek)
+  return the number of bytes read
+*/
+local uLong unz64local_ReadAt (unz64_s* s, ZPOS64_T pos, voidp buf, uLong size)
+{
+    uLong uRead;
+    if (s->stream_pos!=pos)
+    {
+        if (ZSEEK64(s->z_filefunc,s->filestream,pos,ZLIB_FILEFUNC_SEEK_SET)!=0)
+        {
+            s->stream_pos = UNZ_STREAM_POS_UNKNOWN;
+            return 0;
+        }
+    }
+    uRead = ZREAD64(s->z_filefunc,s->filestream,buf,size);
+    if (uRead==size)
+        s->stream_pos = pos + uRead;
+    else
+        s->stream_pos = UNZ_STREAM_POS_UNKNOWN;
+    return uRead;
+}
+
 /*
   Read bytes from the current file.
   buf contain buffer where data must be copied
@@ -1747,51 +2526,103 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
     while (pfile_in_zip_read_info->stream.avail_out>0)
     {
-        if ((pfile_in_zip_read_info->stream.avail_in==0) &&
-            (pfile_in_zip_read_info->rest_read_compressed>0))
+        if (((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw)) &&
+            (pfile_in_zip_read_info->stream.avail_in==0) &&
+            (pfile_in_zip_read_info->rest_read_compressed>0) &&
+            (pfile_in_zip_read_info->stream.avail_out>=s->read_buffer_size) &&
+            (pfile_in_zip_read_info->mapped_data==NULL))
         {
-            uInt uReadThis = UNZ_BUFSIZE;
+            /* large read of stored data : read straight into the caller buffer,
+               without going through read_buffer */
+            uInt uReadThis = pfile_in_zip_read_info->stream.avail_out;
+            unz64local_ReadAhead(s,pfile_in_zip_read_info);
             if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
                 uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
-            if (uReadThis == 0)
-                return UNZ_EOF;
-            if (ZSEEK64(pfile_in_zip_read_info->z_filefunc,
-                      pfile_in_zip_read_info->filestream,
+            if (unz64local_ReadAt(s,
                       pfile_in_zip_read_info->pos_in_zipfile +
                          pfile_in_zip_read_info->byte_before_the_zipfile,
-                         ZLIB_FILEFUNC_SEEK_SET)!=0)
-                return UNZ_ERRNO;
-            if (ZREAD64(pfile_in_zip_read_info->z_filefunc,
-                      pfile_in_zip_read_info->filestream,
-                      pfile_in_zip_read_info->read_buffer,
+                      pfile_in_zip_read_info->stream.next_out,
                       uReadThis)!=uReadThis)
                 return UNZ_ERRNO;
 
-
 #            ifndef NOUNCRYPT
             if(s->encrypted)
-            {
-                uInt i;
-                for(i=0;i<uReadThis;i++)
-                  pfile_in_zip_read_info->read_buffer[i] =
-                      zdecode(s->keys,s->pcrc_32_tab,
-                              pfile_in_zip_read_info->read_buffer[i]);
-            }
+                zdecode_block(s->keys,s->pcrc_32_tab,
+                              pfile_in_zip_read_info->stream.next_out,uReadThis);
 #            endif
 
+            pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
+            pfile_in_zip_read_info->rest_read_compressed -= uReadThis;
+
+            pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uReadThis;
+
+            pfile_in_zip_read_info->crc32 = mzCrc32(pfile_in_zip_read_info->crc32,
+                                pfile_in_zip_read_info->stream.next_out,
+                                uReadThis);
+            pfile_in_zip_read_info->rest_read_uncompressed-=uReadThis;
+            pfile_in_zip_read_info->stream.avail_out -= uReadThis;
+            pfile_in_zip_read_info->stream.next_out += uReadThis;
+            pfile_in_zip_read_info->stream.total_out += uReadThis;
+            iRead += uReadThis;
+            continue;
+        }
+
+        if ((pfile_in_zip_read_info->stream.avail_in==0) &&
+            (pfile_in_zip_read_info->rest_read_compressed>0))
+        {
+            uInt uReadThis = (uInt)s->read_buffer_size;
+
+            unz64local_ReadAhead(s,pfile_in_zip_read_info);
+            if ((pfile_in_zip_read_info->mapped_data!=NULL) && (!s->encrypted))
+            {
+                /* zipfile mapped in memory, the compressed data is used in place */
+                ZPOS64_T pos = pfile_in_zip_read_info->pos_in_zipfile +
+                               pfile_in_zip_read_info->byte_before_the_zipfile;
+
+                uReadThis = (uInt)-1;
+                if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
+                    uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
+                if ((pos>pfile_in_zip_read_info->mapped_size) ||
+                    (pfile_in_zip_read_info->mapped_size-pos<uReadThis))
+                    return UNZ_ERRNO;
+
+                pfile_in_zip_read_info->stream.next_in =
+                    (Bytef*)(pfile_in_zip_read_info->mapped_data+pos);
+            }
+            else
+            {
+                if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
+                    uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
+                if (uReadThis == 0)
+                    return UNZ_EOF;
+                if (unz64local_ReadAt(s,
+                          pfile_in_zip_read_info->pos_in_zipfile +
+                             pfile_in_zip_read_info->byte_before_the_zipfile,
+                          pfile_in_zip_read_info->read_buffer,
+                          uReadThis)!=uReadThis)
+                    return UNZ_ERRNO;
+
+
+#                ifndef NOUNCRYPT
+                if(s->encrypted)
+                    zdecode_block(s->keys,s->pcrc_32_tab,
+                                  (unsigned char*)pfile_in_zip_read_info->read_buffer,uReadThis);
+#                endif
+
+                pfile_in_zip_read_info->stream.next_in =
+                    (Bytef*)pfile_in_zip_read_info->read_buffer;
+            }
 
             pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
 
             pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
 
-            pfile_in_zip_read_info->stream.next_in =
-                (Bytef*)pfile_in_zip_read_info->read_buffer;
             pfile_in_zip_read_info->stream.avail_in = (uInt)uReadThis;
         }
 
         if ((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw))
         {
-            uInt uDoCopy,i ;
+            uInt uDoCopy ;
 
             if ((pfile_in_zip_read_info->stream.avail_in == 0) &&
                 (pfile_in_zip_read_info->rest_read_compressed == 0))
@@ -1803,13 +2634,12 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
             else
                 uDoCopy = pfile_in_zip_read_info->stream.avail_in ;
 
-            for (i=0;i<uDoCopy;i++)
-                *(pfile_in_zip_read_info->stream.next_out+i) =
-                        *(pfile_in_zip_read_info->stream.next_in+i);
+            memcpy(pfile_in_zip_read_info->stream.next_out,
+                   pfile_in_zip_read_info->stream.next_in,uDoCopy);
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uDoCopy;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
+            pfile_in_zip_read_info->crc32 = mzCrc32(pfile_in_zip_read_info->crc32,
                                 pfile_in_zip_read_info->stream.next_out,
                                 uDoCopy);
             pfile_in_zip_read_info->rest_read_uncompressed-=uDoCopy;
@@ -1846,7 +2676,7 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,bufBefore, (uInt)(uOutThis));
+            pfile_in_zip_read_info->crc32 = mzCrc32(pfile_in_zip_read_info->crc32,bufBefore, (uInt)(uOutThis));
             pfile_in_zip_read_info->rest_read_uncompressed -= uOutThis;
             iRead += (uInt)(uTotalOutAfter - uTotalOutBefore);
 
@@ -1890,7 +2720,7 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
 
             pfile_in_zip_read_info->crc32 =
-                crc32(pfile_in_zip_read_info->crc32,bufBefore,
+                mzCrc32(pfile_in_zip_read_info->crc32,bufBefore,
                         (uInt)(uOutThis));
 
             pfile_in_zip_read_info->rest_read_uncompressed -=
@@ -1911,6 +2741,150 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 }
 
 
+/*
+  Read the whole file szFileName in a buffer allocated with exactly its
+    uncompressed size: a deflated file is inflated in a single call from its
+    compressed data, a stored file is read straight into the buffer.
+*/
+extern int ZEXPORT unzReadEntryToBuffer (unzFile file, const char* szFileName, int iCaseSensitivity,
+                                         void** pbuf, ZPOS64_T* plen)
+{
+    unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    unsigned char* buf;
+    unsigned char* compressed = NULL;
+    ZPOS64_T size;
+    ZPOS64_T size_compressed;
+    ZPOS64_T pos;
+    int err;
+
+    if (file==NULL || szFileName==NULL || pbuf==NULL || plen==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    *pbuf = NULL;
+    *plen = 0;
+
+    err = unzLocateFile(file,szFileName,iCaseSensitivity);
+    if (err!=UNZ_OK)
+        return err;
+
+    if ((s->cur_file_info.flag & 1) != 0)
+        return UNZ_PARAMERROR;
+
+    size = s->cur_file_info.uncompressed_size;
+    if ((ZPOS64_T)(size_t)size != size)
+        return UNZ_INTERNALERROR;
+    buf = (unsigned char*)ALLOC((size_t)(size ? size : 1));
+    if (buf==NULL)
+        return UNZ_INTERNALERROR;
+
+    err = unzOpenCurrentFile(file);
+    if (err!=UNZ_OK)
+    {
+        TRYFREE(buf);
+        return err;
+    }
+    pfile_in_zip_read_info = s->pfile_in_zip_read;
+    size_compressed = pfile_in_zip_read_info->rest_read_compressed;
+    pos = pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile;
+
+    if (((pfile_in_zip_read_info->compression_method==0) ||
+         (pfile_in_zip_read_info->compression_method==Z_DEFLATED)) &&
+        (size==(uInt)size) && (size_compressed==(uInt)size_compressed))
+    {
+        const unsigned char* in = NULL;
+
+        if ((pfile_in_zip_read_info->compression_method==0) && (size_compressed!=size))
+            err = UNZ_BADZIPFILE;
+        else if (pfile_in_zip_read_info->mapped_data!=NULL)
+        {
+            if ((pos>pfile_in_zip_read_info->mapped_size) ||
+                (pfile_in_zip_read_info->mapped_size-pos<size_compressed))
+                err = UNZ_ERRNO;
+            else
+                in = pfile_in_zip_read_info->mapped_data+pos;
+        }
+        else if (pfile_in_zip_read_info->compression_method==0)
+            in = buf;
+        else
+        {
+            compressed = (unsigned char*)call_zalloc_mem(&s->allocator,(size_t)(size_compressed ? size_compressed : 1));
+            if (compressed==NULL)
+                err = UNZ_INTERNALERROR;
+            in = compressed;
+        }
+
+        if ((err==UNZ_OK) && (pfile_in_zip_read_info->mapped_data==NULL) &&
+            (unz64local_ReadAt(s,pos,(voidp)in,(uLong)size_compressed)!=size_compressed))
+            err = UNZ_ERRNO;
+
+        if (err==UNZ_OK)
+        {
+            if (pfile_in_zip_read_info->compression_method==0)
+            {
+                if (in!=buf)
+                    memcpy(buf,in,(size_t)size);
+            }
+            else
+            {
+                pfile_in_zip_read_info->stream.next_in = (Bytef*)in;
+                pfile_in_zip_read_info->stream.avail_in = (uInt)size_compressed;
+                pfile_in_zip_read_info->stream.next_out = (Bytef*)buf;
+                pfile_in_zip_read_info->stream.avail_out = (uInt)size;
+                if ((inflate(&pfile_in_zip_read_info->stream,Z_FINISH)!=Z_STREAM_END) ||
+                    (pfile_in_zip_read_info->stream.avail_out!=0))
+                    err = UNZ_BADZIPFILE;
+                pfile_in_zip_read_info->stream.next_in = NULL;
+                pfile_in_zip_read_info->stream.avail_in = 0;
+            }
+        }
+
+        if (err==UNZ_OK)
+        {
+            pfile_in_zip_read_info->pos_in_zipfile += size_compressed;
+            pfile_in_zip_read_info->rest_read_compressed = 0;
+            pfile_in_zip_read_info->rest_read_uncompressed = 0;
+            pfile_in_zip_read_info->total_out_64 = size;
+            pfile_in_zip_read_info->crc32 = mzCrc32(pfile_in_zip_read_info->crc32,buf,(uLong)size);
+        }
+        call_zfree_mem(&s->allocator,compressed);
+    }
+    else
+    {
+        /* bzip2 file, or too large for a single call */
+        ZPOS64_T done = 0;
+        while ((err==UNZ_OK) && (done<size))
+        {
+            unsigned chunk = 0x40000000;
+            int read;
+            if (size-done<chunk)
+                chunk = (unsigned)(size-done);
+            read = unzReadCurrentFile(file,buf+done,chunk);
+            if (read<0)
+                err = read;
+            else if (read==0)
+                err = UNZ_BADZIPFILE;
+            else
+                done += (ZPOS64_T)read;
+        }
+    }
+
+    if (err==UNZ_OK)
+        err = unzCloseCurrentFile(file);
+    else
+        unzCloseCurrentFile(file);
+
+    if (err!=UNZ_OK)
+    {
+        TRYFREE(buf);
+        return err;
+    }
+    *pbuf = buf;
+    *plen = size;
+    return UNZ_OK;
+}
+
+
 /*
   Give the current position in uncompressed data
 */
@@ -2010,6 +2984,7 @@ extern int ZEXPORT unzGetLocalExtrafield (unzFile file, voidp buf, unsigned len)
     if (read_now==0)
         return 0;
 
+    s->stream_pos = UNZ_STREAM_POS_UNKNOWN;
     if (ZSEEK64(pfile_in_zip_read_info->z_filefunc,
               pfile_in_zip_read_info->filestream,
               pfile_in_zip_read_info->offset_local_extrafield +
@@ -2026,128 +3001,1324 @@ extern int ZEXPORT unzGetLocalExtrafield (unzFile file, voidp buf, unsigned len)
 }
 
 /*
-  Close the file in zip opened with unzipOpenCurrentFile
-  Return UNZ_CRCERROR if all the file was read but the CRC is not good
+///////////////////////////////////////////
+// Random access in the current file
+//
+// A seek index keeps, every span bytes of uncompressed data, the state
+// needed to restart inflate there (bit position and the last 32K of
+// output), as done by zran.c in the zlib examples.
 */
-extern int ZEXPORT unzCloseCurrentFile (unzFile file)
+
+#define UNZ_SEEK_WINDOW_SIZE (32768)
+
+local void unz64local_FreeSeekIndex(const zlib_allocator_def* pallocator, unz64_seek_index* seek_index)
 {
-    int err=UNZ_OK;
+    uLong i;
+    if (seek_index==NULL)
+        return;
+    for (i=seek_index->count;i>0;i--)
+        call_zfree_mem(pallocator,seek_index->points[i-1].window);
+    call_zfree_mem(pallocator,seek_index->points);
+    call_zfree_mem(pallocator,seek_index);
+}
 
-    unz64_s* s;
-    file_in_zip64_read_info_s* pfile_in_zip_read_info;
-    if (file==NULL)
-        return UNZ_PARAMERROR;
-    s=(unz64_s*)file;
-    pfile_in_zip_read_info=s->pfile_in_zip_read;
+local unz64_seek_index* unz64local_AllocSeekIndex(const zlib_allocator_def* pallocator, ZPOS64_T span)
+{
+    unz64_seek_index* seek_index = (unz64_seek_index*)call_zalloc_mem(pallocator,sizeof(unz64_seek_index));
+    if (seek_index==NULL)
+        return NULL;
+    seek_index->span = span;
+    seek_index->count = 0;
+    seek_index->capacity = 0;
+    seek_index->points = NULL;
+    return seek_index;
+}
 
-    if (pfile_in_zip_read_info==NULL)
-        return UNZ_PARAMERROR;
+/* append a checkpoint, window being the window_size bytes of output before out */
+local int unz64local_AddSeekPoint(const zlib_allocator_def* pallocator, unz64_seek_index* seek_index,
+                                  ZPOS64_T out, ZPOS64_T in, int bits,
+                                  const unsigned char* window, uInt window_size)
+{
+    unz64_seek_point* point;
+    if (seek_index->count==seek_index->capacity)
+    {
+        uLong capacity = (seek_index->capacity==0) ? 8 : seek_index->capacity*2;
+        unz64_seek_point* points = (unz64_seek_point*)call_zalloc_mem(pallocator,capacity*sizeof(unz64_seek_point));
+        if (points==NULL)
+            return UNZ_INTERNALERROR;
+        if (seek_index->count>0)
+            memcpy(points,seek_index->points,seek_index->count*sizeof(unz64_seek_point));
+        call_zfree_mem(pallocator,seek_index->points);
+        seek_index->points = points;
+        seek_index->capacity = capacity;
+    }
 
+    point = &seek_index->points[seek_index->count];
+    point->out = out;
+    point->in = in;
+    point->bits = bits;
+    point->window_size = window_size;
+    point->window = NULL;
+    if (window_size>0)
+    {
+        point->window = (unsigned char*)call_zalloc_mem(pallocator,window_size);
+        if (point->window==NULL)
+            return UNZ_INTERNALERROR;
+        if (window!=NULL)
+            memcpy(point->window,window,window_size);
+    }
+    seek_index->count++;
+    return UNZ_OK;
+}
 
-    if ((pfile_in_zip_read_info->rest_read_uncompressed == 0) &&
-        (!pfile_in_zip_read_info->raw))
+/*
+  Inflate the whole current file with a private stream, and build its seek index.
+    The reading position of the current file is not changed.
+*/
+local int unz64local_BuildSeekIndex(unz64_s* s, ZPOS64_T span, unz64_seek_index** pseek_index)
+{
+    file_in_zip64_read_info_s* pfile_in_zip_read_info = s->pfile_in_zip_read;
+    unz64_seek_index* seek_index;
+    z_stream stream;
+    unsigned char* window;
+    unsigned char* input;
+    unsigned char* last_window;
+    ZPOS64_T total_in = 0;
+    ZPOS64_T total_out = 0;
+    ZPOS64_T last = 0;
+    ZPOS64_T rest_read_compressed = pfile_in_zip_read_info->rest_read_compressed_start;
+    ZPOS64_T pos_in_zipfile = pfile_in_zip_read_info->pos_in_zipfile_start;
+    int err = Z_OK;
+
+    seek_index = unz64local_AllocSeekIndex(&s->allocator,span);
+    window = (unsigned char*)call_zalloc_mem(&s->allocator,UNZ_SEEK_WINDOW_SIZE);
+    last_window = (unsigned char*)call_zalloc_mem(&s->allocator,UNZ_SEEK_WINDOW_SIZE);
+    input = (unsigned char*)call_zalloc_mem(&s->allocator,s->read_buffer_size);
+    if ((seek_index==NULL) || (window==NULL) || (last_window==NULL) || (input==NULL))
     {
-        if (pfile_in_zip_read_info->crc32 != pfile_in_zip_read_info->crc32_wait)
-            err=UNZ_CRCERROR;
+        call_zfree_mem(&s->allocator,input);
+        call_zfree_mem(&s->allocator,last_window);
+        call_zfree_mem(&s->allocator,window);
+        unz64local_FreeSeekIndex(&s->allocator,seek_index);
+        return UNZ_INTERNALERROR;
     }
 
+    stream.zalloc = zlib_alloc_from_allocator;
+    stream.zfree = zlib_free_from_allocator;
+    stream.opaque = (voidpf)&s->allocator;
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+    if (inflateInit2(&stream, -MAX_WBITS)!=Z_OK)
+        err = Z_MEM_ERROR;
 
-    TRYFREE(pfile_in_zip_read_info->read_buffer);
-    pfile_in_zip_read_info->read_buffer = NULL;
-    if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
-        inflateEnd(&pfile_in_zip_read_info->stream);
-#ifdef HAVE_BZIP2
-    else if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
-        BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
-#endif
+    stream.avail_out = 0;
+    while (err==Z_OK)
+    {
+        if ((stream.avail_in==0) && (rest_read_compressed>0))
+        {
+            uInt uReadThis = (uInt)s->read_buffer_size;
+            if (rest_read_compressed<uReadThis)
+                uReadThis = (uInt)rest_read_compressed;
+            if (unz64local_ReadAt(s,pos_in_zipfile+pfile_in_zip_read_info->byte_before_the_zipfile,
+                                  input,uReadThis)!=uReadThis)
+            {
+                err = Z_ERRNO;
+                break;
+            }
+            pos_in_zipfile += uReadThis;
+            rest_read_compressed -= uReadThis;
+            stream.next_in = input;
+            stream.avail_in = uReadThis;
+        }
+
+        if (stream.avail_out==0)
+        {
+            stream.next_out = window;
+            stream.avail_out = UNZ_SEEK_WINDOW_SIZE;
+        }
 
+        /* stop at the end of each deflate block */
+        total_in += stream.avail_in;
+        total_out += stream.avail_out;
+        err = inflate(&stream, Z_BLOCK);
+        total_in -= stream.avail_in;
+        total_out -= stream.avail_out;
+        if (err==Z_NEED_DICT)
+            err = Z_DATA_ERROR;
+        if (err==Z_STREAM_END)
+            break;
+        if (err==Z_BUF_ERROR)
+            err = ((stream.avail_in==0) && (rest_read_compressed==0)) ? Z_DATA_ERROR : Z_OK;
 
-    pfile_in_zip_read_info->stream_initialised = 0;
-    TRYFREE(pfile_in_zip_read_info);
+        /* at the end of a block (and not the last one), add a checkpoint every span bytes */
+        if ((err==Z_OK) && ((stream.data_type & 128)!=0) && ((stream.data_type & 64)==0) &&
+            ((total_out==0) || (total_out-last>span)))
+        {
+            uInt left = stream.avail_out;
+            uInt window_size = (total_out<UNZ_SEEK_WINDOW_SIZE) ? (uInt)total_out : UNZ_SEEK_WINDOW_SIZE;
+
+            /* the window is circular, the last output ends at UNZ_SEEK_WINDOW_SIZE-left */
+            if (left>0)
+                memcpy(last_window,window+UNZ_SEEK_WINDOW_SIZE-left,left);
+            if (left<UNZ_SEEK_WINDOW_SIZE)
+                memcpy(last_window+left,window,UNZ_SEEK_WINDOW_SIZE-left);
+
+            if (unz64local_AddSeekPoint(&s->allocator,seek_index,total_out,total_in,stream.data_type & 7,
+                                        last_window+UNZ_SEEK_WINDOW_SIZE-window_size,window_size)!=UNZ_OK)
+                err = Z_MEM_ERROR;
+            last = total_out;
+        }
+    }
 
-    s->pfile_in_zip_read=NULL;
+    inflateEnd(&stream);
+    call_zfree_mem(&s->allocator,input);
+    call_zfree_mem(&s->allocator,last_window);
+    call_zfree_mem(&s->allocator,window);
 
-    return err;
+    if (err!=Z_STREAM_END)
+    {
+        unz64local_FreeSeekIndex(&s->allocator,seek_index);
+        return (err==Z_ERRNO) ? UNZ_ERRNO : ((err==Z_MEM_ERROR) ? UNZ_INTERNALERROR : UNZ_BADZIPFILE);
+    }
+    *pseek_index = seek_index;
+    return UNZ_OK;
+}
+
+/*
+  Read and drop count bytes of the current file
+*/
+local int unz64local_SkipCurrentFile(unzFile file, ZPOS64_T count)
+{
+    char buf[8192];
+    while (count>0)
+    {
+        unsigned len = sizeof(buf);
+        int err;
+        if (count<len)
+            len = (unsigned)count;
+        err = unzReadCurrentFile(file,buf,len);
+        if (err<0)
+            return err;
+        if (err==0)
+            return UNZ_PARAMERROR;
+        count -= (ZPOS64_T)err;
+    }
+    return UNZ_OK;
 }
 
+/*
+  Restart the reading of the current file at its first byte
+*/
+local int unz64local_RewindCurrentFile(unz64_s* s)
+{
+    file_in_zip64_read_info_s* pfile_in_zip_read_info = s->pfile_in_zip_read;
+
+    if (pfile_in_zip_read_info->stream_initialised==Z_DEFLATED)
+    {
+        if (inflateReset(&pfile_in_zip_read_info->stream)!=Z_OK)
+            return UNZ_INTERNALERROR;
+    }
+#ifdef HAVE_BZIP2
+    else if (pfile_in_zip_read_info->stream_initialised==Z_BZIP2ED)
+        return UNZ_PARAMERROR;
+#endif
+
+    pfile_in_zip_read_info->pos_in_zipfile = pfile_in_zip_read_info->pos_in_zipfile_start;
+    pfile_in_zip_read_info->rest_read_compressed = pfile_in_zip_read_info->rest_read_compressed_start;
+    pfile_in_zip_read_info->rest_read_uncompressed = s->cur_file_info.uncompressed_size;
+    pfile_in_zip_read_info->total_out_64 = 0;
+    pfile_in_zip_read_info->crc32 = 0;
+    pfile_in_zip_read_info->stream.avail_in = 0;
+#    ifndef NOUNCRYPT
+    memcpy(s->keys,pfile_in_zip_read_info->keys_start,sizeof(s->keys));
+#    endif
+    return UNZ_OK;
+}
 
 /*
-  Get the global comment string of the ZipFile, in the szComment buffer.
-  uSizeBuf is the size of the szComment buffer.
-  return the number of byte copied or an error code <0
+  Restart the inflate of the current file at a checkpoint
 */
-extern int ZEXPORT unzGetGlobalComment (unzFile file, char * szComment, uLong uSizeBuf)
+local int unz64local_RestoreSeekPoint(unz64_s* s, const unz64_seek_point* point)
 {
-    unz64_s* s;
-    uLong uReadThis ;
-    if (file==NULL)
-        return (int)UNZ_PARAMERROR;
-    s=(unz64_s*)file;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info = s->pfile_in_zip_read;
+    ZPOS64_T in = point->in - ((point->bits>0) ? 1 : 0);
 
-    uReadThis = uSizeBuf;
-    if (uReadThis>s->gi.size_comment)
-        uReadThis = s->gi.size_comment;
+    if (inflateReset(&pfile_in_zip_read_info->stream)!=Z_OK)
+        return UNZ_INTERNALERROR;
 
-    if (ZSEEK64(s->z_filefunc,s->filestream,s->central_pos+22,ZLIB_FILEFUNC_SEEK_SET)!=0)
-        return UNZ_ERRNO;
+    pfile_in_zip_read_info->pos_in_zipfile = pfile_in_zip_read_info->pos_in_zipfile_start + in;
+    pfile_in_zip_read_info->rest_read_compressed = pfile_in_zip_read_info->rest_read_compressed_start - in;
+    pfile_in_zip_read_info->stream.avail_in = 0;
 
-    if (uReadThis>0)
+    if (point->bits>0)
     {
-      *szComment='\0';
-      if (ZREAD64(s->z_filefunc,s->filestream,szComment,uReadThis)!=uReadThis)
-        return UNZ_ERRNO;
+        unsigned char c;
+        if (unz64local_ReadAt(s,pfile_in_zip_read_info->pos_in_zipfile+pfile_in_zip_read_info->byte_before_the_zipfile,
+                              &c,1)!=1)
+            return UNZ_ERRNO;
+        pfile_in_zip_read_info->pos_in_zipfile++;
+        pfile_in_zip_read_info->rest_read_compressed--;
+        if (inflatePrime(&pfile_in_zip_read_info->stream,point->bits,c >> (8-point->bits))!=Z_OK)
+            return UNZ_INTERNALERROR;
+    }
+    if (point->window_size>0)
+    {
+        if (inflateSetDictionary(&pfile_in_zip_read_info->stream,point->window,point->window_size)!=Z_OK)
+            return UNZ_INTERNALERROR;
     }
 
-    if ((szComment != NULL) && (uSizeBuf > s->gi.size_comment))
-        *(szComment+s->gi.size_comment)='\0';
-    return (int)uReadThis;
+    pfile_in_zip_read_info->total_out_64 = point->out;
+    pfile_in_zip_read_info->rest_read_uncompressed = s->cur_file_info.uncompressed_size - point->out;
+    pfile_in_zip_read_info->check_crc = 0;
+    return UNZ_OK;
 }
 
-/* Additions by RX '2004 */
-extern ZPOS64_T ZEXPORT unzGetOffset64(unzFile file)
+/*
+  Build the seek index of the current file, with a checkpoint every span
+    bytes of uncompressed data
+*/
+extern int ZEXPORT unzBuildCurrentFileSeekIndex (unzFile file, ZPOS64_T span)
 {
     unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    unz64_seek_index* seek_index = NULL;
+    int err;
 
     if (file==NULL)
-          return 0; //UNZ_PARAMERROR;
+        return UNZ_PARAMERROR;
     s=(unz64_s*)file;
-    if (!s->current_file_ok)
-      return 0;
-    if (s->gi.number_entry != 0 && s->gi.number_entry != 0xffff)
-      if (s->num_file==s->gi.number_entry)
-         return 0;
-    return s->pos_in_central_dir;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+    if ((pfile_in_zip_read_info==NULL) || (span==0))
+        return UNZ_PARAMERROR;
+    if ((pfile_in_zip_read_info->stream_initialised!=Z_DEFLATED) || (s->encrypted))
+        return UNZ_PARAMERROR;
+
+    err = unz64local_BuildSeekIndex(s,span,&seek_index);
+    if (err!=UNZ_OK)
+        return err;
+    unz64local_FreeSeekIndex(&s->allocator,pfile_in_zip_read_info->seek_index);
+    pfile_in_zip_read_info->seek_index = seek_index;
+    return UNZ_OK;
 }
 
-extern uLong ZEXPORT unzGetOffset (unzFile file)
+/* little endian values of the seek index files */
+local int unz64local_PutValue(FILE* fp, ZPOS64_T x, int nbByte)
 {
-    ZPOS64_T offset64;
+    unsigned char buf[8];
+    int n;
+    for (n=0;n<nbByte;n++)
+    {
+        buf[n] = (unsigned char)(x & 0xff);
+        x >>= 8;
+    }
+    return (fwrite(buf,1,(size_t)nbByte,fp)==(size_t)nbByte) ? UNZ_OK : UNZ_ERRNO;
+}
 
-    if (file==NULL)
-          return 0; //UNZ_PARAMERROR;
-    offset64 = unzGetOffset64(file);
-    return (uLong)offset64;
+local int unz64local_GetValue(FILE* fp, ZPOS64_T* px, int nbByte)
+{
+    unsigned char buf[8];
+    ZPOS64_T x = 0;
+    int n;
+    if (fread(buf,1,(size_t)nbByte,fp)!=(size_t)nbByte)
+        return UNZ_ERRNO;
+    for (n=nbByte-1;n>=0;n--)
+        x = (x << 8) | buf[n];
+    *px = x;
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzSetOffset64(unzFile file, ZPOS64_T pos)
+#define UNZ_SEEK_INDEX_MAGIC (0x58494b53) /* "SKIX" */
+#define UNZ_SEEK_INDEX_VERSION (1)
+
+/*
+  Write the seek index of the current file to the file path
+*/
+extern int ZEXPORT unzSaveCurrentFileSeekIndex (unzFile file, const char* path)
 {
     unz64_s* s;
-    int err;
+    const unz64_seek_index* seek_index;
+    FILE* fp;
+    uLong i;
+    int err = UNZ_OK;
 
-    if (file==NULL)
+    if (file==NULL || path==NULL)
         return UNZ_PARAMERROR;
     s=(unz64_s*)file;
+    if ((s->pfile_in_zip_read==NULL) || (s->pfile_in_zip_read->seek_index==NULL))
+        return UNZ_PARAMERROR;
+    seek_index = s->pfile_in_zip_read->seek_index;
 
-    s->pos_in_central_dir = pos;
-    s->num_file = s->gi.number_entry;      /* hack */
-    err = unz64local_GetCurrentFileInfoInternal(file,&s->cur_file_info,
-                                              &s->cur_file_info_internal,
-                                              NULL,0,NULL,0,NULL,0);
-    s->current_file_ok = (err == UNZ_OK);
+    fp = fopen(path,"wb");
+    if (fp==NULL)
+        return UNZ_ERRNO;
+
+    /* the header identifies the file the index was built for */
+    if (err==UNZ_OK) err = unz64local_PutValue(fp,UNZ_SEEK_INDEX_MAGIC,4);
+    if (err==UNZ_OK) err = unz64local_PutValue(fp,UNZ_SEEK_INDEX_VERSION,4);
+    if (err==UNZ_OK) err = unz64local_PutValue(fp,s->cur_file_info_internal.offset_curfile,8);
+    if (err==UNZ_OK) err = unz64local_PutValue(fp,s->cur_file_info.crc,4);
+    if (err==UNZ_OK) err = unz64local_PutValue(fp,s->cur_file_info.compressed_size,8);
+    if (err==UNZ_OK) err = unz64local_PutValue(fp,s->cur_file_info.uncompressed_size,8);
+    if (err==UNZ_OK) err = unz64local_PutValue(fp,seek_index->span,8);
+    if (err==UNZ_OK) err = unz64local_PutValue(fp,seek_index->count,8);
+
+    for (i=0;(i<seek_index->count) && (err==UNZ_OK);i++)
+    {
+        const unz64_seek_point* point = &seek_index->points[i];
+        err = unz64local_PutValue(fp,point->out,8);
+        if (err==UNZ_OK) err = unz64local_PutValue(fp,point->in,8);
+        if (err==UNZ_OK) err = unz64local_PutValue(fp,(ZPOS64_T)point->bits,1);
+        if (err==UNZ_OK) err = unz64local_PutValue(fp,point->window_size,4);
+        if ((err==UNZ_OK) && (point->window_size>0) &&
+            (fwrite(point->window,1,point->window_size,fp)!=point->window_size))
+            err = UNZ_ERRNO;
+    }
+
+    if (fclose(fp)!=0)
+        err = UNZ_ERRNO;
     return err;
 }
 
-extern int ZEXPORT unzSetOffset (unzFile file, uLong pos)
+/*
+  Read the seek index of the current file from the file path, written by
+    unzSaveCurrentFileSeekIndex
+*/
+extern int ZEXPORT unzLoadCurrentFileSeekIndex (unzFile file, const char* path)
 {
-    return unzSetOffset64(file,pos);
+    unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    unz64_seek_index* seek_index;
+    FILE* fp;
+    ZPOS64_T magic, version, offset_curfile, crc, compressed_size, uncompressed_size, span, count;
+    ZPOS64_T i;
+    int err = UNZ_OK;
+
+    if (file==NULL || path==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+    if ((pfile_in_zip_read_info==NULL) || (pfile_in_zip_read_info->stream_initialised!=Z_DEFLATED) ||
+        (s->encrypted))
+        return UNZ_PARAMERROR;
+
+    fp = fopen(path,"rb");
+    if (fp==NULL)
+        return UNZ_ERRNO;
+
+    if (err==UNZ_OK) err = unz64local_GetValue(fp,&magic,4);
+    if (err==UNZ_OK) err = unz64local_GetValue(fp,&version,4);
+    if (err==UNZ_OK) err = unz64local_GetValue(fp,&offset_curfile,8);
+    if (err==UNZ_OK) err = unz64local_GetValue(fp,&crc,4);
+    if (err==UNZ_OK) err = unz64local_GetValue(fp,&compressed_size,8);
+    if (err==UNZ_OK) err = unz64local_GetValue(fp,&uncompressed_size,8);
+    if (err==UNZ_OK) err = unz64local_GetValue(fp,&span,8);
+    if (err==UNZ_OK) err = unz64local_GetValue(fp,&count,8);
+
+    /* the index must have been built for this very file */
+    if ((err==UNZ_OK) &&
+        ((magic!=UNZ_SEEK_INDEX_MAGIC) || (version!=UNZ_SEEK_INDEX_VERSION) ||
+         (offset_curfile!=s->cur_file_info_internal.offset_curfile) ||
+         (crc!=s->cur_file_info.crc) ||
+         (compressed_size!=s->cur_file_info.compressed_size) ||
+         (uncompressed_size!=s->cur_file_info.uncompressed_size) ||
+         (span==0) || (count!=(ZPOS64_T)(uLong)count)))
+        err = UNZ_BADZIPFILE;
+
+    seek_index = NULL;
+    if (err==UNZ_OK)
+    {
+        seek_index = unz64local_AllocSeekIndex(&s->allocator,span);
+        if (seek_index==NULL)
+            err = UNZ_INTERNALERROR;
+    }
+
+    for (i=0;(i<count) && (err==UNZ_OK);i++)
+    {
+        ZPOS64_T out, in, bits, window_size;
+        err = unz64local_GetValue(fp,&out,8);
+        if (err==UNZ_OK) err = unz64local_GetValue(fp,&in,8);
+        if (err==UNZ_OK) err = unz64local_GetValue(fp,&bits,1);
+        if (err==UNZ_OK) err = unz64local_GetValue(fp,&window_size,4);
+        if ((err==UNZ_OK) &&
+            ((bits>7) || (window_size>UNZ_SEEK_WINDOW_SIZE) || (out>uncompressed_size) ||
+             (in>compressed_size) || ((bits>0) && (in==0))))
+            err = UNZ_BADZIPFILE;
+        if (err==UNZ_OK)
+            err = unz64local_AddSeekPoint(&s->allocator,seek_index,out,in,(int)bits,NULL,(uInt)window_size);
+        if ((err==UNZ_OK) && (window_size>0) &&
+            (fread(seek_index->points[seek_index->count-1].window,1,(size_t)window_size,fp)!=(size_t)window_size))
+            err = UNZ_ERRNO;
+    }
+    fclose(fp);
+
+    if (err!=UNZ_OK)
+    {
+        unz64local_FreeSeekIndex(&s->allocator,seek_index);
+        return err;
+    }
+    unz64local_FreeSeekIndex(&s->allocator,pfile_in_zip_read_info->seek_index);
+    pfile_in_zip_read_info->seek_index = seek_index;
+    return UNZ_OK;
+}
+
+/*
+  Set the position in the uncompressed data of the current file
+*/
+extern int ZEXPORT unzSeekCurrentFile64 (unzFile file, ZPOS64_T pos)
+{
+    unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    ZPOS64_T size;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+    if (pfile_in_zip_read_info==NULL)
+        return UNZ_PARAMERROR;
+
+    size = (pfile_in_zip_read_info->raw) ? pfile_in_zip_read_info->rest_read_compressed_start
+                                         : s->cur_file_info.uncompressed_size;
+    if (pos>size)
+        return UNZ_PARAMERROR;
+    if (pos==pfile_in_zip_read_info->total_out_64)
+        return UNZ_OK;
+
+    /* stored data, or raw data, not encrypted : jump to the position */
+    if (((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw)) &&
+        (!s->encrypted))
+    {
+        pfile_in_zip_read_info->pos_in_zipfile = pfile_in_zip_read_info->pos_in_zipfile_start + pos;
+        pfile_in_zip_read_info->rest_read_compressed = pfile_in_zip_read_info->rest_read_compressed_start - pos;
+        pfile_in_zip_read_info->rest_read_uncompressed = s->cur_file_info.uncompressed_size - pos;
+        pfile_in_zip_read_info->total_out_64 = pos;
+        pfile_in_zip_read_info->stream.avail_in = 0;
+        pfile_in_zip_read_info->check_crc = 0;
+        return UNZ_OK;
+    }
+
+    /* deflated data : restart at the nearest checkpoint before pos */
+    if ((pfile_in_zip_read_info->stream_initialised==Z_DEFLATED) && (!s->encrypted))
+    {
+        if ((pfile_in_zip_read_info->seek_index==NULL) && (s->seek_index_span>0))
+        {
+            err = unzBuildCurrentFileSeekIndex(file,s->seek_index_span);
+            if (err!=UNZ_OK)
+                return err;
+        }
+
+        if (pfile_in_zip_read_info->seek_index!=NULL)
+        {
+            const unz64_seek_index* seek_index = pfile_in_zip_read_info->seek_index;
+            const unz64_seek_point* point = NULL;
+            uLong lo = 0, hi = seek_index->count;
+
+            /* last checkpoint with out <= pos */
+            while (lo<hi)
+            {
+                uLong mid = lo + (hi-lo)/2;
+                if (seek_index->points[mid].out<=pos)
+                    lo = mid+1;
+                else
+                    hi = mid;
+            }
+            if (lo>0)
+                point = &seek_index->points[lo-1];
+
+            /* going on from the current position is cheaper */
+            if ((point!=NULL) &&
+                ((pos<pfile_in_zip_read_info->total_out_64) || (point->out>pfile_in_zip_read_info->total_out_64)))
+            {
+                err = unz64local_RestoreSeekPoint(s,point);
+                if (err!=UNZ_OK)
+                    return err;
+            }
+        }
+    }
+
+    /* without checkpoint, restart from the beginning of the file */
+    if (pos<pfile_in_zip_read_info->total_out_64)
+    {
+        err = unz64local_RewindCurrentFile(s);
+        if (err!=UNZ_OK)
+            return err;
+    }
+
+    return unz64local_SkipCurrentFile(file,pos-pfile_in_zip_read_info->total_out_64);
+}
+
+/*
+  Close the file in zip opened with unzipOpenCurrentFile
+  Return UNZ_CRCERROR if all the file was read but the CRC is not good
+*/
+extern int ZEXPORT unzCloseCurrentFile (unzFile file)
+{
+    int err=UNZ_OK;
+
+    unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+    if (pfile_in_zip_read_info==NULL)
+        return UNZ_PARAMERROR;
+
+
+    if ((pfile_in_zip_read_info->rest_read_uncompressed == 0) &&
+        (!pfile_in_zip_read_info->raw) &&
+        (pfile_in_zip_read_info->check_crc))
+    {
+        if (pfile_in_zip_read_info->crc32 != pfile_in_zip_read_info->crc32_wait)
+            err=UNZ_CRCERROR;
+    }
+
+
+    unz64local_FreeSeekIndex(&s->allocator,pfile_in_zip_read_info->seek_index);
+    pfile_in_zip_read_info->seek_index = NULL;
+#ifdef HAVE_BZIP2
+    if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
+        BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
+#endif
+
+
+    /* the read buffer and the inflate state are kept for the next file,
+       and freed by unzClose */
+    pfile_in_zip_read_info->stream_initialised = 0;
+    pfile_in_zip_read_info->stream.next_in = NULL;
+    pfile_in_zip_read_info->stream.avail_in = 0;
+    unz64local_FreeReadInfo(&s->allocator,s->pfile_in_zip_read_spare);
+    s->pfile_in_zip_read_spare = pfile_in_zip_read_info;
+
+    s->pfile_in_zip_read=NULL;
+
+    return err;
+}
+
+
+/*
+  Get the global comment string of the ZipFile, in the szComment buffer.
+  uSizeBuf is the size of the szComment buffer.
+  return the number of byte copied or an error code <0
+*/
+extern int ZEXPORT unzGetGlobalComment (unzFile file, char * szComment, uLong uSizeBuf)
+{
+    unz64_s* s;
+    uLong uReadThis ;
+    if (file==NULL)
+        return (int)UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+
+    uReadThis = uSizeBuf;
+    if (uReadThis>s->gi.size_comment)
+        uReadThis = s->gi.size_comment;
+
+    s->stream_pos = UNZ_STREAM_POS_UNKNOWN;
+    if (ZSEEK64(s->z_filefunc,s->filestream,s->central_pos+22,ZLIB_FILEFUNC_SEEK_SET)!=0)
+        return UNZ_ERRNO;
+
+    if (uReadThis>0)
+    {
+      *szComment='\0';
+      if (ZREAD64(s->z_filefunc,s->filestream,szComment,uReadThis)!=uReadThis)
+        return UNZ_ERRNO;
+    }
+
+    if ((szComment != NULL) && (uSizeBuf > s->gi.size_comment))
+        *(szComment+s->gi.size_comment)='\0';
+    return (int)uReadThis;
+}
+
+/* Additions by RX '2004 */
+extern ZPOS64_T ZEXPORT unzGetOffset64(unzFile file)
+{
+    unz64_s* s;
+
+    if (file==NULL)
+          return 0; //UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    if (!s->current_file_ok)
+      return 0;
+    if (s->gi.number_entry != 0 && s->gi.number_entry != 0xffff)
+      if (s->num_file==s->gi.number_entry)
+         return 0;
+    return s->pos_in_central_dir;
+}
+
+extern uLong ZEXPORT unzGetOffset (unzFile file)
+{
+    ZPOS64_T offset64;
+
+    if (file==NULL)
+          return 0; //UNZ_PARAMERROR;
+    offset64 = unzGetOffset64(file);
+    return (uLong)offset64;
+}
+
+extern int ZEXPORT unzSetOffset64(unzFile file, ZPOS64_T pos)
+{
+    unz64_s* s;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+
+    s->pos_in_central_dir = pos;
+    s->num_file = s->gi.number_entry;      /* hack */
+    err = unz64local_GetCurrentFileInfoInternal(file,&s->cur_file_info,
+                                              &s->cur_file_info_internal,
+                                              NULL,0,NULL,0,NULL,0);
+    s->current_file_ok = (err == UNZ_OK);
+    return err;
+}
+
+extern int ZEXPORT unzSetOffset (unzFile file, uLong pos)
+{
+    return unzSetOffset64(file,pos);
+}
+
+/*
+///////////////////////////////////////////
+// Forward-only reading of a zipfile from a stream
+//
+// The local headers are read in order, the central directory is never
+// used, so the zipfile can be read while it arrives (from a pipe or a
+// socket). The sizes of an entry written with a data descriptor are
+// only known when its data has been read.
+*/
+
+#define UNZ_STREAM_ENTRY_NONE (0)    /* no current entry */
+#define UNZ_STREAM_ENTRY_DATA (1)    /* the data of the current entry is being read */
+#define UNZ_STREAM_ENTRY_DONE (2)    /* the data (and data descriptor) of the current entry was read */
+
+typedef struct
+{
+    unz_stream_read_func read_func;  /* function reading the zipfile */
+    voidpf opaque;                   /* opaque parameter of read_func */
+    int end_of_input;                /* 1 once read_func returned 0 */
+
+    unsigned char* buffer;           /* input buffer, filled by read_func */
+    uLong buffer_size;
+    uLong buffer_pos;                /* first byte of buffer not yet used */
+    uLong buffer_len;                /* number of bytes in buffer */
+
+    int entry_state;                 /* UNZ_STREAM_ENTRY_xxx */
+    unz_file_info64 cur_file_info;   /* information of the current entry */
+    char* cur_file_name;             /* file name of the current entry */
+    unsigned char* cur_file_extra;   /* local extra field of the current entry */
+    int size_known;                  /* 0 if the sizes are in a data descriptor */
+    int zip64;                       /* 1 if the local header has a zip64 extra field */
+
+    int opened;                      /* 1 if the current entry was opened */
+    z_stream stream;                 /* zLib stream structure for inflate */
+    int stream_initialised;          /* flag set if stream structure is initialised */
+    const unsigned char* in_next;    /* compressed data given to inflate, not used yet */
+    uLong in_avail;
+    ZPOS64_T rest_read_compressed;   /* number of byte to be read, if size_known */
+    ZPOS64_T total_in;               /* number of compressed bytes read */
+    ZPOS64_T total_out;              /* number of uncompressed bytes read */
+    uLong crc32;                     /* crc32 of all data uncompressed */
+
+    int encrypted;
+#    ifndef NOUNCRYPT
+    unsigned long keys[3];           /* keys defining the pseudo-random sequence */
+    const z_crc_t* pcrc_32_tab;
+    unsigned char* crypt_buffer;     /* decrypted compressed data given to inflate */
+#    endif
+} unz64_stream_s;
+
+/* read more bytes of the zipfile in the buffer, the used bytes are dropped */
+local int unz64local_StreamFill(unz64_stream_s* s)
+{
+    long lRead;
+
+    if (s->buffer_pos>0)
+    {
+        s->buffer_len -= s->buffer_pos;
+        if (s->buffer_len>0)
+            memmove(s->buffer,s->buffer+s->buffer_pos,s->buffer_len);
+        s->buffer_pos = 0;
+    }
+    if ((s->end_of_input) || (s->buffer_len==s->buffer_size))
+        return UNZ_OK;
+
+    lRead = s->read_func(s->opaque,s->buffer+s->buffer_len,s->buffer_size-s->buffer_len);
+    if (lRead<0)
+        return UNZ_ERRNO;
+    if (lRead==0)
+        s->end_of_input = 1;
+    s->buffer_len += (uLong)lRead;
+    return UNZ_OK;
+}
+
+/* make the next len bytes of the zipfile available in the buffer, len<=buffer_size,
+   return UNZ_END_OF_LIST_OF_FILE if the zipfile ends before */
+local int unz64local_StreamNeed(unz64_stream_s* s, uLong len)
+{
+    while (s->buffer_len-s->buffer_pos<len)
+    {
+        if (s->end_of_input)
+            return UNZ_END_OF_LIST_OF_FILE;
+        if (unz64local_StreamFill(s)!=UNZ_OK)
+            return UNZ_ERRNO;
+    }
+    return UNZ_OK;
+}
+
+/* copy the next len bytes of the zipfile to buf */
+local int unz64local_StreamRead(unz64_stream_s* s, unsigned char* buf, uLong len)
+{
+    while (len>0)
+    {
+        uLong uCopy;
+        if (s->buffer_pos==s->buffer_len)
+        {
+            if (s->end_of_input)
+                return UNZ_BADZIPFILE;
+            if (unz64local_StreamFill(s)!=UNZ_OK)
+                return UNZ_ERRNO;
+            continue;
+        }
+        uCopy = s->buffer_len-s->buffer_pos;
+        if (len<uCopy)
+            uCopy = len;
+        memcpy(buf,s->buffer+s->buffer_pos,uCopy);
+        s->buffer_pos += uCopy;
+        buf += uCopy;
+        len -= uCopy;
+    }
+    return UNZ_OK;
+}
+
+/* drop the next len bytes of the zipfile */
+local int unz64local_StreamSkip(unz64_stream_s* s, ZPOS64_T len)
+{
+    while (len>0)
+    {
+        uLong uSkip;
+        if (s->buffer_pos==s->buffer_len)
+        {
+            if (s->end_of_input)
+                return UNZ_BADZIPFILE;
+            if (unz64local_StreamFill(s)!=UNZ_OK)
+                return UNZ_ERRNO;
+            continue;
+        }
+        uSkip = s->buffer_len-s->buffer_pos;
+        if (len<uSkip)
+            uSkip = (uLong)len;
+        s->buffer_pos += uSkip;
+        len -= uSkip;
+    }
+    return UNZ_OK;
+}
+
+local void unz64local_StreamFreeEntry(unz64_stream_s* s)
+{
+    if (s->stream_initialised==Z_DEFLATED)
+        inflateEnd(&s->stream);
+    s->stream_initialised = 0;
+    TRYFREE(s->cur_file_name);
+    s->cur_file_name = NULL;
+    TRYFREE(s->cur_file_extra);
+    s->cur_file_extra = NULL;
+    s->opened = 0;
+    s->encrypted = 0;
+    s->in_avail = 0;
+    s->entry_state = UNZ_STREAM_ENTRY_NONE;
+}
+
+/* read the data descriptor after the data of the current entry */
+local int unz64local_StreamReadDataDescriptor(unz64_stream_s* s)
+{
+    uLong uSizeLength;
+    const unsigned char* p;
+    int err;
+
+    err = unz64local_StreamNeed(s,4);
+    if (err!=UNZ_OK)
+        return (err==UNZ_END_OF_LIST_OF_FILE) ? UNZ_BADZIPFILE : err;
+    /* the signature of the data descriptor is optional */
+    if (unz64local_getLongFromBuffer(s->buffer+s->buffer_pos)==0x08074b50)
+        s->buffer_pos += 4;
+
+    /* the sizes are on 8 bytes in zip64 entries, some writers only know it at the end */
+    uSizeLength = ((s->zip64) || (s->total_in>=0xffffffff) || (s->total_out>=0xffffffff)) ? 8 : 4;
+    err = unz64local_StreamNeed(s,4+2*uSizeLength);
+    if (err!=UNZ_OK)
+        return (err==UNZ_END_OF_LIST_OF_FILE) ? UNZ_BADZIPFILE : err;
+
+    p = s->buffer+s->buffer_pos;
+    s->cur_file_info.crc = unz64local_getLongFromBuffer(p);
+    if (uSizeLength==8)
+    {
+        s->cur_file_info.compressed_size = unz64local_getLong64FromBuffer(p+4);
+        s->cur_file_info.uncompressed_size = unz64local_getLong64FromBuffer(p+12);
+    }
+    else
+    {
+        s->cur_file_info.compressed_size = unz64local_getLongFromBuffer(p+4);
+        s->cur_file_info.uncompressed_size = unz64local_getLongFromBuffer(p+8);
+    }
+    s->buffer_pos += 4+2*uSizeLength;
+    return UNZ_OK;
+}
+
+/* the data of the current entry was read, check it */
+local int unz64local_StreamEndOfData(unz64_stream_s* s)
+{
+    int err = UNZ_OK;
+
+    if (!s->size_known)
+        err = unz64local_StreamReadDataDescriptor(s);
+    s->entry_state = UNZ_STREAM_ENTRY_DONE;
+    if (err!=UNZ_OK)
+        return err;
+
+    if (s->encrypted)
+        s->total_in += 12;
+    if ((s->total_in!=s->cur_file_info.compressed_size) ||
+        (s->total_out!=s->cur_file_info.uncompressed_size))
+        return UNZ_BADZIPFILE;
+    return UNZ_OK;
+}
+
+/* read up to len bytes of uncompressed data of the current entry (opened) */
+local int unz64local_StreamReadData(unz64_stream_s* s, unsigned char* buf, uInt len)
+{
+    uInt iRead = 0;
+    int err;
+
+    while ((iRead<len) && (s->entry_state==UNZ_STREAM_ENTRY_DATA))
+    {
+        /* the next compressed bytes of the zipfile */
+        if (s->in_avail==0)
+        {
+            uLong uAvail;
+            if (s->size_known && (s->rest_read_compressed==0) && (s->stream_initialised!=Z_DEFLATED))
+            {
+                err = unz64local_StreamEndOfData(s);
+                if (err!=UNZ_OK)
+                    return err;
+                break;
+            }
+            if (s->buffer_pos==s->buffer_len)
+            {
+                if (s->end_of_input)
+                    return UNZ_BADZIPFILE;
+                if (unz64local_StreamFill(s)!=UNZ_OK)
+                    return UNZ_ERRNO;
+                continue;
+            }
+
+            uAvail = s->buffer_len-s->buffer_pos;
+            if (s->size_known && (s->rest_read_compressed<uAvail))
+                uAvail = (uLong)s->rest_read_compressed;
+            if (uAvail==0)
+                return Z_DATA_ERROR;
+            if ((s->stream_initialised!=Z_DEFLATED) && (uAvail>len-iRead))
+                uAvail = len-iRead;
+
+            s->in_next = s->buffer+s->buffer_pos;
+#            ifndef NOUNCRYPT
+            if (s->encrypted)
+            {
+                memcpy(s->crypt_buffer,s->buffer+s->buffer_pos,uAvail);
+                zdecode_block(s->keys,s->pcrc_32_tab,s->crypt_buffer,uAvail);
+                s->in_next = s->crypt_buffer;
+            }
+#            endif
+            s->in_avail = uAvail;
+            s->buffer_pos += uAvail;
+            s->rest_read_compressed -= uAvail;
+            s->total_in += uAvail;
+        }
+
+        if (s->stream_initialised!=Z_DEFLATED)
+        {
+            /* stored, the chunk fits in buf */
+            uInt uDoCopy = (uInt)s->in_avail;
+            memcpy(buf+iRead,s->in_next,uDoCopy);
+            s->crc32 = mzCrc32(s->crc32,buf+iRead,uDoCopy);
+            s->total_out += uDoCopy;
+            s->in_avail = 0;
+            iRead += uDoCopy;
+        }
+        else
+        {
+            uLong uTotalOutBefore = s->stream.total_out;
+            uInt uOutThis;
+
+            s->stream.next_in = (Bytef*)s->in_next;
+            s->stream.avail_in = (uInt)s->in_avail;
+            s->stream.next_out = (Bytef*)(buf+iRead);
+            s->stream.avail_out = len-iRead;
+            err = inflate(&s->stream,Z_SYNC_FLUSH);
+            uOutThis = (uInt)(s->stream.total_out-uTotalOutBefore);
+
+            s->crc32 = mzCrc32(s->crc32,buf+iRead,uOutThis);
+            s->total_out += uOutThis;
+            iRead += uOutThis;
+            s->in_next = s->stream.next_in;
+            s->in_avail = s->stream.avail_in;
+
+            if (err==Z_STREAM_END)
+            {
+                /* the bytes after the deflate stream belong to the data descriptor
+                   or to the next entry, give them back */
+                s->buffer_pos -= s->in_avail;
+                s->rest_read_compressed += s->in_avail;
+                s->total_in -= s->in_avail;
+                s->in_avail = 0;
+                if (s->size_known && (s->rest_read_compressed>0))
+                    return Z_DATA_ERROR;
+                err = unz64local_StreamEndOfData(s);
+                if (err!=UNZ_OK)
+                    return err;
+                break;
+            }
+            if ((err==Z_BUF_ERROR) && (uOutThis==0) && (s->in_avail>0))
+                return Z_DATA_ERROR;
+            if ((err!=Z_OK) && (err!=Z_BUF_ERROR))
+                return (err==Z_NEED_DICT) ? Z_DATA_ERROR : err;
+        }
+    }
+    return (int)iRead;
+}
+
+/* prepare the reading of the data of the current entry */
+local int unz64local_StreamOpenData(unz64_stream_s* s, const char* password)
+{
+    if ((s->cur_file_info.compression_method!=0) &&
+        (s->cur_file_info.compression_method!=Z_DEFLATED))
+        return UNZ_BADZIPFILE;
+    /* the end of stored data can only be known from its size */
+    if ((s->cur_file_info.compression_method==0) && (!s->size_known))
+        return UNZ_BADZIPFILE;
+
+    if ((s->cur_file_info.compression_method==Z_DEFLATED) && (s->stream_initialised!=Z_DEFLATED))
+    {
+        s->stream.zalloc = (alloc_func)0;
+        s->stream.zfree = (free_func)0;
+        s->stream.opaque = (voidpf)0;
+        s->stream.next_in = 0;
+        s->stream.avail_in = 0;
+        if (inflateInit2(&s->stream,-MAX_WBITS)!=Z_OK)
+            return UNZ_INTERNALERROR;
+        s->stream_initialised = Z_DEFLATED;
+    }
+
+#    ifndef NOUNCRYPT
+    if (password != NULL)
+    {
+        if (s->size_known && (s->rest_read_compressed<12))
+            return UNZ_BADZIPFILE;
+        if (unz64local_StreamNeed(s,12)!=UNZ_OK)
+            return UNZ_BADZIPFILE;
+        if (s->crypt_buffer==NULL)
+        {
+            s->crypt_buffer = (unsigned char*)ALLOC(s->buffer_size);
+            if (s->crypt_buffer==NULL)
+                return UNZ_INTERNALERROR;
+        }
+        s->pcrc_32_tab = get_crc_table();
+        init_keys(password,s->keys,s->pcrc_32_tab);
+        zdecode_block(s->keys,s->pcrc_32_tab,s->buffer+s->buffer_pos,12);
+        s->buffer_pos += 12;
+        s->rest_read_compressed -= 12;
+        s->encrypted = 1;
+    }
+#    endif
+
+    s->opened = 1;
+    return UNZ_OK;
+}
+
+/* skip the rest of the data of the current entry */
+local int unz64local_StreamSkipData(unz64_stream_s* s)
+{
+    unsigned char buf[4096];
+    int err;
+
+    if (s->entry_state!=UNZ_STREAM_ENTRY_DATA)
+        return UNZ_OK;
+
+    if (s->size_known)
+    {
+        /* the compressed data does not have to be read */
+        err = unz64local_StreamSkip(s,s->rest_read_compressed);
+        s->entry_state = UNZ_STREAM_ENTRY_DONE;
+        return err;
+    }
+
+    /* a data descriptor follows the data, the deflate stream gives its end */
+    if (!s->opened)
+    {
+        if ((s->cur_file_info.flag & 1) != 0)
+            return UNZ_BADZIPFILE;
+        err = unz64local_StreamOpenData(s,NULL);
+        if (err!=UNZ_OK)
+            return err;
+    }
+    do
+    {
+        err = unz64local_StreamReadData(s,buf,sizeof(buf));
+    } while (err>0);
+    return err;
+}
+
+/*
+  Open a zipfile read by read_func from its first byte
+*/
+extern unzStreamFile ZEXPORT unzStreamOpen (unz_stream_read_func read_func, voidpf opaque)
+{
+    unz64_stream_s* s;
+
+    if (read_func==NULL)
+        return NULL;
+    s = (unz64_stream_s*)ALLOC(sizeof(unz64_stream_s));
+    if (s==NULL)
+        return NULL;
+    memset(s,0,sizeof(unz64_stream_s));
+    s->read_func = read_func;
+    s->opaque = opaque;
+    s->buffer_size = UNZ_BUFSIZE;
+    s->buffer = (unsigned char*)ALLOC(s->buffer_size);
+    if (s->buffer==NULL)
+    {
+        TRYFREE(s);
+        return NULL;
+    }
+    return (unzStreamFile)s;
+}
+
+/*
+  Go to the next entry of the zipfile, skipping the rest of the current one
+*/
+extern int ZEXPORT unzStreamGoToNextFile (unzStreamFile file)
+{
+    unz64_stream_s* s;
+    const unsigned char* p;
+    uLong uMagic, uSizeFileName, uSizeExtraField;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_stream_s*)file;
+
+    err = unz64local_StreamSkipData(s);
+    unz64local_StreamFreeEntry(s);
+    if (err!=UNZ_OK)
+        return err;
+
+    err = unz64local_StreamNeed(s,4);
+    if (err==UNZ_END_OF_LIST_OF_FILE)
+        return UNZ_END_OF_LIST_OF_FILE;
+    if (err!=UNZ_OK)
+        return err;
+
+    /* the zipfile of a split archive starts with the signature of a data descriptor */
+    uMagic = unz64local_getLongFromBuffer(s->buffer+s->buffer_pos);
+    if (uMagic==0x08074b50)
+    {
+        s->buffer_pos += 4;
+        err = unz64local_StreamNeed(s,4);
+        if (err==UNZ_END_OF_LIST_OF_FILE)
+            return UNZ_END_OF_LIST_OF_FILE;
+        if (err!=UNZ_OK)
+            return err;
+        uMagic = unz64local_getLongFromBuffer(s->buffer+s->buffer_pos);
+    }
+
+    /* the central directory comes after the last entry */
+    if ((uMagic==0x02014b50) || (uMagic==0x06054b50) || (uMagic==0x06064b50))
+        return UNZ_END_OF_LIST_OF_FILE;
+    if (uMagic!=0x04034b50)
+        return UNZ_BADZIPFILE;
+
+    err = unz64local_StreamNeed(s,SIZEZIPLOCALHEADER);
+    if (err!=UNZ_OK)
+        return (err==UNZ_END_OF_LIST_OF_FILE) ? UNZ_BADZIPFILE : err;
+
+    p = s->buffer+s->buffer_pos;
+    memset(&s->cur_file_info,0,sizeof(unz_file_info64));
+    s->cur_file_info.version_needed = unz64local_getShortFromBuffer(p+4);
+    s->cur_file_info.flag = unz64local_getShortFromBuffer(p+6);
+    s->cur_file_info.compression_method = unz64local_getShortFromBuffer(p+8);
+    s->cur_file_info.dosDate = unz64local_getLongFromBuffer(p+10);
+    unz64local_DosDateToTmuDate(s->cur_file_info.dosDate, &s->cur_file_info.tmu_date);
+    s->cur_file_info.crc = unz64local_getLongFromBuffer(p+14);
+    s->cur_file_info.compressed_size = unz64local_getLongFromBuffer(p+18);
+    s->cur_file_info.uncompressed_size = unz64local_getLongFromBuffer(p+22);
+    uSizeFileName = unz64local_getShortFromBuffer(p+26);
+    uSizeExtraField = unz64local_getShortFromBuffer(p+28);
+    s->cur_file_info.size_filename = uSizeFileName;
+    s->cur_file_info.size_file_extra = uSizeExtraField;
+    s->buffer_pos += SIZEZIPLOCALHEADER;
+
+    /* the file name and the extra field can be larger than the buffer */
+    s->cur_file_name = (char*)ALLOC(uSizeFileName+1);
+    s->cur_file_extra = (unsigned char*)ALLOC(uSizeExtraField+1);
+    if ((s->cur_file_name==NULL) || (s->cur_file_extra==NULL))
+        return UNZ_INTERNALERROR;
+    err = unz64local_StreamRead(s,(unsigned char*)s->cur_file_name,uSizeFileName);
+    if (err!=UNZ_OK)
+        return err;
+    s->cur_file_name[uSizeFileName] = '\0';
+    err = unz64local_StreamRead(s,s->cur_file_extra,uSizeExtraField);
+    if (err!=UNZ_OK)
+        return err;
+
+    /* the zip64 extra field of a local header has both sizes */
+    s->zip64 = 0;
+    p = s->cur_file_extra;
+    while (p+4<=s->cur_file_extra+uSizeExtraField)
+    {
+        uLong headerId = unz64local_getShortFromBuffer(p);
+        uLong dataSize = unz64local_getShortFromBuffer(p+2);
+        const unsigned char* data = p+4;
+
+        if (data+dataSize>s->cur_file_extra+uSizeExtraField)
+            break;
+        if (headerId==0x0001)
+        {
+            s->zip64 = 1;
+            if ((s->cur_file_info.uncompressed_size==0xffffffff) && (data+8<=p+4+dataSize))
+            {
+                s->cur_file_info.uncompressed_size = unz64local_getLong64FromBuffer(data);
+                data += 8;
+            }
+            if ((s->cur_file_info.compressed_size==0xffffffff) && (data+8<=p+4+dataSize))
+                s->cur_file_info.compressed_size = unz64local_getLong64FromBuffer(data);
+        }
+        p += 4+dataSize;
+    }
+
+    s->size_known = ((s->cur_file_info.flag & 8) == 0);
+    s->rest_read_compressed = s->cur_file_info.compressed_size;
+    s->total_in = 0;
+    s->total_out = 0;
+    s->crc32 = 0;
+    s->entry_state = UNZ_STREAM_ENTRY_DATA;
+    return UNZ_OK;
+}
+
+/*
+  Get Info about the current entry, from its local header
+*/
+extern int ZEXPORT unzStreamGetCurrentFileInfo64 (unzStreamFile file,
+                                                  unz_file_info64* pfile_info,
+                                                  char* szFileName,
+                                                  uLong fileNameBufferSize,
+                                                  void* extraField,
+                                                  uLong extraFieldBufferSize)
+{
+    unz64_stream_s* s;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_stream_s*)file;
+    if (s->entry_state==UNZ_STREAM_ENTRY_NONE)
+        return UNZ_END_OF_LIST_OF_FILE;
+
+    if (pfile_info!=NULL)
+        *pfile_info = s->cur_file_info;
+
+    if ((szFileName!=NULL) && (fileNameBufferSize>0))
+    {
+        uLong uSizeRead = s->cur_file_info.size_filename;
+        if (uSizeRead>=fileNameBufferSize)
+            uSizeRead = fileNameBufferSize-1;
+        memcpy(szFileName,s->cur_file_name,uSizeRead);
+        szFileName[uSizeRead] = '\0';
+    }
+
+    if ((extraField!=NULL) && (extraFieldBufferSize>0))
+    {
+        uLong uSizeRead = s->cur_file_info.size_file_extra;
+        if (uSizeRead>extraFieldBufferSize)
+            uSizeRead = extraFieldBufferSize;
+        memcpy(extraField,s->cur_file_extra,uSizeRead);
+    }
+    return UNZ_OK;
+}
+
+/*
+  Open the current entry for reading data
+*/
+extern int ZEXPORT unzStreamOpenCurrentFilePassword (unzStreamFile file, const char* password)
+{
+    unz64_stream_s* s;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_stream_s*)file;
+    if ((s->entry_state!=UNZ_STREAM_ENTRY_DATA) || (s->opened) || (s->total_in>0))
+        return UNZ_PARAMERROR;
+    return unz64local_StreamOpenData(s,password);
+}
+
+extern int ZEXPORT unzStreamOpenCurrentFile (unzStreamFile file)
+{
+    return unzStreamOpenCurrentFilePassword(file, NULL);
+}
+
+/*
+  Read bytes from the current entry
+*/
+extern int ZEXPORT unzStreamReadCurrentFile (unzStreamFile file, voidp buf, unsigned len)
+{
+    unz64_stream_s* s;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_stream_s*)file;
+    if (!s->opened)
+        return UNZ_PARAMERROR;
+    if ((buf==NULL) && (len>0))
+        return UNZ_PARAMERROR;
+    if (s->entry_state!=UNZ_STREAM_ENTRY_DATA)
+        return 0;
+    return unz64local_StreamReadData(s,(unsigned char*)buf,(uInt)len);
+}
+
+/*
+  Close the current entry, checking its CRC if all its data was read
+*/
+extern int ZEXPORT unzStreamCloseCurrentFile (unzStreamFile file)
+{
+    unz64_stream_s* s;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_stream_s*)file;
+    if (!s->opened)
+        return UNZ_PARAMERROR;
+
+    if ((s->entry_state==UNZ_STREAM_ENTRY_DONE) && (s->crc32!=s->cur_file_info.crc))
+        return UNZ_CRCERROR;
+    return UNZ_OK;
+}
+
+/*
+  Close the zipfile, the remaining input is not read
+*/
+extern int ZEXPORT unzStreamClose (unzStreamFile file)
+{
+    unz64_stream_s* s;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_stream_s*)file;
+
+    unz64local_StreamFreeEntry(s);
+    TRYFREE(s->buffer);
+#    ifndef NOUNCRYPT
+    TRYFREE(s->crypt_buffer);
+#    endif
+    TRYFREE(s);
+    return UNZ_OK;
 }
@@ -195,6 +195,50 @@ extern unzFile ZEXPORT unzOpen2_64 OF((const void *path,
       for read/write the zip file (see ioapi.h)
 */
 
+/* unz_open_options contain the options of unzOpen3, a field left to 0 takes
+   its default value */
+typedef struct unz_open_options_s
+{
+    uLong read_buffer_size;     /* size of the buffer used to read compressed data,
+                                   16384 by default */
+    ZPOS64_T seek_index_span;   /* if not 0, the first unzSeekCurrentFile64 in a deflated
+                                   file builds a seek index with a checkpoint every
+                                   seek_index_span bytes, see unzBuildCurrentFileSeekIndex */
+    uLong read_ahead_depth;     /* if not 0, the system is asked to read in advance the
+                                   next read_ahead_depth read buffers of the current file
+                                   (see call_zadvise64), so that reading the disk and
+                                   inflating overlap */
+    const zlib_allocator_def* allocator; /* allocator of the internal memory of the handle
+                                   and of its zlib streams, malloc by default. The
+                                   memory given to the caller (unzGetDirectory,
+                                   unzReadEntryToBuffer) still comes from malloc */
+} unz_open_options;
+
+extern unzFile ZEXPORT unzOpen3 OF((const void *path,
+                                    zlib_filefunc64_def* pzlib_filefunc_def,
+                                    const unz_open_options* options));
+/*
+   Open a Zip file, like unzOpen2_64, with the options given in *options
+     (options can be NULL for the default values)
+   An allocator with zrelease_mem (fill_arena_allocator) belongs to the handle
+     from then on : it is released by unzClose, or at once if the zipfile cannot
+     be opened.
+*/
+
+extern unzFile ZEXPORT unzOpenClone OF((unzFile file));
+/*
+   Open a new handle on the zipfile of an opened handle, without reading its
+     central directory again : the directory, and the filename index if it was
+     built, are shared (read-only) by both handles.
+   Each handle has its own stream position and current file, so that several
+     threads can read several files of the same zipfile at the same time, one
+     handle per thread. The zipfile must be opened with the fill_pread_filefunc64
+     or fill_mmap_filefunc64 backend (see ioapi.h), and not with an allocator
+     released at close (fill_arena_allocator), else NULL is returned.
+   Build the filename index before cloning to share it. Each handle is closed
+     with unzClose.
+*/
+
 extern int ZEXPORT unzClose OF((unzFile file));
 /*
   Close a ZipFile opened with unzipOpen.
@@ -251,6 +295,14 @@ extern int ZEXPORT unzLocateFile OF((unzFile file,
   UNZ_END_OF_LIST_OF_FILE if the file is not found
 */
 
+extern int ZEXPORT unzBuildFileNameIndex OF((unzFile file));
+/*
+  Build an index of the filenames of the zipfile (a hash table over the central
+    directory), used by unzLocateFile and unzLocateFiles instead of a scan of
+    the whole directory. The index is freed by unzClose.
+  return UNZ_OK if there is no problem
+*/
+
 
 /* ****************************************** */
 /* Ryan supplied functions */
@@ -283,6 +335,109 @@ extern int ZEXPORT unzGoToFilePos64(
     unzFile file,
     const unz64_file_pos* file_pos);
 
+extern int ZEXPORT unzLocateFiles OF((unzFile file,
+                     const char* const* szFileNames,
+                     uLong count,
+                     int iCaseSensitivity,
+                     unz64_file_pos* file_pos));
+/*
+  Locate count filenames at once, for the iCaseSensitivity signification see
+    unzStringFileNameCompare. The current file is not changed: file_pos[i]
+    receives the position of szFileNames[i], to be used with unzGoToFilePos64,
+    or zero if the file is not found.
+  return the number of files found, or a negative error code
+*/
+
+/* Callback of unzSelectFiles, return non-zero to select the file.
+   szFileName and file_info come from the central directory only. */
+typedef int (*unz_select_func) OF((voidpf opaque,
+                                   const char* szFileName,
+                                   const unz_file_info64* file_info));
+
+extern int ZEXPORT unzSelectFiles OF((unzFile file,
+                     unz_select_func select_func,
+                     voidpf opaque,
+                     unz64_file_pos** pfile_pos,
+                     ZPOS64_T* pcount));
+/*
+  List the files of the zipfile selected by select_func, which is called for
+    every file of the central directory. No local header is read, and the
+    current file is not changed.
+  *pfile_pos receives the positions of the *pcount selected files, in the order
+    of the zipfile, to be used with unzGoToFilePos64 ; it must be freed with
+    free() (it is NULL if no file is selected).
+  return UNZ_OK if there is no problem
+*/
+
+extern int ZEXPORT unzSelectFilesWithPrefix OF((unzFile file,
+                     const char* szPrefix,
+                     int iCaseSensitivity,
+                     unz64_file_pos** pfile_pos,
+                     ZPOS64_T* pcount));
+/*
+  unzSelectFiles for the files whose name starts with szPrefix, as
+    "res/fr.lproj/" for a directory and all its content.
+  For the iCaseSensitivity signification, see unzStringFileNameCompare
+*/
+
+extern int ZEXPORT unzSelectFilesMatching OF((unzFile file,
+                     const char* szPattern,
+                     int iCaseSensitivity,
+                     unz64_file_pos** pfile_pos,
+                     ZPOS64_T* pcount));
+/*
+  unzSelectFiles for the files whose name matches the glob pattern szPattern,
+    see unzGlobMatch.
+  For the iCaseSensitivity signification, see unzStringFileNameCompare
+*/
+
+extern int ZEXPORT unzGlobMatch OF((const char* szPattern,
+                     const char* szFileName,
+                     int iCaseSensitivity));
+/*
+  Match a filename against a glob pattern, where
+    ? matches one character other than /
+    * matches any characters other than /
+    ** matches any characters, / included, and the / following it is optional
+    [abc], [a-z] match one of the characters, [!abc] or [^abc] one other
+    \ makes the next character match itself
+  return 1 if szFileName matches szPattern, 0 otherwise
+*/
+
+/* unz_directory contain the main information of all the files of the zipfile,
+   one array per field, entry i being the i-th file of the central directory */
+typedef struct unz_directory_s
+{
+    ZPOS64_T number_entry;          /* number of files, size of the arrays */
+    ZPOS64_T* pos_in_zip_directory; /* for unzGoToFilePos64, with num_of_file i */
+    ZPOS64_T* offset_local_header;  /* offset of the local header in the zipfile */
+    ZPOS64_T* compressed_size;      /* compressed size */
+    ZPOS64_T* uncompressed_size;    /* uncompressed size */
+    uLong* crc;                     /* crc-32 */
+    uLong* dosDate;                 /* last mod file date in Dos fmt */
+    uLong* compression_method;      /* compression method */
+    uLong* flag;                    /* general purpose bit flag */
+    uLong* external_fa;             /* external file attributes */
+    uLong* filename_offset;         /* number_entry+1 offsets in filenames, the name
+                                       of the file i is filenames+filename_offset[i] */
+    char* filenames;                /* the file names, each one ended by a '\0' */
+} unz_directory;
+
+extern int ZEXPORT unzGetDirectory OF((unzFile file, unz_directory** pdirectory));
+/*
+  Decode the whole central directory (already in memory) at once, in a table
+    allocated as a single block: the sizes of the entries, and the file names
+    packed one after the other.
+  The current file is not changed.
+  *pdirectory must be freed with unzFreeDirectory.
+  return UNZ_OK if there is no problem
+*/
+
+extern void ZEXPORT unzFreeDirectory OF((unz_directory* directory));
+/*
+  Free a table returned by unzGetDirectory
+*/
+
 /* ****************************************** */
 
 extern int ZEXPORT unzGetCurrentFileInfo64 OF((unzFile file,
@@ -369,6 +524,36 @@ extern int ZEXPORT unzOpenCurrentFile3 OF((unzFile file,
          but you CANNOT set method parameter as NULL
 */
 
+extern int ZEXPORT unzGetCurrentFileMappedData OF((unzFile file,
+                                           const void** pdata,
+                                           ZPOS64_T* psize));
+/*
+  Give in *pdata and *psize the data of the current file, in place in the zipfile
+    mapped in memory, without any copy. The zipfile must be opened by unzOpen2_64
+    with fill_mmap_filefunc64, and the file must be stored (method 0) and not
+    encrypted, else UNZ_PARAMERROR is returned.
+  The pointer remains valid until unzClose. The CRC is not checked.
+  Deflated files of a mapped zipfile are read with unzReadCurrentFile, which
+    then inflates directly from the mapped bytes.
+*/
+
+extern int ZEXPORT unzReadEntryToBuffer OF((unzFile file,
+                                            const char* szFileName,
+                                            int iCaseSensitivity,
+                                            void** pbuf,
+                                            ZPOS64_T* plen));
+/*
+  Locate the file szFileName (like unzLocateFile, for the iCaseSensitivity
+    signification see unzStringFileNameCompare) and read it whole in *pbuf,
+    *plen bytes.
+  The buffer is allocated once with exactly the uncompressed size, and a deflated
+    file is inflated in a single call straight into it. The caller frees it
+    with free().
+  The file becomes the current file. Return UNZ_OK, UNZ_END_OF_LIST_OF_FILE if
+    the file is not found, UNZ_PARAMERROR if it is encrypted, UNZ_CRCERROR if
+    the CRC is not good, or another error.
+*/
+
 
 extern int ZEXPORT unzCloseCurrentFile OF((unzFile file));
 /*
@@ -402,6 +587,39 @@ extern int ZEXPORT unzeof OF((unzFile file));
   return 1 if the end of file was reached, 0 elsewhere
 */
 
+extern int ZEXPORT unzSeekCurrentFile64 OF((unzFile file, ZPOS64_T pos));
+/*
+  Set the position in uncompressed data of the current file (or in the raw
+    data if the file was opened raw), the next unzReadCurrentFile reads from pos.
+  Stored files are positioned directly. A deflated file restarts from the
+    nearest checkpoint of its seek index when it has one, else it is read
+    again from its beginning (or from the current position when pos is after it).
+  Once a seek was done, the CRC of the file is no longer checked by
+    unzCloseCurrentFile.
+  return UNZ_OK if the position was set, UNZ_PARAMERROR if pos is after the end
+    of the file, <0 with error code if there is an error
+*/
+
+extern int ZEXPORT unzBuildCurrentFileSeekIndex OF((unzFile file, ZPOS64_T span));
+/*
+  Build the seek index of the current file (opened by unzOpenCurrentFile, deflated
+    and not encrypted), with a checkpoint about every span bytes of uncompressed data.
+  The whole file is decompressed once, each checkpoint takes up to 32K of memory.
+  The reading position of the current file is not changed.
+  The index is freed by unzCloseCurrentFile.
+  return UNZ_OK if the index was built, <0 with error code if there is an error
+*/
+
+extern int ZEXPORT unzSaveCurrentFileSeekIndex OF((unzFile file, const char* path));
+extern int ZEXPORT unzLoadCurrentFileSeekIndex OF((unzFile file, const char* path));
+/*
+  Write the seek index of the current file to the file path, or read it back,
+    to avoid building it again when the file is opened later.
+  unzLoadCurrentFileSeekIndex returns UNZ_BADZIPFILE if the index was not built
+    for the current file of this zipfile.
+  return UNZ_OK if there is no problem, <0 with error code if there is an error
+*/
+
 extern int ZEXPORT unzGetLocalExtrafield OF((unzFile file,
                                              voidp buf,
                                              unsigned len));
@@ -428,6 +646,84 @@ extern uLong ZEXPORT unzGetOffset (unzFile file);
 extern int ZEXPORT unzSetOffset64 (unzFile file, ZPOS64_T pos);
 extern int ZEXPORT unzSetOffset (unzFile file, uLong pos);
 
+/***************************************************************************/
+/* Forward-only reading of a zipfile from a stream (a pipe, a socket...)
+   The entries are read in order from their local header, without seeking and
+   without the central directory, so they can be extracted while the zipfile
+   is arriving. */
+
+typedef voidp unzStreamFile;
+
+typedef long (*unz_stream_read_func) OF((voidpf opaque, void* buf, uLong size));
+/*
+  Read up to size bytes of the zipfile in buf.
+  return the number of bytes read, 0 at the end of the zipfile, <0 if there is an error
+*/
+
+extern unzStreamFile ZEXPORT unzStreamOpen OF((unz_stream_read_func read_func, voidpf opaque));
+/*
+  Open a zipfile read with read_func from its first byte.
+  There is no current entry, call unzStreamGoToNextFile to read the first one.
+  return NULL if there is an error
+*/
+
+extern int ZEXPORT unzStreamGoToNextFile OF((unzStreamFile file));
+/*
+  Skip the rest of the current entry and read the local header of the next one.
+  An entry written with a data descriptor (flag bit 3) can only be skipped by
+    decompressing it, so it can't be skipped if it is stored, or if it is
+    encrypted and was not opened with its password.
+  return UNZ_OK if there is no problem
+  return UNZ_END_OF_LIST_OF_FILE when the central directory or the end of the
+    zipfile was reached
+*/
+
+extern int ZEXPORT unzStreamGetCurrentFileInfo64 OF((unzStreamFile file,
+                                                     unz_file_info64 *pfile_info,
+                                                     char *szFileName,
+                                                     uLong fileNameBufferSize,
+                                                     void *extraField,
+                                                     uLong extraFieldBufferSize));
+/*
+  Get Info about the current entry, like unzGetCurrentFileInfo64, from its local
+    header (extraField gets the local extra field, there is no comment).
+  For an entry written with a data descriptor, the crc and the sizes are 0 until
+    all its data was read.
+*/
+
+extern int ZEXPORT unzStreamOpenCurrentFile OF((unzStreamFile file));
+extern int ZEXPORT unzStreamOpenCurrentFilePassword OF((unzStreamFile file,
+                                                        const char* password));
+/*
+  Open the current entry for reading data, before any of its data was read.
+  Only stored and deflated entries can be read, stored entries must not
+    have a data descriptor.
+  return UNZ_OK if there is no problem
+*/
+
+extern int ZEXPORT unzStreamReadCurrentFile OF((unzStreamFile file,
+                                                voidp buf,
+                                                unsigned len));
+/*
+  Read bytes from the current entry (opened by unzStreamOpenCurrentFile),
+    like unzReadCurrentFile.
+  return the number of byte copied, 0 at the end of the entry, <0 with error code
+    if there is an error (UNZ_BADZIPFILE if the sizes of the entry don't match
+    the data)
+*/
+
+extern int ZEXPORT unzStreamCloseCurrentFile OF((unzStreamFile file));
+/*
+  Close the current entry opened with unzStreamOpenCurrentFile
+  Return UNZ_CRCERROR if all the entry was read but the CRC is not good
+*/
+
+extern int ZEXPORT unzStreamClose OF((unzStreamFile file));
+/*
+  Close a zipfile opened with unzStreamOpen, the rest of the zipfile is not read.
+  return UNZ_OK if there is no problem.
+*/
+
 
 
 #ifdef __cplusplus
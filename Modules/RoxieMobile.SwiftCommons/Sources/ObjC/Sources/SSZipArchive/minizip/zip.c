@@ -26,8 +26,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 #include "zlib.h"
 #include "zip.h"
+#include "mzcrc32.h"
+
+#if (!defined(_WIN32)) && (!defined(WIN32))
+#include <pthread.h>
+#define MZ_HAVE_PTHREAD
+#endif
 
 #ifdef STDC
 #  include <stddef.h>
@@ -70,6 +77,10 @@
 #define SIZEZIPLOCALHEADER (0x1e)
 */
 
+/* the parallel deflate primes each block with the end of the previous one */
+#define ZIP_DEFLATE_DICT_SIZE (32768)
+#define ZIP_DEFLATE_BLOCK_SIZE (128*1024)
+
 /* I've found an old Unix (a SunOS 4.1.3_U1) without all SEEK_* defined.... */
 
 
@@ -98,7 +109,10 @@
 const char zip_copyright[] =" zip 1.01 Copyright 1998-2004 Gilles Vollant - http://www.winimage.com/zLibDll";
 
 
-#define SIZEDATA_INDATABLOCK (4096-(4*4))
+/* the central directory starts with this capacity, and doubles when full */
+#define ZIP_CENTRALDIR_MIN_CAPACITY (4096)
+/* capacity reserved per file by expected_entries : a header and 64 bytes of name */
+#define ZIP_CENTRALDIR_ENTRY_RESERVE (SIZECENTRALHEADER+64)
 
 #define LOCALHEADERMAGIC    (0x04034b50)
 #define CENTRALHEADERMAGIC  (0x02014b50)
@@ -111,20 +125,12 @@ const char zip_copyright[] =" zip 1.01 Copyright 1998-2004 Gilles Vollant - http
 
 #define SIZECENTRALHEADER (0x2e) /* 46 */
 
-typedef struct linkedlist_datablock_internal_s
-{
-  struct linkedlist_datablock_internal_s* next_datablock;
-  uLong  avail_in_this_block;
-  uLong  filled_in_this_block;
-  uLong  unused; /* for future use and alignement */
-  unsigned char data[SIZEDATA_INDATABLOCK];
-} linkedlist_datablock_internal;
-
-typedef struct linkedlist_data_s
+typedef struct zip64_central_dir_s
 {
-    linkedlist_datablock_internal* first_block;
-    linkedlist_datablock_internal* last_block;
-} linkedlist_data;
+    unsigned char* data;
+    size_t size;                /* bytes of central directory in data */
+    size_t capacity;            /* bytes allocated for data */
+} zip64_central_dir;
 
 
 typedef struct
@@ -155,9 +161,10 @@ typedef struct
     ZPOS64_T pos_zip64extrainfo;
     ZPOS64_T totalCompressedData;
     ZPOS64_T totalUncompressedData;
+    int  parallel;              /* 1 if the file is deflated by the pool of zip64_internal */
 #ifndef NOCRYPT
     unsigned long keys[3];     /* keys defining the pseudo-random sequence */
-    const unsigned long* pcrc_32_tab;
+    const z_crc_t* pcrc_32_tab;
     int crypt_header_size;
 #endif
 } curfile64_info;
@@ -165,8 +172,9 @@ typedef struct
 typedef struct
 {
     zlib_filefunc64_32_def z_filefunc;
+    zlib_allocator_def allocator; /* allocator of the internal memory of the zipfile */
     voidpf filestream;        /* io structore of the zipfile */
-    linkedlist_data central_dir;/* datablock with central dir in construction*/
+    zip64_central_dir central_dir;/* central dir in construction, in one buffer */
     int  in_opened_file_inzip;  /* 1 if a file in the zip is currently writ.*/
     curfile64_info ci;            /* info on the file curretly writing */
 
@@ -174,6 +182,10 @@ typedef struct
     ZPOS64_T add_position_when_writting_offset;
     ZPOS64_T number_entry;
 
+    int deflate_workers;        /* threads of the parallel deflate, 1 or less if none */
+    uLong deflate_block_size;
+    struct zip64_deflate_pool_s* deflate_pool; /* created by the first deflated file */
+
 #ifndef NO_ADDFILEINEXISTINGZIP
     char *globalcomment;
 #endif
@@ -186,90 +198,62 @@ typedef struct
 #include "crypt.h"
 #endif
 
-local linkedlist_datablock_internal* allocate_new_datablock()
+local void init_central_dir(zip64_central_dir* cd)
 {
-    linkedlist_datablock_internal* ldi;
-    ldi = (linkedlist_datablock_internal*)
-                 ALLOC(sizeof(linkedlist_datablock_internal));
-    if (ldi!=NULL)
-    {
-        ldi->next_datablock = NULL ;
-        ldi->filled_in_this_block = 0 ;
-        ldi->avail_in_this_block = SIZEDATA_INDATABLOCK ;
-    }
-    return ldi;
+    cd->data = NULL;
+    cd->size = 0;
+    cd->capacity = 0;
 }
 
-local void free_datablock(linkedlist_datablock_internal* ldi)
+local void free_central_dir(const zlib_allocator_def* pallocator, zip64_central_dir* cd)
 {
-    while (ldi!=NULL)
-    {
-        linkedlist_datablock_internal* ldinext = ldi->next_datablock;
-        TRYFREE(ldi);
-        ldi = ldinext;
-    }
+    if (cd->data!=NULL)
+        call_zfree_mem(pallocator,cd->data);
+    init_central_dir(cd);
 }
 
-local void init_linkedlist(linkedlist_data* ll)
+/* make room for capacity bytes, keeping the data already there ; the allocator
+   has no realloc, the data is copied to a new buffer */
+local int reserve_central_dir(const zlib_allocator_def* pallocator, zip64_central_dir* cd, size_t capacity)
 {
-    ll->first_block = ll->last_block = NULL;
-}
+    unsigned char* data;
 
-local void free_linkedlist(linkedlist_data* ll)
-{
-    free_datablock(ll->first_block);
-    ll->first_block = ll->last_block = NULL;
-}
-
-
-local int add_data_in_datablock(linkedlist_data* ll, const void* buf, uLong len)
-{
-    linkedlist_datablock_internal* ldi;
-    const unsigned char* from_copy;
+    if (capacity <= cd->capacity)
+        return ZIP_OK;
 
-    if (ll==NULL)
+    data = (unsigned char*)call_zalloc_mem(pallocator,capacity);
+    if (data==NULL)
         return ZIP_INTERNALERROR;
+    if (cd->size>0)
+        memcpy(data,cd->data,cd->size);
+    if (cd->data!=NULL)
+        call_zfree_mem(pallocator,cd->data);
+    cd->data = data;
+    cd->capacity = capacity;
+    return ZIP_OK;
+}
 
-    if (ll->last_block == NULL)
-    {
-        ll->first_block = ll->last_block = allocate_new_datablock();
-        if (ll->first_block == NULL)
-            return ZIP_INTERNALERROR;
-    }
-
-    ldi = ll->last_block;
-    from_copy = (unsigned char*)buf;
-
-    while (len>0)
+local int add_data_in_central_dir(const zlib_allocator_def* pallocator, zip64_central_dir* cd, const void* buf, size_t len)
+{
+    if (len > cd->capacity - cd->size)
     {
-        uInt copy_this;
-        uInt i;
-        unsigned char* to_copy;
-
-        if (ldi->avail_in_this_block==0)
-        {
-            ldi->next_datablock = allocate_new_datablock();
-            if (ldi->next_datablock == NULL)
-                return ZIP_INTERNALERROR;
-            ldi = ldi->next_datablock ;
-            ll->last_block = ldi;
-        }
-
-        if (ldi->avail_in_this_block < len)
-            copy_this = (uInt)ldi->avail_in_this_block;
-        else
-            copy_this = (uInt)len;
+        size_t capacity = (cd->capacity>0) ? cd->capacity : ZIP_CENTRALDIR_MIN_CAPACITY;
+        int err;
 
-        to_copy = &(ldi->data[ldi->filled_in_this_block]);
-
-        for (i=0;i<copy_this;i++)
-            *(to_copy+i)=*(from_copy+i);
+        if (cd->size + len < cd->size)
+            return ZIP_INTERNALERROR;
+        while ((capacity < cd->size + len) && (capacity <= ((size_t)-1)/2))
+            capacity *= 2;
+        if (capacity < cd->size + len)
+            capacity = cd->size + len;
 
-        ldi->filled_in_this_block += copy_this;
-        ldi->avail_in_this_block -= copy_this;
-        from_copy += copy_this ;
-        len -= copy_this;
+        err = reserve_central_dir(pallocator,cd,capacity);
+        if (err!=ZIP_OK)
+            return err;
     }
+
+    memcpy(cd->data + cd->size,buf,len);
+    cd->size += len;
     return ZIP_OK;
 }
 
@@ -344,297 +328,225 @@ local uLong zip64local_TmzDateToDosDate(const tm_zip* ptm)
 
 /****************************************************************************/
 
-local int zip64local_getByte OF((const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, int *pi));
+#define SIZEENDOFCENTRALDIR (0x16)
+#define SIZEZIP64LOCATOR (0x14)
+#define SIZEZIP64ENDOFCENTRALDIR (0x38)
 
-local int zip64local_getByte(const zlib_filefunc64_32_def* pzlib_filefunc_def,voidpf filestream,int* pi)
+local uLong zip64local_getShortFromBuffer (const unsigned char* p)
 {
-    unsigned char c;
-    int err = (int)ZREAD64(*pzlib_filefunc_def,filestream,&c,1);
-    if (err==1)
-    {
-        *pi = (int)c;
-        return ZIP_OK;
-    }
-    else
-    {
-        if (ZERROR64(*pzlib_filefunc_def,filestream))
-            return ZIP_ERRNO;
-        else
-            return ZIP_EOF;
-    }
+  return (uLong)p[0] | ((uLong)p[1]<<8);
 }
 
-
-/* ===========================================================================
-   Reads a long in LSB order from the given gz_stream. Sets
-*/
-local int zip64local_getShort OF((const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, uLong *pX));
-
-local int zip64local_getShort (const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, uLong* pX)
+local uLong zip64local_getLongFromBuffer (const unsigned char* p)
 {
-    uLong x ;
-    int i = 0;
-    int err;
-
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x = (uLong)i;
-
-    if (err==ZIP_OK)
-        err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<8;
-
-    if (err==ZIP_OK)
-        *pX = x;
-    else
-        *pX = 0;
-    return err;
+  return (uLong)p[0] | ((uLong)p[1]<<8) | ((uLong)p[2]<<16) | ((uLong)p[3]<<24);
 }
 
-local int zip64local_getLong OF((const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, uLong *pX));
-
-local int zip64local_getLong (const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, uLong* pX)
+local ZPOS64_T zip64local_getLong64FromBuffer (const unsigned char* p)
 {
-    uLong x ;
-    int i = 0;
-    int err;
-
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x = (uLong)i;
-
-    if (err==ZIP_OK)
-        err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<8;
-
-    if (err==ZIP_OK)
-        err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<16;
-
-    if (err==ZIP_OK)
-        err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<24;
-
-    if (err==ZIP_OK)
-        *pX = x;
-    else
-        *pX = 0;
-    return err;
+  return (ZPOS64_T)zip64local_getLongFromBuffer(p) |
+         ((ZPOS64_T)zip64local_getLongFromBuffer(p+4)<<32);
 }
 
-local int zip64local_getLong64 OF((const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, ZPOS64_T *pX));
-
-
-local int zip64local_getLong64 (const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, ZPOS64_T *pX)
+/* zip64_end_of_central_dir contain the end of central directory record of a
+   zipfile, or its zip64 end of central directory record */
+typedef struct zip64_end_of_central_dir_s
 {
-  ZPOS64_T x;
-  int i = 0;
-  int err;
-
-  err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x = (ZPOS64_T)i;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<8;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<16;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<24;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<32;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<40;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<48;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<56;
+  ZPOS64_T central_pos;          /* position of the record */
+  int isZip64;                   /* 1 if the record is the zip64 one */
+  uLong number_disk;             /* number of the current disk */
+  uLong number_disk_with_CD;     /* number the the disk with central dir */
+  ZPOS64_T number_entry;         /* number of entries on this disk */
+  ZPOS64_T number_entry_CD;      /* total number of entries in the central dir */
+  ZPOS64_T size_central_dir;     /* size of the central directory  */
+  ZPOS64_T offset_central_dir;   /* offset of start of central directory */
+  char* globalcomment;           /* global comment, NULL for zip64 */
+} zip64_end_of_central_dir;
 
-  if (err==ZIP_OK)
-    *pX = x;
-  else
-    *pX = 0;
+/*
+  Find the last signature of the end of central directory record in buf,
+    preferring the one whose comment ends exactly at the end of buf
+  return -1 if there is none
+*/
+local long zip64local_FindEndOfCentralDir(const unsigned char* buf, uLong uBufSize)
+{
+  long lFound = -1;
+  long i;
 
-  return err;
+  if (uBufSize<SIZEENDOFCENTRALDIR)
+    return -1;
+  /* without comment, the record is at the very end and found by the first test */
+  for (i=(long)(uBufSize-SIZEENDOFCENTRALDIR); i>=0; i--)
+  {
+    if ((buf[i]!=0x50) || (zip64local_getLongFromBuffer(buf+i)!=0x06054b50))
+      continue;
+    if ((uLong)i+SIZEENDOFCENTRALDIR+zip64local_getShortFromBuffer(buf+i+20)==uBufSize)
+      return i;
+    if (lFound<0)
+      lFound = i;
+  }
+  return lFound;
 }
 
-#ifndef BUFREADCOMMENT
-#define BUFREADCOMMENT (0x400)
-#endif
 /*
-  Locate the Central directory of a zipfile (at the end, just before
-    the global comment)
+  Read the zip64 end of central directory record pointed by the zip64 locator
+    just before the end of central directory record.
+  return 0 if there is no usable zip64 record
 */
-local ZPOS64_T zip64local_SearchCentralDir OF((const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream));
-
-local ZPOS64_T zip64local_SearchCentralDir(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream)
+local int zip64local_ReadZip64EndOfCentralDir(const zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                              voidpf filestream,
+                                              const unsigned char* buf, ZPOS64_T uBufPos, uLong uBufSize,
+                                              long lPosLocator,
+                                              zip64_end_of_central_dir* pend)
 {
-  unsigned char* buf;
-  ZPOS64_T uSizeFile;
-  ZPOS64_T uBackRead;
-  ZPOS64_T uMaxBack=0xffff; /* maximum size of global comment */
-  ZPOS64_T uPosFound=0;
+  unsigned char record[SIZEZIP64ENDOFCENTRALDIR];
+  const unsigned char* p;
+  ZPOS64_T relativeOffset;
 
-  if (ZSEEK64(*pzlib_filefunc_def,filestream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
+  // Signature "0x07064b50" Zip64 end of central directory locater
+  p = buf+lPosLocator;
+  if (zip64local_getLongFromBuffer(p)!=0x07064b50)
     return 0;
-
-
-  uSizeFile = ZTELL64(*pzlib_filefunc_def,filestream);
-
-  if (uMaxBack>uSizeFile)
-    uMaxBack = uSizeFile;
-
-  buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
-  if (buf==NULL)
+  /* number of the disk with the start of the zip64 end of central directory */
+  if (zip64local_getLongFromBuffer(p+4)!=0)
+    return 0;
+  /* relative offset of the zip64 end of central directory record */
+  relativeOffset = zip64local_getLong64FromBuffer(p+8);
+  /* total number of disks */
+  if (zip64local_getLongFromBuffer(p+16)!=1)
     return 0;
 
-  uBackRead = 4;
-  while (uBackRead<uMaxBack)
+  /* the record is usually in the tail already read */
+  if ((relativeOffset>=uBufPos) && (relativeOffset+SIZEZIP64ENDOFCENTRALDIR<=uBufPos+uBufSize))
+    p = buf+(relativeOffset-uBufPos);
+  else
   {
-    uLong uReadSize;
-    ZPOS64_T uReadPos ;
-    int i;
-    if (uBackRead+BUFREADCOMMENT>uMaxBack)
-      uBackRead = uMaxBack;
-    else
-      uBackRead+=BUFREADCOMMENT;
-    uReadPos = uSizeFile-uBackRead ;
-
-    uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
-      (BUFREADCOMMENT+4) : (uLong)(uSizeFile-uReadPos);
-    if (ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-      break;
-
-    if (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
-      break;
-
-    for (i=(int)uReadSize-3; (i--)>0;)
-      if (((*(buf+i))==0x50) && ((*(buf+i+1))==0x4b) &&
-        ((*(buf+i+2))==0x05) && ((*(buf+i+3))==0x06))
-      {
-        uPosFound = uReadPos+i;
-        break;
-      }
-
-      if (uPosFound!=0)
-        break;
+    if (ZSEEK64(*pzlib_filefunc_def,filestream,relativeOffset,ZLIB_FILEFUNC_SEEK_SET)!=0)
+      return 0;
+    if (ZREAD64(*pzlib_filefunc_def,filestream,record,SIZEZIP64ENDOFCENTRALDIR)!=SIZEZIP64ENDOFCENTRALDIR)
+      return 0;
+    p = record;
   }
-  TRYFREE(buf);
-  return uPosFound;
+  if (zip64local_getLongFromBuffer(p)!=0x06064b50) // signature of 'Zip64 end of central directory'
+    return 0;
+
+  pend->central_pos = relativeOffset;
+  pend->isZip64 = 1;
+  /* p+4 size of the record, p+12 version made by, p+14 version needed to extract */
+  pend->number_disk = zip64local_getLongFromBuffer(p+16);
+  pend->number_disk_with_CD = zip64local_getLongFromBuffer(p+20);
+  pend->number_entry = zip64local_getLong64FromBuffer(p+24);
+  pend->number_entry_CD = zip64local_getLong64FromBuffer(p+32);
+  pend->size_central_dir = zip64local_getLong64FromBuffer(p+40);
+  pend->offset_central_dir = zip64local_getLong64FromBuffer(p+48);
+  // TODO..
+  // read the comment from the standard central header.
+  pend->globalcomment = NULL;
+  return 1;
 }
 
 /*
-Locate the End of Zip64 Central directory locator and from there find the CD of a zipfile (at the end, just before
-the global comment)
+  Locate and read the end of central directory record of a zipfile (at the end,
+    just before the global comment), or the zip64 one if there is one.
+  The tail of the zipfile, which holds the record, the global comment and the
+    zip64 locator, is read with a single read.
 */
-local ZPOS64_T zip64local_SearchCentralDir64 OF((const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream));
-
-local ZPOS64_T zip64local_SearchCentralDir64(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream)
+local int zip64local_ReadEndOfCentralDir OF((const zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                             const zlib_allocator_def* pallocator,
+                                             voidpf filestream,
+                                             zip64_end_of_central_dir* pend));
+
+local int zip64local_ReadEndOfCentralDir(const zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                         const zlib_allocator_def* pallocator,
+                                         voidpf filestream,
+                                         zip64_end_of_central_dir* pend)
 {
   unsigned char* buf;
   ZPOS64_T uSizeFile;
-  ZPOS64_T uBackRead;
-  ZPOS64_T uMaxBack=0xffff; /* maximum size of global comment */
-  ZPOS64_T uPosFound=0;
-  uLong uL;
-  ZPOS64_T relativeOffset;
+  ZPOS64_T uReadPos;
+  uLong uReadSize;
+  uLong uMaxBack = SIZEENDOFCENTRALDIR+0xffff+SIZEZIP64LOCATOR; /* maximum size of the tail */
+  long lPos;
+  const unsigned char* p;
 
+  pend->globalcomment = NULL;
   if (ZSEEK64(*pzlib_filefunc_def,filestream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
-    return 0;
-
+    return ZIP_ERRNO;
   uSizeFile = ZTELL64(*pzlib_filefunc_def,filestream);
+  if (uSizeFile==(ZPOS64_T)-1)
+    return ZIP_ERRNO;
 
-  if (uMaxBack>uSizeFile)
-    uMaxBack = uSizeFile;
+  /* allow appending to empty ZIP archive */
+  if (uSizeFile==0)
+  {
+    memset(pend,0,sizeof(zip64_end_of_central_dir));
+    return ZIP_OK;
+  }
 
-  buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
-  if (buf==NULL)
-    return 0;
+  uReadSize = (uSizeFile<uMaxBack) ? (uLong)uSizeFile : uMaxBack;
+  uReadPos = uSizeFile-uReadSize;
+  if (uReadSize<SIZEENDOFCENTRALDIR)
+    return ZIP_ERRNO;
 
-  uBackRead = 4;
-  while (uBackRead<uMaxBack)
+  buf = (unsigned char*)call_zalloc_mem(pallocator,uReadSize);
+  if (buf==NULL)
+    return ZIP_INTERNALERROR;
+  if ((ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0) ||
+      (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize))
   {
-    uLong uReadSize;
-    ZPOS64_T uReadPos;
-    int i;
-    if (uBackRead+BUFREADCOMMENT>uMaxBack)
-      uBackRead = uMaxBack;
-    else
-      uBackRead+=BUFREADCOMMENT;
-    uReadPos = uSizeFile-uBackRead ;
-
-    uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
-      (BUFREADCOMMENT+4) : (uLong)(uSizeFile-uReadPos);
-    if (ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-      break;
+    call_zfree_mem(pallocator,buf);
+    return ZIP_ERRNO;
+  }
 
-    if (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
-      break;
+  lPos = zip64local_FindEndOfCentralDir(buf,uReadSize);
+  if (lPos<0)
+  {
+    call_zfree_mem(pallocator,buf);
+    return ZIP_ERRNO;
+  }
 
-    for (i=(int)uReadSize-3; (i--)>0;)
+  if ((lPos<SIZEZIP64LOCATOR) ||
+      (!zip64local_ReadZip64EndOfCentralDir(pzlib_filefunc_def,filestream,buf,uReadPos,uReadSize,
+                                            lPos-SIZEZIP64LOCATOR,pend)))
+  {
+    uLong size_comment;
+
+    p = buf+lPos;
+    pend->central_pos = uReadPos+lPos;
+    pend->isZip64 = 0;
+    pend->number_disk = zip64local_getShortFromBuffer(p+4);
+    pend->number_disk_with_CD = zip64local_getShortFromBuffer(p+6);
+    pend->number_entry = zip64local_getShortFromBuffer(p+8);
+    pend->number_entry_CD = zip64local_getShortFromBuffer(p+10);
+    pend->size_central_dir = zip64local_getLongFromBuffer(p+12);
+    pend->offset_central_dir = zip64local_getLongFromBuffer(p+16);
+
+    /* zipfile global comment, it may be cut by the end of the zipfile */
+    size_comment = zip64local_getShortFromBuffer(p+20);
+    if (size_comment>uReadSize-lPos-SIZEENDOFCENTRALDIR)
+      size_comment = uReadSize-lPos-SIZEENDOFCENTRALDIR;
+    if (size_comment>0)
     {
-      // Signature "0x07064b50" Zip64 end of central directory locater
-      if (((*(buf+i))==0x50) && ((*(buf+i+1))==0x4b) && ((*(buf+i+2))==0x06) && ((*(buf+i+3))==0x07))
+      pend->globalcomment = (char*)call_zalloc_mem(pallocator,size_comment+1);
+      if (pend->globalcomment)
       {
-        uPosFound = uReadPos+i;
-        break;
+        memcpy(pend->globalcomment,p+SIZEENDOFCENTRALDIR,size_comment);
+        pend->globalcomment[size_comment]=0;
       }
     }
-
-      if (uPosFound!=0)
-        break;
   }
+  call_zfree_mem(pallocator,buf);
 
-  TRYFREE(buf);
-  if (uPosFound == 0)
-    return 0;
-
-  /* Zip64 end of central directory locator */
-  if (ZSEEK64(*pzlib_filefunc_def,filestream, uPosFound,ZLIB_FILEFUNC_SEEK_SET)!=0)
-    return 0;
-
-  /* the signature, already checked */
-  if (zip64local_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
-    return 0;
-
-  /* number of the disk with the start of the zip64 end of  central directory */
-  if (zip64local_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
-    return 0;
-  if (uL != 0)
-    return 0;
-
-  /* relative offset of the zip64 end of central directory record */
-  if (zip64local_getLong64(pzlib_filefunc_def,filestream,&relativeOffset)!=ZIP_OK)
-    return 0;
-
-  /* total number of disks */
-  if (zip64local_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
-    return 0;
-  if (uL != 1)
-    return 0;
-
-  /* Goto Zip64 end of central directory record */
-  if (ZSEEK64(*pzlib_filefunc_def,filestream, relativeOffset,ZLIB_FILEFUNC_SEEK_SET)!=0)
-    return 0;
-
-  /* the signature */
-  if (zip64local_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
-    return 0;
-
-  if (uL != 0x06064b50) // signature of 'Zip64 end of central directory'
-    return 0;
-
-  return relativeOffset;
+  if ((pend->number_entry_CD!=pend->number_entry) ||
+      (pend->number_disk_with_CD!=0) ||
+      (pend->number_disk!=0) ||
+      (pend->central_pos<pend->offset_central_dir+pend->size_central_dir))
+  {
+    call_zfree_mem(pallocator,pend->globalcomment);
+    pend->globalcomment = NULL;
+    return ZIP_BADZIPFILE;
+  }
+  return ZIP_OK;
 }
 
 int LoadCentralDirectoryRecord(zip64_internal* pziinit);
@@ -646,192 +558,44 @@ int LoadCentralDirectoryRecord(zip64_internal* pziinit)
   ZPOS64_T size_central_dir;     /* size of the central directory  */
   ZPOS64_T offset_central_dir;   /* offset of start of central directory */
   ZPOS64_T central_pos;
-  uLong uL;
-
-  uLong number_disk;          /* number of the current dist, used for
-                              spaning ZIP, unsupported, always 0*/
-  uLong number_disk_with_CD;  /* number the the disk with central dir, used
-                              for spaning ZIP, unsupported, always 0*/
-  ZPOS64_T number_entry;
   ZPOS64_T number_entry_CD;      /* total number of entries in
                                 the central dir
                                 (same than number_entry on nospan) */
-  uLong VersionMadeBy;
-  uLong VersionNeeded;
-  uLong size_comment;
-
-  int hasZIP64Record = 0;
-
-  // check first if we find a ZIP64 record
-  central_pos = zip64local_SearchCentralDir64(&pziinit->z_filefunc,pziinit->filestream);
-  if(central_pos > 0)
-  {
-    hasZIP64Record = 1;
-  }
-  else if(central_pos == 0)
-  {
-    central_pos = zip64local_SearchCentralDir(&pziinit->z_filefunc,pziinit->filestream);
-  }
-
-/* disable to allow appending to empty ZIP archive
-        if (central_pos==0)
-            err=ZIP_ERRNO;
-*/
-
-  if(hasZIP64Record)
-  {
-    ZPOS64_T sizeEndOfCentralDirectory;
-    if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, central_pos, ZLIB_FILEFUNC_SEEK_SET) != 0)
-      err=ZIP_ERRNO;
-
-    /* the signature, already checked */
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream,&uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* size of zip64 end of central directory record */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream, &sizeEndOfCentralDirectory)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* version made by */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &VersionMadeBy)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* version needed to extract */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &VersionNeeded)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* number of this disk */
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream,&number_disk)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* number of the disk with the start of the central directory */
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream,&number_disk_with_CD)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* total number of entries in the central directory on this disk */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream, &number_entry)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* total number of entries in the central directory */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream,&number_entry_CD)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    if ((number_entry_CD!=number_entry) || (number_disk_with_CD!=0) || (number_disk!=0))
-      err=ZIP_BADZIPFILE;
-
-    /* size of the central directory */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream,&size_central_dir)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* offset of start of central directory with respect to the
-    starting disk number */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream,&offset_central_dir)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    // TODO..
-    // read the comment from the standard central header.
-    size_comment = 0;
-  }
-  else
-  {
-    // Read End of central Directory info
-    if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, central_pos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-      err=ZIP_ERRNO;
-
-    /* the signature, already checked */
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream,&uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* number of this disk */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream,&number_disk)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* number of the disk with the start of the central directory */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream,&number_disk_with_CD)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* total number of entries in the central dir on this disk */
-    number_entry = 0;
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-    else
-      number_entry = uL;
-
-    /* total number of entries in the central dir */
-    number_entry_CD = 0;
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-    else
-      number_entry_CD = uL;
-
-    if ((number_entry_CD!=number_entry) || (number_disk_with_CD!=0) || (number_disk!=0))
-      err=ZIP_BADZIPFILE;
-
-    /* size of the central directory */
-    size_central_dir = 0;
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream, &uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-    else
-      size_central_dir = uL;
-
-    /* offset of start of central directory with respect to the starting disk number */
-    offset_central_dir = 0;
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream, &uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-    else
-      offset_central_dir = uL;
-
-
-    /* zipfile global comment length */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &size_comment)!=ZIP_OK)
-      err=ZIP_ERRNO;
-  }
-
-  if ((central_pos<offset_central_dir+size_central_dir) &&
-    (err==ZIP_OK))
-    err=ZIP_BADZIPFILE;
+  zip64_end_of_central_dir end_of_central_dir;
 
+  err = zip64local_ReadEndOfCentralDir(&pziinit->z_filefunc,&pziinit->allocator,pziinit->filestream,&end_of_central_dir);
   if (err!=ZIP_OK)
   {
     ZCLOSE64(pziinit->z_filefunc, pziinit->filestream);
     return ZIP_ERRNO;
   }
 
-  if (size_comment>0)
-  {
-    pziinit->globalcomment = (char*)ALLOC(size_comment+1);
-    if (pziinit->globalcomment)
-    {
-      size_comment = ZREAD64(pziinit->z_filefunc, pziinit->filestream, pziinit->globalcomment,size_comment);
-      pziinit->globalcomment[size_comment]=0;
-    }
-  }
+  central_pos = end_of_central_dir.central_pos;
+  number_entry_CD = end_of_central_dir.number_entry_CD;
+  size_central_dir = end_of_central_dir.size_central_dir;
+  offset_central_dir = end_of_central_dir.offset_central_dir;
+  pziinit->globalcomment = end_of_central_dir.globalcomment;
 
   byte_before_the_zipfile = central_pos - (offset_central_dir+size_central_dir);
   pziinit->add_position_when_writting_offset = byte_before_the_zipfile;
 
+  /* the existing central directory is read in one go, in front of the room
+     already reserved for the files to add */
+  if ((err==ZIP_OK) && (size_central_dir>0))
   {
-    ZPOS64_T size_central_dir_to_read = size_central_dir;
-    size_t buf_size = SIZEDATA_INDATABLOCK;
-    void* buf_read = (void*)ALLOC(buf_size);
-    if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, offset_central_dir + byte_before_the_zipfile, ZLIB_FILEFUNC_SEEK_SET) != 0)
+    zip64_central_dir* cd = &pziinit->central_dir;
+    if ((size_t)size_central_dir != size_central_dir)
+      err=ZIP_INTERNALERROR;
+    if (err==ZIP_OK)
+      err = reserve_central_dir(&pziinit->allocator,cd,cd->capacity + (size_t)size_central_dir);
+    if ((err==ZIP_OK) &&
+        (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, offset_central_dir + byte_before_the_zipfile, ZLIB_FILEFUNC_SEEK_SET) != 0))
       err=ZIP_ERRNO;
-
-    while ((size_central_dir_to_read>0) && (err==ZIP_OK))
-    {
-      ZPOS64_T read_this = SIZEDATA_INDATABLOCK;
-      if (read_this > size_central_dir_to_read)
-        read_this = size_central_dir_to_read;
-
-      if (ZREAD64(pziinit->z_filefunc, pziinit->filestream,buf_read,(uLong)read_this) != read_this)
-        err=ZIP_ERRNO;
-
-      if (err==ZIP_OK)
-        err = add_data_in_datablock(&pziinit->central_dir,buf_read, (uLong)read_this);
-
-      size_central_dir_to_read-=read_this;
-    }
-    TRYFREE(buf_read);
+    if ((err==ZIP_OK) &&
+        (ZREAD64(pziinit->z_filefunc, pziinit->filestream,cd->data,(uLong)size_central_dir) != size_central_dir))
+      err=ZIP_ERRNO;
+    if (err==ZIP_OK)
+      cd->size = (size_t)size_central_dir;
   }
   pziinit->begin_pos = byte_before_the_zipfile;
   pziinit->number_entry = number_entry_CD;
@@ -847,13 +611,27 @@ int LoadCentralDirectoryRecord(zip64_internal* pziinit)
 
 
 /************************************************************/
-extern zipFile ZEXPORT zipOpen3 (const void *pathname, int append, zipcharpc* globalcomment, zlib_filefunc64_32_def* pzlib_filefunc64_32_def);
-extern zipFile ZEXPORT zipOpen3 (const void *pathname, int append, zipcharpc* globalcomment, zlib_filefunc64_32_def* pzlib_filefunc64_32_def)
+local zipFile zipOpenInternal (const void *pathname, int append, zipcharpc* globalcomment,
+                               zlib_filefunc64_32_def* pzlib_filefunc64_32_def,
+                               const zip_open_options* options)
 {
     zip64_internal ziinit;
     zip64_internal* zi;
     int err=ZIP_OK;
 
+    if ((options!=NULL) && (options->allocator!=NULL))
+        ziinit.allocator = *options->allocator;
+    else
+        fill_malloc_allocator(&ziinit.allocator);
+
+    ziinit.deflate_workers = (options!=NULL) ? options->deflate_workers : 0;
+    ziinit.deflate_block_size = ZIP_DEFLATE_BLOCK_SIZE;
+    if ((options!=NULL) && (options->deflate_block_size!=0))
+        ziinit.deflate_block_size = options->deflate_block_size;
+    if (ziinit.deflate_block_size < ZIP_DEFLATE_DICT_SIZE)
+        ziinit.deflate_block_size = ZIP_DEFLATE_DICT_SIZE;
+    ziinit.deflate_pool = NULL;
+
     ziinit.z_filefunc.zseek32_file = NULL;
     ziinit.z_filefunc.ztell32_file = NULL;
     if (pzlib_filefunc64_32_def==NULL)
@@ -868,7 +646,10 @@ extern zipFile ZEXPORT zipOpen3 (const void *pathname, int append, zipcharpc* gl
                     (ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_EXISTING));
 
     if (ziinit.filestream == NULL)
+    {
+        call_zrelease_mem(&ziinit.allocator);
         return NULL;
+    }
 
     if (append == APPEND_STATUS_CREATEAFTER)
         ZSEEK64(ziinit.z_filefunc,ziinit.filestream,0,SEEK_END);
@@ -876,16 +657,24 @@ extern zipFile ZEXPORT zipOpen3 (const void *pathname, int append, zipcharpc* gl
     ziinit.begin_pos = ZTELL64(ziinit.z_filefunc,ziinit.filestream);
     ziinit.in_opened_file_inzip = 0;
     ziinit.ci.stream_initialised = 0;
+    ziinit.ci.parallel = 0;
     ziinit.number_entry = 0;
     ziinit.add_position_when_writting_offset = 0;
-    init_linkedlist(&(ziinit.central_dir));
-
+    init_central_dir(&(ziinit.central_dir));
+    if ((options!=NULL) && (options->expected_entries>0))
+    {
+        /* a failure only leaves the central directory to grow as it goes */
+        ZPOS64_T capacity = options->expected_entries * ZIP_CENTRALDIR_ENTRY_RESERVE;
+        if ((size_t)capacity == capacity)
+            reserve_central_dir(&ziinit.allocator,&ziinit.central_dir,(size_t)capacity);
+    }
 
 
-    zi = (zip64_internal*)ALLOC(sizeof(zip64_internal));
+    zi = (zip64_internal*)call_zalloc_mem(&ziinit.allocator,sizeof(zip64_internal));
     if (zi==NULL)
     {
         ZCLOSE64(ziinit.z_filefunc,ziinit.filestream);
+        call_zrelease_mem(&ziinit.allocator);
         return NULL;
     }
 
@@ -907,9 +696,11 @@ extern zipFile ZEXPORT zipOpen3 (const void *pathname, int append, zipcharpc* gl
     if (err != ZIP_OK)
     {
 #    ifndef NO_ADDFILEINEXISTINGZIP
-        TRYFREE(ziinit.globalcomment);
+        call_zfree_mem(&ziinit.allocator,ziinit.globalcomment);
 #    endif /* !NO_ADDFILEINEXISTINGZIP*/
-        TRYFREE(zi);
+        free_central_dir(&ziinit.allocator,&ziinit.central_dir);
+        call_zfree_mem(&ziinit.allocator,zi);
+        call_zrelease_mem(&ziinit.allocator);
         return NULL;
     }
     else
@@ -919,6 +710,27 @@ extern zipFile ZEXPORT zipOpen3 (const void *pathname, int append, zipcharpc* gl
     }
 }
 
+extern zipFile ZEXPORT zipOpen3 (const void *pathname, int append, zipcharpc* globalcomment, zlib_filefunc64_32_def* pzlib_filefunc64_32_def);
+extern zipFile ZEXPORT zipOpen3 (const void *pathname, int append, zipcharpc* globalcomment, zlib_filefunc64_32_def* pzlib_filefunc64_32_def)
+{
+    return zipOpenInternal(pathname, append, globalcomment, pzlib_filefunc64_32_def, NULL);
+}
+
+extern zipFile ZEXPORT zipOpen4 (const void *pathname, int append, zipcharpc* globalcomment,
+                                 zlib_filefunc64_def* pzlib_filefunc_def, const zip_open_options* options)
+{
+    if (pzlib_filefunc_def != NULL)
+    {
+        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
+        zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
+        zlib_filefunc64_32_def_fill.ztell32_file = NULL;
+        zlib_filefunc64_32_def_fill.zseek32_file = NULL;
+        return zipOpenInternal(pathname, append, globalcomment, &zlib_filefunc64_32_def_fill, options);
+    }
+    else
+        return zipOpenInternal(pathname, append, globalcomment, NULL, options);
+}
+
 extern zipFile ZEXPORT zipOpen2 (const char *pathname, int append, zipcharpc* globalcomment, zlib_filefunc_def* pzlib_filefunc32_def)
 {
     if (pzlib_filefunc32_def != NULL)
@@ -1049,6 +861,10 @@ int Write_LocalFileHeader(zip64_internal* zi, const char* filename, uInt size_ex
   return err;
 }
 
+#ifdef MZ_HAVE_PTHREAD
+local int zip64local_OpenDeflatePool OF((zip64_internal* zi, int level, int windowBits, int memLevel, int strategy));
+#endif
+
 /*
  NOTE.
  When writing RAW the ZIP64 extended information in extrafield_local and extrafield_global needs to be stripped
@@ -1079,11 +895,12 @@ extern int ZEXPORT zipOpenNewFileInZip4_64 (zipFile file, const char* filename,
     if (file == NULL)
         return ZIP_PARAMERROR;
 
+    /* raw data of any method is copied as it is */
 #ifdef HAVE_BZIP2
-    if ((method!=0) && (method!=Z_DEFLATED) && (method!=Z_BZIP2ED))
+    if ((method!=0) && (method!=Z_DEFLATED) && (method!=Z_BZIP2ED) && (!raw))
       return ZIP_PARAMERROR;
 #else
-    if ((method!=0) && (method!=Z_DEFLATED))
+    if ((method!=0) && (method!=Z_DEFLATED) && (!raw))
       return ZIP_PARAMERROR;
 #endif
 
@@ -1130,6 +947,7 @@ extern int ZEXPORT zipOpenNewFileInZip4_64 (zipFile file, const char* filename,
     zi->ci.method = method;
     zi->ci.encrypt = 0;
     zi->ci.stream_initialised = 0;
+    zi->ci.parallel = 0;
     zi->ci.pos_in_buffered_data = 0;
     zi->ci.raw = raw;
     zi->ci.pos_local_header = ZTELL64(zi->z_filefunc,zi->filestream);
@@ -1137,7 +955,7 @@ extern int ZEXPORT zipOpenNewFileInZip4_64 (zipFile file, const char* filename,
     zi->ci.size_centralheader = SIZECENTRALHEADER + size_filename + size_extrafield_global + size_comment;
     zi->ci.size_centralExtraFree = 32; // Extra space we have reserved in case we need to add ZIP64 extra info data
 
-    zi->ci.central_header = (char*)ALLOC((uInt)zi->ci.size_centralheader + zi->ci.size_centralExtraFree);
+    zi->ci.central_header = (char*)call_zalloc_mem(&zi->allocator,(uInt)zi->ci.size_centralheader + zi->ci.size_centralExtraFree);
 
     zi->ci.size_centralExtra = size_extrafield_global;
     zip64local_putValue_inmemory(zi->ci.central_header,(uLong)CENTRALHEADERMAGIC,4);
@@ -1213,11 +1031,23 @@ extern int ZEXPORT zipOpenNewFileInZip4_64 (zipFile file, const char* filename,
     if ((err==ZIP_OK) && (zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
 #endif
     {
+#ifdef MZ_HAVE_PTHREAD
+        if ((zi->ci.method == Z_DEFLATED) && (zi->deflate_workers > 1))
+        {
+          if (windowBits>0)
+              windowBits = -windowBits;
+
+          err = zip64local_OpenDeflatePool(zi, level, windowBits, memLevel, strategy);
+          if (err==ZIP_OK)
+              zi->ci.parallel = 1;
+        }
+        else
+#endif
         if(zi->ci.method == Z_DEFLATED)
         {
-          zi->ci.stream.zalloc = (alloc_func)0;
-          zi->ci.stream.zfree = (free_func)0;
-          zi->ci.stream.opaque = (voidpf)0;
+          zi->ci.stream.zalloc = zlib_alloc_from_allocator;
+          zi->ci.stream.zfree = zlib_free_from_allocator;
+          zi->ci.stream.opaque = (voidpf)&zi->allocator;
 
           if (windowBits>0)
               windowBits = -windowBits;
@@ -1250,7 +1080,7 @@ extern int ZEXPORT zipOpenNewFileInZip4_64 (zipFile file, const char* filename,
         unsigned char bufHead[RAND_HEAD_LEN];
         unsigned int sizeHead;
         zi->ci.encrypt = 1;
-        zi->ci.pcrc_32_tab = (const unsigned long*)get_crc_table();
+        zi->ci.pcrc_32_tab = get_crc_table();
         /*init_keys(password,zi->ci.keys,zi->ci.pcrc_32_tab);*/
 
         sizeHead=crypthead(password,bufHead,RAND_HEAD_LEN,zi->ci.keys,zi->ci.pcrc_32_tab,crcForCrypting);
@@ -1364,6 +1194,175 @@ extern int ZEXPORT zipOpenNewFileInZip (zipFile file, const char* filename, cons
                                  NULL, 0, VERSIONMADEBY, 0, 0);
 }
 
+#define ZIP_DEFAULT_MIN_SAVINGS (4)
+/* the entropy of fewer bytes says little, and of more takes longer for nothing */
+#define ZIP_MIN_SAMPLE_SIZE (64)
+#define ZIP_MAX_SAMPLE_SIZE (65536)
+
+/* extensions of compressed formats, stored by zipChooseCompression */
+local const char* const zip_compressed_extensions[] =
+{
+    "jpg", "jpeg", "png", "gif", "webp", "heic", "heif",
+    "mp3", "m4a", "aac", "ogg", "oga", "opus", "flac",
+    "mp4", "m4v", "mov", "avi", "mkv", "webm", "3gp",
+    "zip", "gz", "tgz", "bz2", "xz", "7z", "rar", "zst", "lz4",
+    "jar", "apk", "ipa", "docx", "xlsx", "pptx", "epub",
+    NULL
+};
+
+typedef struct zip64_magic_number_s
+{
+    uInt offset;
+    uInt size;
+    const char* magic;
+} zip64_magic_number;
+
+/* magic numbers of compressed formats, stored by zipChooseCompression */
+local const zip64_magic_number zip_compressed_magic_numbers[] =
+{
+    { 0, 3, "\xff\xd8\xff" },           /* JPEG */
+    { 0, 4, "\x89PNG" },
+    { 0, 4, "GIF8" },
+    { 0, 4, "PK\x03\x04" },             /* zip, and jar, docx... */
+    { 0, 2, "\x1f\x8b" },               /* gzip */
+    { 0, 3, "BZh" },                    /* bzip2 */
+    { 0, 6, "\xfd" "7zXZ\0" },          /* xz */
+    { 0, 6, "7z\xbc\xaf\x27\x1c" },
+    { 0, 4, "Rar!" },
+    { 0, 4, "\x28\xb5\x2f\xfd" },       /* zstd */
+    { 0, 4, "OggS" },
+    { 0, 4, "fLaC" },
+    { 0, 3, "ID3" },                    /* MP3 */
+    { 4, 4, "ftyp" },                   /* MP4, MOV, M4A, HEIC */
+    { 8, 4, "WEBP" },
+    { 0, 0, NULL }
+};
+
+local int zip64local_ExtensionEqual(const char* extension, const char* filename_extension)
+{
+    while ((*extension!=0) && (*filename_extension!=0))
+    {
+        char c1 = *extension++;
+        char c2 = *filename_extension++;
+        if ((c1>='A') && (c1<='Z'))
+            c1 += 'a'-'A';
+        if ((c2>='A') && (c2<='Z'))
+            c2 += 'a'-'A';
+        if (c1!=c2)
+            return 0;
+    }
+    return (*extension==0) && (*filename_extension==0);
+}
+
+local int zip64local_HasCompressedMagicNumber(const unsigned char* buf, uLong len)
+{
+    const zip64_magic_number* m;
+    for (m=zip_compressed_magic_numbers; m->magic!=NULL; m++)
+    {
+        if ((len >= m->offset + m->size) && (memcmp(buf + m->offset, m->magic, m->size)==0))
+            return 1;
+    }
+    return 0;
+}
+
+/* percent of its size buf is expected to save, from the entropy of its bytes */
+local int zip64local_EstimateSavings(const unsigned char* buf, uLong len)
+{
+    uLong counts[256];
+    double bits = 0;
+    uLong i;
+
+    memset(counts,0,sizeof(counts));
+    for (i=0;i<len;i++)
+        counts[buf[i]]++;
+    for (i=0;i<256;i++)
+    {
+        if (counts[i]>0)
+        {
+            double p = (double)counts[i] / (double)len;
+            bits -= p * log(p);
+        }
+    }
+    bits /= log(2.0);
+    return (int)((8.0 - bits) * 100.0 / 8.0);
+}
+
+extern int ZEXPORT zipChooseCompression (const zip_compression_policy* policy, const char* filename,
+                                         const void* sample, uLong sample_size,
+                                         int* method, int* level, int* strategy)
+{
+    const char* extension = NULL;
+    const char* p;
+    int min_savings = ZIP_DEFAULT_MIN_SAVINGS;
+    int store = 0;
+    uInt i;
+
+    if ((method==NULL) || (level==NULL) || (strategy==NULL))
+        return ZIP_PARAMERROR;
+
+    *method = Z_DEFLATED;
+    *level = Z_DEFAULT_COMPRESSION;
+    *strategy = Z_DEFAULT_STRATEGY;
+    if (policy!=NULL)
+    {
+        if (policy->level!=0)
+            *level = policy->level;
+        *strategy = policy->strategy;
+        if (policy->min_savings!=0)
+            min_savings = policy->min_savings;
+    }
+
+    if (filename!=NULL)
+    {
+        for (p=filename; *p!=0; p++)
+        {
+            if (*p=='.')
+                extension = p+1;
+            else if ((*p=='/') || (*p=='\\'))
+                extension = NULL;
+        }
+    }
+
+    if ((extension!=NULL) && (policy!=NULL) && (policy->rules!=NULL))
+    {
+        for (i=0; i<policy->nb_rules; i++)
+        {
+            const zip_compression_rule* rule = &policy->rules[i];
+            if ((rule->extension!=NULL) && zip64local_ExtensionEqual(rule->extension,extension))
+            {
+                *level = rule->level;
+                *strategy = rule->strategy;
+                if (*level==0)
+                    *method = 0;
+                return ZIP_OK;
+            }
+        }
+    }
+
+    if (extension!=NULL)
+    {
+        for (i=0; (zip_compressed_extensions[i]!=NULL) && !store; i++)
+            store = zip64local_ExtensionEqual(zip_compressed_extensions[i],extension);
+    }
+
+    if ((!store) && (sample!=NULL))
+    {
+        if (sample_size > ZIP_MAX_SAMPLE_SIZE)
+            sample_size = ZIP_MAX_SAMPLE_SIZE;
+        store = zip64local_HasCompressedMagicNumber((const unsigned char*)sample,sample_size);
+        if ((!store) && (min_savings>0) && (sample_size>=ZIP_MIN_SAMPLE_SIZE))
+            store = (zip64local_EstimateSavings((const unsigned char*)sample,sample_size) < min_savings);
+    }
+
+    if (store)
+    {
+        *method = 0;
+        *level = 0;
+        *strategy = Z_DEFAULT_STRATEGY;
+    }
+    return ZIP_OK;
+}
+
 local int zip64FlushWriteBuffer(zip64_internal* zi)
 {
     int err=ZIP_OK;
@@ -1371,10 +1370,7 @@ local int zip64FlushWriteBuffer(zip64_internal* zi)
     if (zi->ci.encrypt != 0)
     {
 #ifndef NOCRYPT
-        uInt i;
-        int t;
-        for (i=0;i<zi->ci.pos_in_buffered_data;i++)
-            zi->ci.buffered_data[i] = zencode(zi->ci.keys, zi->ci.pcrc_32_tab, zi->ci.buffered_data[i],t);
+        zencode_block(zi->ci.keys, zi->ci.pcrc_32_tab, zi->ci.buffered_data, zi->ci.pos_in_buffered_data);
 #endif
     }
 
@@ -1403,6 +1399,363 @@ local int zip64FlushWriteBuffer(zip64_internal* zi)
     return err;
 }
 
+#ifdef MZ_HAVE_PTHREAD
+
+#define ZIP_DEFLATE_JOB_FREE   (0)
+#define ZIP_DEFLATE_JOB_QUEUED (1)
+#define ZIP_DEFLATE_JOB_DONE   (2)
+
+/* One block of a file, deflated by a worker of the pool */
+typedef struct zip64_deflate_job_s
+{
+    unsigned char* in;          /* dict_size bytes of dictionary, then the block */
+    uLong dict_size;
+    uLong in_size;              /* size of the block */
+    unsigned char* out;         /* deflated block */
+    uLong out_size;
+    uLong crc32;                /* crc of the block */
+    int last;                   /* the block ends the file : finished instead of flushed */
+    int state;
+    int err;
+} zip64_deflate_job;
+
+typedef struct zip64_deflate_worker_s
+{
+    struct zip64_deflate_pool_s* pool;
+    z_stream stream;
+} zip64_deflate_worker;
+
+/* Workers deflating the blocks of the current file, kept from one file to
+   the next. The jobs form a ring : filled by zipWriteInFileInZip at next_fill,
+   deflated in the same order, and written at next_write. */
+typedef struct zip64_deflate_pool_s
+{
+    int nb_workers;
+    int nb_started;             /* threads running, started by the first full block */
+    uLong block_size;
+    uLong out_capacity;         /* size of the out buffer of each job */
+    int nb_jobs;
+    zip64_deflate_job* jobs;
+    int next_fill;
+    int next_take;
+    int next_write;
+    int nb_queued;              /* jobs queued and not yet taken by a worker */
+    int nb_in_flight;           /* jobs submitted and not yet written */
+    int level;                  /* parameters of the streams of the workers */
+    int windowBits;
+    int memLevel;
+    int strategy;
+    int closing;
+    zip64_deflate_worker* workers;
+    pthread_t* threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_queued;
+    pthread_cond_t job_done;
+} zip64_deflate_pool;
+
+local int zip64local_DeflateBlock(z_stream* strm, zip64_deflate_job* job, uLong out_capacity)
+{
+    int err = deflateReset(strm);
+    if ((err==Z_OK) && (job->dict_size>0))
+        err = deflateSetDictionary(strm, job->in, (uInt)job->dict_size);
+    if (err!=Z_OK)
+        return err;
+
+    strm->next_in = job->in + job->dict_size;
+    strm->avail_in = (uInt)job->in_size;
+    strm->next_out = job->out;
+    strm->avail_out = (uInt)out_capacity;
+    /* a sync flush ends the block on a byte boundary, where the next one starts */
+    err = deflate(strm, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+    job->out_size = out_capacity - strm->avail_out;
+    job->crc32 = mzCrc32(0, job->in + job->dict_size, job->in_size);
+
+    if (job->last)
+        return (err==Z_STREAM_END) ? Z_OK : Z_BUF_ERROR;
+    if ((err==Z_OK) && (strm->avail_in==0) && (strm->avail_out>0))
+        return Z_OK;
+    return (err==Z_OK) ? Z_BUF_ERROR : err;
+}
+
+local void* zip64local_RunDeflateWorker(void* arg)
+{
+    zip64_deflate_worker* worker = (zip64_deflate_worker*)arg;
+    zip64_deflate_pool* pool = worker->pool;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;)
+    {
+        zip64_deflate_job* job;
+        while ((pool->nb_queued==0) && (!pool->closing))
+            pthread_cond_wait(&pool->job_queued, &pool->mutex);
+        if (pool->nb_queued==0)
+            break;
+        job = &pool->jobs[pool->next_take];
+        pool->next_take = (pool->next_take+1) % pool->nb_jobs;
+        pool->nb_queued--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        job->err = zip64local_DeflateBlock(&worker->stream, job, pool->out_capacity);
+
+        pthread_mutex_lock(&pool->mutex);
+        job->state = ZIP_DEFLATE_JOB_DONE;
+        pthread_cond_broadcast(&pool->job_done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+local void zip64local_FreeDeflatePool(const zlib_allocator_def* pallocator, zip64_deflate_pool* pool)
+{
+    int i;
+    if (pool==NULL)
+        return;
+
+    if (pool->nb_started>0)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pool->closing = 1;
+        pthread_cond_broadcast(&pool->job_queued);
+        pthread_mutex_unlock(&pool->mutex);
+        for (i=0;i<pool->nb_started;i++)
+            pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_queued);
+    pthread_mutex_destroy(&pool->mutex);
+
+    for (i=0;i<pool->nb_workers;i++)
+        if (pool->workers[i].stream.state!=NULL)
+            deflateEnd(&pool->workers[i].stream);
+    for (i=0;i<pool->nb_jobs;i++)
+    {
+        call_zfree_mem(pallocator, pool->jobs[i].in);
+        call_zfree_mem(pallocator, pool->jobs[i].out);
+    }
+    call_zfree_mem(pallocator, pool->jobs);
+    call_zfree_mem(pallocator, pool->workers);
+    call_zfree_mem(pallocator, pool->threads);
+    call_zfree_mem(pallocator, pool);
+}
+
+/* Make the pool of zi ready for a new file deflated with these parameters.
+   Everything is allocated here, on the calling thread, as the allocator
+   need not be thread safe. */
+local int zip64local_OpenDeflatePool(zip64_internal* zi, int level, int windowBits, int memLevel, int strategy)
+{
+    zip64_deflate_pool* pool = zi->deflate_pool;
+    int i;
+
+    if ((pool!=NULL) && ((pool->level!=level) || (pool->windowBits!=windowBits) ||
+                         (pool->memLevel!=memLevel) || (pool->strategy!=strategy)))
+    {
+        /* the streams are made again for other parameters */
+        zip64local_FreeDeflatePool(&zi->allocator, pool);
+        zi->deflate_pool = pool = NULL;
+    }
+
+    if (pool==NULL)
+    {
+        int err = Z_OK;
+        pool = (zip64_deflate_pool*)call_zalloc_mem(&zi->allocator, sizeof(zip64_deflate_pool));
+        if (pool==NULL)
+            return ZIP_INTERNALERROR;
+        memset(pool, 0, sizeof(zip64_deflate_pool));
+        pool->nb_workers = zi->deflate_workers;
+        pool->nb_jobs = 2 * zi->deflate_workers;
+        pool->block_size = zi->deflate_block_size;
+        pool->level = level;
+        pool->windowBits = windowBits;
+        pool->memLevel = memLevel;
+        pool->strategy = strategy;
+        if (pthread_mutex_init(&pool->mutex, NULL)!=0)
+        {
+            call_zfree_mem(&zi->allocator, pool);
+            return ZIP_INTERNALERROR;
+        }
+        pthread_cond_init(&pool->job_queued, NULL);
+        pthread_cond_init(&pool->job_done, NULL);
+
+        pool->workers = (zip64_deflate_worker*)call_zalloc_mem(&zi->allocator, pool->nb_workers * sizeof(zip64_deflate_worker));
+        pool->threads = (pthread_t*)call_zalloc_mem(&zi->allocator, pool->nb_workers * sizeof(pthread_t));
+        pool->jobs = (zip64_deflate_job*)call_zalloc_mem(&zi->allocator, pool->nb_jobs * sizeof(zip64_deflate_job));
+        if ((pool->workers==NULL) || (pool->threads==NULL) || (pool->jobs==NULL))
+            err = Z_MEM_ERROR;
+        else
+        {
+            memset(pool->workers, 0, pool->nb_workers * sizeof(zip64_deflate_worker));
+            memset(pool->jobs, 0, pool->nb_jobs * sizeof(zip64_deflate_job));
+        }
+
+        for (i=0;(err==Z_OK) && (i<pool->nb_workers);i++)
+        {
+            z_stream* strm = &pool->workers[i].stream;
+            pool->workers[i].pool = pool;
+            strm->zalloc = zlib_alloc_from_allocator;
+            strm->zfree = zlib_free_from_allocator;
+            strm->opaque = (voidpf)&zi->allocator;
+            err = deflateInit2(strm, level, Z_DEFLATED, windowBits, memLevel, strategy);
+            if (err!=Z_OK)
+                strm->state = NULL;
+        }
+        if (err==Z_OK)
+            pool->out_capacity = deflateBound(&pool->workers[0].stream, pool->block_size) + 16;
+
+        for (i=0;(err==Z_OK) && (i<pool->nb_jobs);i++)
+        {
+            pool->jobs[i].in = (unsigned char*)call_zalloc_mem(&zi->allocator, ZIP_DEFLATE_DICT_SIZE + pool->block_size);
+            pool->jobs[i].out = (unsigned char*)call_zalloc_mem(&zi->allocator, pool->out_capacity);
+            if ((pool->jobs[i].in==NULL) || (pool->jobs[i].out==NULL))
+                err = Z_MEM_ERROR;
+        }
+
+        if (err!=Z_OK)
+        {
+            if (pool->workers==NULL)
+                pool->nb_workers = 0;
+            if (pool->jobs==NULL)
+                pool->nb_jobs = 0;
+            zip64local_FreeDeflatePool(&zi->allocator, pool);
+            return ZIP_INTERNALERROR;
+        }
+        zi->deflate_pool = pool;
+    }
+
+    /* every job of the previous file was written */
+    pool->next_fill = pool->next_take = pool->next_write = 0;
+    pool->nb_queued = pool->nb_in_flight = 0;
+    pool->jobs[0].dict_size = 0;
+    pool->jobs[0].in_size = 0;
+    return ZIP_OK;
+}
+
+/* Copy the deflated block of job to the zipfile through buffered_data,
+   where it is encrypted if needed */
+local int zip64local_WriteDeflateJob(zip64_internal* zi, zip64_deflate_job* job)
+{
+    const unsigned char* out = job->out;
+    uLong left = job->out_size;
+    int err = (job->err==Z_OK) ? ZIP_OK : ZIP_INTERNALERROR;
+
+    while ((err==ZIP_OK) && (left>0))
+    {
+        uLong copy_this = Z_BUFSIZE - zi->ci.pos_in_buffered_data;
+        if (copy_this>left)
+            copy_this = left;
+        memcpy(zi->ci.buffered_data + zi->ci.pos_in_buffered_data, out, copy_this);
+        zi->ci.pos_in_buffered_data += (uInt)copy_this;
+        out += copy_this;
+        left -= copy_this;
+        if ((zi->ci.pos_in_buffered_data==Z_BUFSIZE) && (zip64FlushWriteBuffer(zi)==ZIP_ERRNO))
+            err = ZIP_ERRNO;
+    }
+
+    zi->ci.crc32 = mzCrc32Combine(zi->ci.crc32, job->crc32, job->in_size);
+    zi->ci.totalUncompressedData += job->in_size;
+    job->state = ZIP_DEFLATE_JOB_FREE;
+    return err;
+}
+
+/* Write the oldest jobs of the ring, waiting for them if wait is set, or
+   as long as they are done otherwise */
+local int zip64local_WriteDeflateJobs(zip64_internal* zi, int wait, int nb_max)
+{
+    zip64_deflate_pool* pool = zi->deflate_pool;
+    int err = ZIP_OK;
+
+    while ((pool->nb_in_flight>0) && (nb_max>0))
+    {
+        zip64_deflate_job* job = &pool->jobs[pool->next_write];
+        int state;
+        int tmp_err;
+
+        pthread_mutex_lock(&pool->mutex);
+        while (wait && (job->state!=ZIP_DEFLATE_JOB_DONE))
+            pthread_cond_wait(&pool->job_done, &pool->mutex);
+        state = job->state;
+        pthread_mutex_unlock(&pool->mutex);
+        if (state!=ZIP_DEFLATE_JOB_DONE)
+            break;
+
+        tmp_err = zip64local_WriteDeflateJob(zi, job);
+        if (err==ZIP_OK)
+            err = tmp_err;
+        pool->next_write = (pool->next_write+1) % pool->nb_jobs;
+        pool->nb_in_flight--;
+        nb_max--;
+    }
+    return err;
+}
+
+/* Submit the job being filled, and start filling the next one */
+local int zip64local_SubmitDeflateJob(zip64_internal* zi, int last)
+{
+    zip64_deflate_pool* pool = zi->deflate_pool;
+    zip64_deflate_job* job = &pool->jobs[pool->next_fill];
+    zip64_deflate_job* next_job;
+    int err = ZIP_OK;
+
+    job->last = last;
+    if (last && (pool->nb_in_flight==0))
+    {
+        /* the file fits in one block : no thread needed */
+        job->err = zip64local_DeflateBlock(&pool->workers[0].stream, job, pool->out_capacity);
+        return zip64local_WriteDeflateJob(zi, job);
+    }
+
+    while (pool->nb_started<pool->nb_workers)
+    {
+        if (pthread_create(&pool->threads[pool->nb_started], NULL,
+                           zip64local_RunDeflateWorker, &pool->workers[pool->nb_started])!=0)
+            break;
+        pool->nb_started++;
+    }
+    if (pool->nb_started==0)
+    {
+        /* no thread could be started, the block is deflated here */
+        job->err = zip64local_DeflateBlock(&pool->workers[0].stream, job, pool->out_capacity);
+        job->state = ZIP_DEFLATE_JOB_DONE;
+    }
+    else
+    {
+        pthread_mutex_lock(&pool->mutex);
+        job->state = ZIP_DEFLATE_JOB_QUEUED;
+        pool->nb_queued++;
+        pthread_cond_signal(&pool->job_queued);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    pool->nb_in_flight++;
+    if (last)
+        return ZIP_OK;
+
+    /* the next job of the ring must have been written before it is filled again */
+    pool->next_fill = (pool->next_fill+1) % pool->nb_jobs;
+    next_job = &pool->jobs[pool->next_fill];
+    if (pool->nb_in_flight==pool->nb_jobs)
+        err = zip64local_WriteDeflateJobs(zi, 1, 1);
+    if (err==ZIP_OK)
+        err = zip64local_WriteDeflateJobs(zi, 0, pool->nb_jobs);
+
+    /* the full previous block is read by its worker only, it can be copied from */
+    next_job->dict_size = ZIP_DEFLATE_DICT_SIZE;
+    memcpy(next_job->in, job->in + job->dict_size + job->in_size - ZIP_DEFLATE_DICT_SIZE, ZIP_DEFLATE_DICT_SIZE);
+    next_job->in_size = 0;
+    return err;
+}
+
+/* Deflate the end of the file, and write all its blocks */
+local int zip64local_CloseDeflatePool(zip64_internal* zi)
+{
+    zip64_deflate_pool* pool = zi->deflate_pool;
+    int err = zip64local_SubmitDeflateJob(zi, 1);
+    int tmp_err = zip64local_WriteDeflateJobs(zi, 1, pool->nb_jobs);
+    if (err==ZIP_OK)
+        err = tmp_err;
+    return err;
+}
+
+#endif
+
 extern int ZEXPORT zipWriteInFileInZip (zipFile file,const void* buf,unsigned int len)
 {
     zip64_internal* zi;
@@ -1415,7 +1768,32 @@ extern int ZEXPORT zipWriteInFileInZip (zipFile file,const void* buf,unsigned in
     if (zi->in_opened_file_inzip == 0)
         return ZIP_PARAMERROR;
 
-    zi->ci.crc32 = crc32(zi->ci.crc32,buf,(uInt)len);
+#ifdef MZ_HAVE_PTHREAD
+    if (zi->ci.parallel)
+    {
+        /* the blocks are filled here, their crc is computed by the workers */
+        zip64_deflate_pool* pool = zi->deflate_pool;
+        const unsigned char* in = (const unsigned char*)buf;
+        while ((err==ZIP_OK) && (len>0))
+        {
+            zip64_deflate_job* job = &pool->jobs[pool->next_fill];
+            uLong copy_this = pool->block_size - job->in_size;
+            if (copy_this>len)
+                copy_this = len;
+            memcpy(job->in + job->dict_size + job->in_size, in, copy_this);
+            job->in_size += copy_this;
+            in += copy_this;
+            len -= (unsigned int)copy_this;
+            if (job->in_size==pool->block_size)
+                err = zip64local_SubmitDeflateJob(zi, 0);
+        }
+        return err;
+    }
+#endif
+
+    /* the crc of raw data is given to zipCloseFileInZipRaw */
+    if (!zi->ci.raw)
+        zi->ci.crc32 = mzCrc32(zi->ci.crc32,(const unsigned char*)buf,(uInt)len);
 
 #ifdef HAVE_BZIP2
     if(zi->ci.method == Z_BZIP2ED && (!zi->ci.raw))
@@ -1531,6 +1909,11 @@ extern int ZEXPORT zipCloseFileInZipRaw64 (zipFile file, ZPOS64_T uncompressed_s
         return ZIP_PARAMERROR;
     zi->ci.stream.avail_in = 0;
 
+#ifdef MZ_HAVE_PTHREAD
+    if (zi->ci.parallel)
+        err = zip64local_CloseDeflatePool(zi);
+    else
+#endif
     if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
                 {
                         while (err==ZIP_OK)
@@ -1590,7 +1973,12 @@ extern int ZEXPORT zipCloseFileInZipRaw64 (zipFile file, ZPOS64_T uncompressed_s
             err = ZIP_ERRNO;
                 }
 
-    if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
+    if (zi->ci.parallel)
+    {
+        /* the pool is kept for the next file */
+        zi->ci.parallel = 0;
+    }
+    else if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
     {
         int tmp_err = deflateEnd(&zi->ci.stream);
         if (err == ZIP_OK)
@@ -1707,9 +2095,9 @@ extern int ZEXPORT zipCloseFileInZipRaw64 (zipFile file, ZPOS64_T uncompressed_s
     }
 
     if (err==ZIP_OK)
-        err = add_data_in_datablock(&zi->central_dir, zi->ci.central_header, (uLong)zi->ci.size_centralheader);
+        err = add_data_in_central_dir(&zi->allocator,&zi->central_dir, zi->ci.central_header, (size_t)zi->ci.size_centralheader);
 
-    free(zi->ci.central_header);
+    call_zfree_mem(&zi->allocator,zi->ci.central_header);
 
     if (err==ZIP_OK)
     {
@@ -1901,6 +2289,7 @@ extern int ZEXPORT zipClose (zipFile file, const char* global_comment)
     uLong size_centraldir = 0;
     ZPOS64_T centraldir_pos_inzip;
     ZPOS64_T pos;
+    zlib_allocator_def allocator;
 
     if (file == NULL)
         return ZIP_PARAMERROR;
@@ -1919,25 +2308,17 @@ extern int ZEXPORT zipClose (zipFile file, const char* global_comment)
 
     centraldir_pos_inzip = ZTELL64(zi->z_filefunc,zi->filestream);
 
-    if (err==ZIP_OK)
+    size_centraldir = (uLong)zi->central_dir.size;
+    if ((err==ZIP_OK) && (size_centraldir>0))
     {
-        linkedlist_datablock_internal* ldi = zi->central_dir.first_block;
-        while (ldi!=NULL)
-        {
-            if ((err==ZIP_OK) && (ldi->filled_in_this_block>0))
-            {
-                if (ZWRITE64(zi->z_filefunc,zi->filestream, ldi->data, ldi->filled_in_this_block) != ldi->filled_in_this_block)
-                    err = ZIP_ERRNO;
-            }
-
-            size_centraldir += ldi->filled_in_this_block;
-            ldi = ldi->next_datablock;
-        }
+        if (ZWRITE64(zi->z_filefunc,zi->filestream, zi->central_dir.data, size_centraldir) != size_centraldir)
+            err = ZIP_ERRNO;
     }
-    free_linkedlist(&(zi->central_dir));
+    free_central_dir(&zi->allocator,&(zi->central_dir));
 
     pos = centraldir_pos_inzip - zi->add_position_when_writting_offset;
-    if(pos >= 0xffffffff)
+    /* the end of central directory record then refers to the zip64 one */
+    if((pos >= 0xffffffff) || (zi->number_entry >= 0xffff))
     {
       ZPOS64_T Zip64EOCDpos = ZTELL64(zi->z_filefunc,zi->filestream);
       Write_Zip64EndOfCentralDirectoryRecord(zi, size_centraldir, centraldir_pos_inzip);
@@ -1955,10 +2336,15 @@ extern int ZEXPORT zipClose (zipFile file, const char* global_comment)
         if (err == ZIP_OK)
             err = ZIP_ERRNO;
 
+    allocator = zi->allocator;
+#ifdef MZ_HAVE_PTHREAD
+    zip64local_FreeDeflatePool(&allocator,zi->deflate_pool);
+#endif
 #ifndef NO_ADDFILEINEXISTINGZIP
-    TRYFREE(zi->globalcomment);
+    call_zfree_mem(&allocator,zi->globalcomment);
 #endif
-    TRYFREE(zi);
+    call_zfree_mem(&allocator,zi);
+    call_zrelease_mem(&allocator);
 
     return err;
 }
@@ -1969,8 +2355,8 @@ extern int ZEXPORT zipRemoveExtraInfoBlock (char* pData, int* dataLen, short sHe
   int size = 0;
   char* pNewHeader;
   char* pTmp;
-  short header;
-  short dataSize;
+  uLong header;
+  uLong dataSize;
 
   int retVal = ZIP_OK;
 
@@ -1978,25 +2364,41 @@ extern int ZEXPORT zipRemoveExtraInfoBlock (char* pData, int* dataLen, short sHe
     return ZIP_PARAMERROR;
 
   pNewHeader = (char*)ALLOC(*dataLen);
+  if (pNewHeader == NULL)
+    return ZIP_INTERNALERROR;
   pTmp = pNewHeader;
 
   while(p < (pData + *dataLen))
   {
-    header = *(short*)p;
-    dataSize = *(((short*)p)+1);
+    int rest = (int)((pData + *dataLen) - p);
 
-    if( header == sHeader ) // Header found.
-    {
-      p += dataSize + 4; // skip it. do not copy to temp buffer
-    }
+    // the extra field may come from an archive being copied: read the
+    // header id and size as little endian shorts wherever they are, and
+    // keep a truncated block as it is
+    if (rest < 4)
+      dataSize = (uLong)rest;
     else
     {
-      // Extra Info block should not be removed, So copy it to the temp buffer.
-      memcpy(pTmp, p, dataSize + 4);
-      p += dataSize + 4;
-      size += dataSize + 4;
+      header = zip64local_getShortFromBuffer((const unsigned char*)p);
+      dataSize = zip64local_getShortFromBuffer((const unsigned char*)p + 2);
+      if (dataSize > (uLong)(rest - 4))
+        dataSize = (uLong)rest;
+      else
+      {
+        dataSize += 4;
+        if( header == (uLong)(unsigned short)sHeader ) // Header found.
+        {
+          p += dataSize; // skip it. do not copy to temp buffer
+          continue;
+        }
+      }
     }
 
+    // Extra Info block should not be removed, So copy it to the temp buffer.
+    memcpy(pTmp, p, dataSize);
+    pTmp += dataSize;
+    p += dataSize;
+    size += (int)dataSize;
   }
 
   if(size < *dataLen)
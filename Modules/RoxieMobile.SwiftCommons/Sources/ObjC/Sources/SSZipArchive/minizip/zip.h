@@ -144,6 +144,39 @@ extern zipFile ZEXPORT zipOpen2_64 OF((const void *pathname,
                                    zipcharpc* globalcomment,
                                    zlib_filefunc64_def* pzlib_filefunc_def));
 
+/* zip_open_options contain the options of zipOpen4, a field left to 0 takes
+   its default value */
+typedef struct zip_open_options_s
+{
+    const zlib_allocator_def* allocator; /* allocator of the internal memory of the handle
+                                   (central directory, buffers, comment) and of its
+                                   zlib streams, malloc by default */
+    int deflate_workers;        /* threads deflating each file in blocks, in parallel
+                                   (0 or 1 for a single zlib stream on the calling thread) */
+    uLong deflate_block_size;   /* size of these blocks, at least 32K, 128K by default */
+    ZPOS64_T expected_entries;  /* number of files the zipfile should end with, to allocate
+                                   its central directory at once instead of growing it */
+} zip_open_options;
+
+extern zipFile ZEXPORT zipOpen4 OF((const void *pathname,
+                                   int append,
+                                   zipcharpc* globalcomment,
+                                   zlib_filefunc64_def* pzlib_filefunc_def,
+                                   const zip_open_options* options));
+/*
+  Open a zipfile, like zipOpen2_64, with the options given in *options
+    (options can be NULL for the default values).
+  An allocator with zrelease_mem (fill_arena_allocator) belongs to the handle
+    from then on : it is released by zipClose, or at once if the zipfile cannot
+    be opened.
+  With deflate_workers above 1, the data of a deflated file (not raw) is cut in
+    blocks deflated by a pool of threads, each block primed with the last 32K of
+    the previous one and ended by a sync flush, so that the blocks joined in
+    order make one deflate stream. It is a little larger than a single stream.
+    The threads are started by the first file longer than one block, and
+    stopped by zipClose.
+*/
+
 extern int ZEXPORT zipOpenNewFileInZip OF((zipFile file,
                        const char* filename,
                        const zip_fileinfo* zipfi,
@@ -303,6 +336,48 @@ extern int ZEXPORT zipOpenNewFileInZip4_64 OF((zipFile file,
     flag : value for flag field (compression level info will be added)
  */
 
+/* Compression of the files of one extension, for zipChooseCompression */
+typedef struct zip_compression_rule_s
+{
+    const char* extension;      /* extension of the file name, without the dot,
+                                   compared ignoring case */
+    int level;                  /* level of these files, 0 to store them */
+    int strategy;               /* strategy of deflateInit2 for these files */
+} zip_compression_rule;
+
+/* Policy of zipChooseCompression, a field left to 0 takes its default value */
+typedef struct zip_compression_policy_s
+{
+    const zip_compression_rule* rules; /* per-extension overrides, checked first */
+    uInt nb_rules;
+    int level;                  /* level of the other files, Z_DEFAULT_COMPRESSION by default */
+    int strategy;               /* strategy of the other files */
+    int min_savings;            /* percent of its size a file is expected to save, from the
+                                   entropy of its first bytes, else it is stored ; 4 by
+                                   default, negative to deflate whatever the entropy */
+} zip_compression_policy;
+
+extern int ZEXPORT zipChooseCompression OF((const zip_compression_policy* policy,
+                                            const char* filename,
+                                            const void* sample,
+                                            uLong sample_size,
+                                            int* method,
+                                            int* level,
+                                            int* strategy));
+/*
+  Choose the method, level and strategy of a file for zipOpenNewFileInZip4_64,
+    from its name and the first bytes of its content, so that files which do
+    not shrink are not deflated (policy can be NULL for the default values,
+    sample can be NULL when the content is not known yet).
+  In order : a rule of policy for the extension of filename ; the extensions
+    and the magic numbers of compressed formats (JPEG, PNG, GIF, MP3, MP4,
+    zip, gzip, xz...), stored ; the entropy of the bytes of sample (the first
+    64K are used), stored if it leaves less than min_savings ; then the level
+    and strategy of policy.
+  *method receives Z_DEFLATED, or 0 to store the file with level 0.
+  Return ZIP_OK, or ZIP_PARAMERROR.
+*/
+
 
 extern int ZEXPORT zipWriteInFileInZip OF((zipFile file,
                        const void* buf,